@@ -0,0 +1,34 @@
+# Post-build report: size of the HomeKit accessory database pointer tables
+# (accessory_db_* in main.c) per memory region. Only the pointer arrays are
+# counted; the characteristic, service and accessory objects they point to
+# stay in DRAM. A table listed as DRAM lost its const qualifier.
+#
+# Usage: cmake -DNM=<nm> -DELF=<elf> -P accessory-db-size.cmake
+
+execute_process(
+    COMMAND ${NM} -S ${ELF}
+    OUTPUT_VARIABLE nm_output
+    RESULT_VARIABLE nm_result)
+if(NOT nm_result EQUAL 0)
+    message(WARNING "accessory database report: ${NM} failed on ${ELF}")
+    return()
+endif()
+
+set(flash_bytes 0)
+set(dram_bytes 0)
+set(tables 0)
+string(REPLACE "\n" ";" nm_lines "${nm_output}")
+foreach(line IN LISTS nm_lines)
+    if(line MATCHES "^[0-9a-fA-F]+ ([0-9a-fA-F]+) ([A-Za-z]) accessory_db_[A-Za-z0-9_]+")
+        math(EXPR size "0x${CMAKE_MATCH_1}")
+        string(TOLOWER "${CMAKE_MATCH_2}" type)
+        math(EXPR tables "${tables} + 1")
+        if(type STREQUAL "r")
+            math(EXPR flash_bytes "${flash_bytes} + ${size}")
+        else()
+            math(EXPR dram_bytes "${dram_bytes} + ${size}")
+        endif()
+    endif()
+endforeach()
+
+message("Accessory database pointer tables: ${tables} tables, ${flash_bytes} bytes in flash (saved from DRAM), ${dram_bytes} bytes in DRAM; characteristic/service objects not included")
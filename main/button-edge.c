@@ -0,0 +1,346 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/gptimer.h>
+#include <soc/soc_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "button-edge.h"
+
+static const char *BUTTON_EDGE_TAG = "BUTTON";
+
+// Boven de relay actuator: de press-down flank moet direct doorgezet worden
+#define BUTTON_EDGE_TASK_PRIORITY   (configMAX_PRIORITIES - 4)
+// Ook de factory reset (long press) loopt op deze stack
+#define BUTTON_EDGE_TASK_STACK      4096
+#define BUTTON_EDGE_QUEUE_LENGTH    8
+
+typedef enum {
+    BUTTON_EDGE_MSG_DOWN = 0,
+    BUTTON_EDGE_MSG_UP,
+    BUTTON_EDGE_MSG_LONG,
+    BUTTON_EDGE_MSG_WINDOW,
+} button_edge_msg_type_t;
+
+typedef struct {
+    button_edge_msg_type_t type;
+    int64_t at_us;
+} button_edge_msg_t;
+
+static button_edge_config_t s_config;
+static button_edge_callback_fn s_callback = NULL;
+static void *s_callback_ctx = NULL;
+static QueueHandle_t s_queue = NULL;
+static gptimer_handle_t s_debounce_timer = NULL;
+static esp_timer_handle_t s_long_timer = NULL;
+static esp_timer_handle_t s_window_timer = NULL;
+
+// Alleen de GPIO ISR (interrupt aan) of het debounce alarm (interrupt uit) schrijft
+static atomic_bool s_pressed = false;
+static uint32_t s_presses = 0;
+static int64_t s_first_press_us = 0;
+static bool s_long_fired = false;
+
+static inline gpio_int_type_t button_edge_level_intr(bool pressed) {
+    // Interrupt op het level dat de knop in 'pressed' brengt
+    return (pressed == s_config.active_low) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+}
+
+static inline bool button_edge_read_pressed(void) {
+    return (gpio_get_level(s_config.gpio) == 0) == s_config.active_low;
+}
+
+static inline void button_edge_debounce_start(void) {
+    gptimer_set_raw_count(s_debounce_timer, 0);
+    gptimer_start(s_debounce_timer);
+}
+
+static bool button_edge_post_from_isr(bool pressed) {
+    button_edge_msg_t msg = {
+        .type = pressed ? BUTTON_EDGE_MSG_DOWN : BUTTON_EDGE_MSG_UP,
+        .at_us = esp_timer_get_time(),
+    };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(s_queue, &msg, &woken);
+    return woken == pdTRUE;
+}
+
+// Er is een level interrupt op de tegenovergestelde toestand: elke aanroep is
+// dus een flank. Tot het debounce alarm afgaat blijft de interrupt uit.
+static void button_edge_isr(void *arg) {
+    (void)arg;
+    gpio_intr_disable(s_config.gpio);
+
+    bool pressed = !atomic_load(&s_pressed);
+    atomic_store(&s_pressed, pressed);
+    button_edge_debounce_start();
+
+    if (button_edge_post_from_isr(pressed)) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// Einde van het dendervenster (GPTimer alarm, ISR context): is het level
+// intussen weer omgeslagen, dan is de laatste flank gemist en sturen we die
+// alsnog, met een nieuw venster. Anders de interrupt weer aan op de volgende
+// flank. Het type wisselt alleen; een wakeup enable blijft staan.
+static bool button_edge_debounce_done(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata,
+                                      void *user_ctx) {
+    (void)edata;
+    (void)user_ctx;
+    gptimer_stop(timer);
+
+    bool pressed = button_edge_read_pressed();
+    if (pressed != atomic_load(&s_pressed)) {
+        atomic_store(&s_pressed, pressed);
+        button_edge_debounce_start();
+        return button_edge_post_from_isr(pressed);
+    }
+
+    gpio_set_intr_type(s_config.gpio, button_edge_level_intr(!pressed));
+    gpio_intr_enable(s_config.gpio);
+    return false;
+}
+
+static void button_edge_timer_post(void *arg) {
+    button_edge_msg_t msg = {
+        .type = (button_edge_msg_type_t)(uintptr_t)arg,
+        .at_us = esp_timer_get_time(),
+    };
+    xQueueSend(s_queue, &msg, 0);
+}
+
+static void button_edge_emit(button_edge_event_type_t type, uint32_t presses, int64_t edge_us) {
+    button_edge_event_t event = {
+        .type = type,
+        .presses = presses,
+        .edge_us = edge_us,
+    };
+    s_callback(&event, s_callback_ctx);
+}
+
+static void button_edge_on_down(int64_t at_us) {
+    s_long_fired = false;
+    esp_timer_stop(s_long_timer);
+    esp_timer_start_once(s_long_timer, (uint64_t)s_config.long_press_ms * 1000ULL);
+
+    if (s_config.multi_press_ms == 0U) {
+        button_edge_emit(BUTTON_EDGE_PRESS, 1, at_us);
+        return;
+    }
+
+    if (s_presses++ == 0U) {
+        s_first_press_us = at_us;
+    }
+    esp_timer_stop(s_window_timer);
+    esp_timer_start_once(s_window_timer, (uint64_t)s_config.multi_press_ms * 1000ULL);
+}
+
+static void button_edge_task(void *arg) {
+    (void)arg;
+    button_edge_msg_t msg;
+
+    for (;;) {
+        if (xQueueReceive(s_queue, &msg, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        switch (msg.type) {
+            case BUTTON_EDGE_MSG_DOWN:
+                button_edge_on_down(msg.at_us);
+                break;
+            case BUTTON_EDGE_MSG_UP:
+                esp_timer_stop(s_long_timer);
+                break;
+            case BUTTON_EDGE_MSG_LONG:
+                if (!atomic_load(&s_pressed) || s_long_fired) {
+                    break;
+                }
+                // Een long press telt niet mee als (multi-)press
+                s_long_fired = true;
+                s_presses = 0;
+                esp_timer_stop(s_window_timer);
+                button_edge_emit(BUTTON_EDGE_LONG_PRESS, 1, msg.at_us);
+                break;
+            case BUTTON_EDGE_MSG_WINDOW: {
+                uint32_t presses = s_presses;
+                s_presses = 0;
+                if (presses == 0U) {
+                    break;
+                }
+                button_edge_emit(presses == 1U ? BUTTON_EDGE_PRESS : BUTTON_EDGE_MULTI_PRESS,
+                                 presses, s_first_press_us);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static esp_err_t button_edge_timer_create(esp_timer_cb_t callback, void *arg, const char *name,
+                                          esp_timer_handle_t *out_timer) {
+    const esp_timer_create_args_t args = {
+        .callback = callback,
+        .arg = arg,
+        .name = name,
+    };
+    return esp_timer_create(&args, out_timer);
+}
+
+// Eenmalig alarm op debounce_ms; de ISR's zetten de teller op 0 en starten hem
+static esp_err_t button_edge_debounce_create(void) {
+    gptimer_config_t timer_cfg = {
+#if SOC_TIMER_GROUP_SUPPORT_XTAL
+        // Geen APB PM lock, dus automatic light sleep blijft mogelijk
+        .clk_src = GPTIMER_CLK_SRC_XTAL,
+#else
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+#endif
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,  // 1 tick = 1 us
+    };
+    esp_err_t err = gptimer_new_timer(&timer_cfg, &s_debounce_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = (uint64_t)s_config.debounce_ms * 1000ULL,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = button_edge_debounce_done,
+    };
+    err = gptimer_set_alarm_action(s_debounce_timer, &alarm);
+    if (err == ESP_OK) {
+        err = gptimer_register_event_callbacks(s_debounce_timer, &cbs, NULL);
+    }
+    if (err == ESP_OK) {
+        err = gptimer_enable(s_debounce_timer);
+    }
+    if (err != ESP_OK) {
+        gptimer_del_timer(s_debounce_timer);
+        s_debounce_timer = NULL;
+    }
+    return err;
+}
+
+esp_err_t button_edge_init(const button_edge_config_t *config, button_edge_callback_fn callback, void *ctx) {
+    if (config == NULL || callback == NULL || config->gpio < 0 || config->long_press_ms == 0U) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_config = *config;
+    if (s_config.debounce_ms == 0U) {
+        s_config.debounce_ms = 1;
+    }
+    s_callback = callback;
+    s_callback_ctx = ctx;
+
+    s_queue = xQueueCreate(BUTTON_EDGE_QUEUE_LENGTH, sizeof(button_edge_msg_t));
+    if (s_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = button_edge_debounce_create();
+    if (err != ESP_OK) {
+        ESP_LOGE(BUTTON_EDGE_TAG, "Failed to create debounce GPTimer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = button_edge_timer_create(button_edge_timer_post, (void *)(uintptr_t)BUTTON_EDGE_MSG_LONG,
+                                   "btn_long", &s_long_timer);
+    if (err == ESP_OK) {
+        err = button_edge_timer_create(button_edge_timer_post, (void *)(uintptr_t)BUTTON_EDGE_MSG_WINDOW,
+                                       "btn_multi", &s_window_timer);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(BUTTON_EDGE_TAG, "Failed to create button timers: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (xTaskCreate(button_edge_task, "button_edge", BUTTON_EDGE_TASK_STACK, NULL,
+                    BUTTON_EDGE_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << s_config.gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = s_config.active_low ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = s_config.active_low ? GPIO_PULLDOWN_DISABLE : GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    err = gpio_config(&io);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Begin in de huidige toestand; de interrupt wacht op de andere
+    bool pressed = button_edge_read_pressed();
+    atomic_store(&s_pressed, pressed);
+    gpio_set_intr_type(s_config.gpio, button_edge_level_intr(!pressed));
+
+    if (s_config.sleep_wakeup) {
+        // Zelfde level type als de interrupt: gpio_wakeup_enable schrijft
+        // dat register ook, dus niet los via lifecycle_power_enable_gpio_wakeup
+        err = gpio_wakeup_enable(s_config.gpio, button_edge_level_intr(!pressed));
+        if (err == ESP_OK) {
+            err = esp_sleep_enable_gpio_wakeup();
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(BUTTON_EDGE_TAG, "Failed to enable GPIO %d wakeup: %s", s_config.gpio, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(BUTTON_EDGE_TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = gpio_isr_handler_add(s_config.gpio, button_edge_isr, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(BUTTON_EDGE_TAG, "Failed to add button ISR: %s", esp_err_to_name(err));
+        return err;
+    }
+    gpio_intr_enable(s_config.gpio);
+
+    ESP_LOGI(BUTTON_EDGE_TAG, "Instant button on GPIO %d (debounce %u ms, long press %u ms, multi-press %s)",
+             s_config.gpio, (unsigned)s_config.debounce_ms, (unsigned)s_config.long_press_ms,
+             s_config.multi_press_ms > 0U ? "on" : "off");
+    return ESP_OK;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int gpio;
+    bool active_low;
+    uint32_t debounce_ms;       // flanken binnen dit venster na een flank zijn dender
+    uint32_t long_press_ms;
+    uint32_t multi_press_ms;    // 0 = geen multi-press: PRESS direct op de press-down flank
+    bool sleep_wakeup;          // knop ook als light sleep wakeup bron (eco profiel)
+} button_edge_config_t;
+
+typedef enum {
+    BUTTON_EDGE_PRESS = 0,
+    BUTTON_EDGE_MULTI_PRESS,    // alleen met multi_press_ms > 0; 'presses' >= 2
+    BUTTON_EDGE_LONG_PRESS,
+} button_edge_event_type_t;
+
+typedef struct {
+    button_edge_event_type_t type;
+    uint32_t presses;
+    int64_t edge_us;            // esp_timer tijd van de (eerste) press-down flank
+} button_edge_event_t;
+
+// Wordt aangeroepen vanuit de button task (niet vanuit de ISR)
+typedef void (*button_edge_callback_fn)(const button_edge_event_t *event, void *ctx);
+
+// Knop met level interrupt die bij elke flank van polariteit wisselt, zodat
+// hij ook als light sleep wakeup bron blijft werken; met sleep_wakeup regelt
+// button_edge_init die zelf. De debounce loopt op een GPTimer alarm (ISR),
+// long/multi-press timing op esp_timer.
+esp_err_t button_edge_init(const button_edge_config_t *config, button_edge_callback_fn callback, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -28,28 +28,49 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include <esp_event.h>
+#include <esp_heap_caps.h>
 #include <esp_netif.h>
 #include <esp_wifi.h>
 #include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_random.h>
 #include <esp_system.h>
 #include <esp_ota_ops.h>
 #include <esp_app_desc.h>
 #include <esp_partition.h>
+#include <esp_pm.h>
+#include <esp_rom_crc.h>
 #include <esp_sleep.h>
 #include <esp_timer.h>
+#if CONFIG_LCM_WIFI_ROAMING
+#include <esp_rrm.h>
+#include <esp_wnm.h>
+#endif
+#include <lwip/dhcp.h>
+#include <lwip/sockets.h>
 #include <mdns.h>
 #include <nvs.h>
 #include <nvs_flash.h>
 
+#include <driver/gpio.h>
+
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 
 #include "esp32-lcm.h"
+#include "notify-scheduler.h"
+#include "event-trace.h"
+#if CONFIG_LCM_UPDATE_IN_APP
+#include "ota-download.h"
+#endif
 
 static const char *WIFI_TAG = "WIFI";
 static const char *LIFECYCLE_TAG = "LIFECYCLE";
@@ -65,6 +86,27 @@ static const char *LIFECYCLE_TAG = "LIFECYCLE";
 static void (*s_wifi_on_ready_cb)(void) = NULL;
 static bool s_wifi_started = false;
 static esp_netif_t *s_wifi_netif = NULL;
+static wifi_config_t s_wifi_config;
+static bool s_wifi_directed_attempt = false;
+static bool s_wifi_directed_config_active = false;
+static bool s_wifi_boot_path_recorded = false;
+static lifecycle_wifi_connect_path_t s_wifi_boot_path = LIFECYCLE_WIFI_CONNECT_PATH_NONE;
+static esp_timer_handle_t s_wifi_reconnect_timer = NULL;
+static bool s_wifi_stopping = false;
+static portMUX_TYPE s_wifi_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static lifecycle_wifi_reconnect_stats_t s_wifi_reconnect_stats;
+static int64_t s_wifi_disconnected_since_us = 0;
+
+#ifndef CONFIG_LCM_WIFI_RECONNECT_BASE_MS
+#define CONFIG_LCM_WIFI_RECONNECT_BASE_MS 250
+#endif
+#ifndef CONFIG_LCM_WIFI_RECONNECT_MAX_MS
+#define CONFIG_LCM_WIFI_RECONNECT_MAX_MS 30000
+#endif
+
+#if CONFIG_LCM_WIFI_RECONNECT_BASE_MS <= 0 || CONFIG_LCM_WIFI_RECONNECT_MAX_MS < CONFIG_LCM_WIFI_RECONNECT_BASE_MS
+#error "CONFIG_LCM_WIFI_RECONNECT_MAX_MS must be >= CONFIG_LCM_WIFI_RECONNECT_BASE_MS > 0"
+#endif
 
 static const uint32_t k_post_reset_magic = 0xC0DEC0DE;
 #ifndef CONFIG_LCM_RESTART_COUNTER_TIMEOUT_MS
@@ -88,12 +130,133 @@ RTC_DATA_ATTR static struct {
     uint32_t restart_count;
 } s_post_reset_state;
 
+static const uint32_t k_wifi_fast_magic = 0xC0DEFA57;
+static const char *k_wifi_fast_key = "wifi_fast";
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t authmode;
+} wifi_fast_params_t;
+
+// Last known good association parameters. The RTC copy is the fast path on
+// warm resets, NVS (wifi_cfg/wifi_fast) backs it across power cycles.
+RTC_DATA_ATTR static struct {
+    uint32_t magic;
+    uint32_t valid;
+    wifi_fast_params_t params;
+    uint32_t last_path;
+    uint32_t fast_boots;
+    uint32_t full_scan_boots;
+    uint32_t fallback_boots;
+} s_wifi_fast_state;
+
+#if CONFIG_LCM_WIFI_IP_DHCP_CACHE
+static const uint32_t k_wifi_lease_magic = 0xC0DE1EA5;
+static const char *k_wifi_lease_key = "wifi_lease";
+
+typedef struct {
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+    uint32_t lease_s;
+    int64_t obtained_at_s;
+} wifi_lease_t;
+
+// Last DHCP lease of s_wifi_netif. NVS (wifi_cfg/wifi_lease) is only
+// rewritten when the addresses change; the RTC copy carries the lease time.
+RTC_DATA_ATTR static struct {
+    uint32_t magic;
+    uint32_t valid;
+    wifi_lease_t lease;
+} s_wifi_lease_state;
+#endif
+
+static const uint32_t k_boot_timeline_magic = 0xC0DEB007;
+
+RTC_DATA_ATTR static struct {
+    uint32_t magic;
+    uint32_t current[LIFECYCLE_BOOT_MILESTONE_COUNT];
+    uint32_t previous[LIFECYCLE_BOOT_MILESTONE_COUNT];
+} s_boot_timeline;
+
+static bool s_boot_timeline_started = false;
+static char s_boot_timeline_str[256];
+
 static char s_fw_revision[LIFECYCLE_FW_REVISION_MAX_LEN];
 static bool s_fw_revision_initialized = false;
 static esp_timer_handle_t s_restart_counter_timer = NULL;
 static bool s_nvs_initialized = false;
 
+// Consolidated lifecycle record (lcm/state): loaded once when NVS is
+// initialised, cached in RAM and only written back when a field changed.
+// The legacy keys are still read once to migrate existing devices.
+#define LIFECYCLE_RECORD_VERSION 1
+static const char *k_lifecycle_record_key = "state";
+
+typedef struct {
+    uint16_t version;
+    uint16_t length;
+    uint32_t restart_count;
+    char running_ver[LIFECYCLE_FW_REVISION_MAX_LEN];    // app version that wrote installed_ver
+    char installed_ver[LIFECYCLE_FW_REVISION_MAX_LEN];  // mirror of fwcfg/installed_ver
+    uint8_t wifi_fast_valid;
+    wifi_fast_params_t wifi_fast;
+    uint32_t crc;
+} lifecycle_record_t;
+
+static lifecycle_record_t s_record;
+static bool s_record_loaded = false;
+static bool s_record_dirty = false;
+static bool s_record_drop_legacy = false;
+// The record is updated from the main task and the Wi-Fi event task, which
+// run concurrently during the startup pipeline.
+static SemaphoreHandle_t s_record_lock = NULL;
+static StaticSemaphore_t s_record_lock_buf;
+
+// NVS session layer: one cached handle per namespace for the lifetime of the
+// app, so helpers skip the namespace lookup of nvs_open()/nvs_close() and
+// several set/erase operations share a single nvs_commit().
+#define LIFECYCLE_NVS_SESSION_SLOTS 5
+
+typedef struct {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    nvs_handle_t handle;
+    bool in_use;
+    bool dirty;
+} lifecycle_nvs_session_t;
+
+static lifecycle_nvs_session_t s_nvs_sessions[LIFECYCLE_NVS_SESSION_SLOTS];
+static SemaphoreHandle_t s_nvs_session_lock = NULL;
+static StaticSemaphore_t s_nvs_session_lock_buf;
+static lifecycle_nvs_stats_t s_nvs_stats;
+
+// Count an NVS operation: LIFECYCLE_NVS_OP(writes, nvs_set_u8(...))
+#define LIFECYCLE_NVS_OP(counter, call) (s_nvs_stats.counter++, (call))
+
+// Raw flash erases outside NVS (OTA slots, otadata, the NVS partition itself)
+static struct {
+    uint32_t erases;
+    uint32_t erase_bytes;
+} s_partition_stats;
+
+#define LIFECYCLE_PARTITION_ERASE(part, offset, len) \
+    (s_partition_stats.erases++, s_partition_stats.erase_bytes += (uint32_t)(len), \
+     esp_partition_erase_range((part), (offset), (len)))
+
+typedef struct {
+    lifecycle_nvs_stats_t nvs;
+    uint32_t partition_erases;
+    uint32_t partition_erase_bytes;
+    int64_t start_us;
+} lifecycle_io_scope_t;
+
+static lifecycle_io_cost_t s_io_costs[LIFECYCLE_IO_OP_COUNT];
+static portMUX_TYPE s_io_costs_lock = portMUX_INITIALIZER_UNLOCKED;
+
 void wifi_config_shutdown(void) __attribute__((weak));
+void lifecycle_update_started(void) __attribute__((weak));
 
 static void lifecycle_log_step(const char *step);
 static void lifecycle_mark_post_reset(lifecycle_post_reset_reason_t reason);
@@ -109,6 +272,12 @@ static void lifecycle_perform_common_shutdown(bool reset_homekit_store);
 static esp_err_t load_restart_counter_from_nvs(uint32_t *out_value, const char *log_tag);
 static esp_err_t save_restart_counter_to_nvs(uint32_t value, const char *log_tag);
 static esp_err_t lifecycle_ensure_nvs_initialized(const char *log_tag);
+static esp_err_t lifecycle_record_commit(const char *log_tag);
+static void lifecycle_record_lock(void);
+static void lifecycle_record_unlock(void);
+static esp_err_t lifecycle_nvs_session(const char *namespace, nvs_handle_t *out_handle);
+static void lifecycle_nvs_mark_dirty(const char *namespace);
+static esp_err_t lifecycle_nvs_commit(const char *namespace);
 
 static esp_err_t nvs_load_wifi(char **out_ssid, char **out_pass) {
     esp_err_t init_err = lifecycle_ensure_nvs_initialized(WIFI_TAG);
@@ -117,7 +286,7 @@ static esp_err_t nvs_load_wifi(char **out_ssid, char **out_pass) {
     }
 
     nvs_handle_t handle;
-    esp_err_t err = nvs_open("wifi_cfg", NVS_READONLY, &handle);
+    esp_err_t err = lifecycle_nvs_session("wifi_cfg", &handle);
     if (err != ESP_OK) {
         ESP_LOGE(WIFI_TAG, "NVS open failed for namespace 'wifi_cfg': %s", esp_err_to_name(err));
         return err;
@@ -125,19 +294,17 @@ static esp_err_t nvs_load_wifi(char **out_ssid, char **out_pass) {
 
     size_t len_ssid = 0;
     size_t len_pass = 0;
-    err = nvs_get_str(handle, "wifi_ssid", NULL, &len_ssid);
+    err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "wifi_ssid", NULL, &len_ssid));
     if (err != ESP_OK) {
         ESP_LOGE(WIFI_TAG, "NVS key 'wifi_ssid' not found: %s", esp_err_to_name(err));
-        nvs_close(handle);
         return err;
     }
 
-    err = nvs_get_str(handle, "wifi_password", NULL, &len_pass);
+    err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "wifi_password", NULL, &len_pass));
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         len_pass = 1;
     } else if (err != ESP_OK) {
         ESP_LOGE(WIFI_TAG, "NVS key 'wifi_password' read error: %s", esp_err_to_name(err));
-        nvs_close(handle);
         return err;
     }
 
@@ -146,67 +313,1052 @@ static esp_err_t nvs_load_wifi(char **out_ssid, char **out_pass) {
     if (ssid == NULL || pass == NULL) {
         free(ssid);
         free(pass);
-        nvs_close(handle);
         return ESP_ERR_NO_MEM;
     }
 
-    err = nvs_get_str(handle, "wifi_ssid", ssid, &len_ssid);
+    err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "wifi_ssid", ssid, &len_ssid));
     if (err != ESP_OK) {
         ESP_LOGE(WIFI_TAG, "Failed to read wifi_ssid: %s", esp_err_to_name(err));
         free(ssid);
         free(pass);
-        nvs_close(handle);
         return err;
     }
 
     if (len_pass == 1) {
         pass[0] = '\0';
     } else {
-        err = nvs_get_str(handle, "wifi_password", pass, &len_pass);
+        err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "wifi_password", pass, &len_pass));
         if (err != ESP_OK) {
             ESP_LOGE(WIFI_TAG, "Failed to read wifi_password: %s", esp_err_to_name(err));
             free(ssid);
             free(pass);
-            nvs_close(handle);
             return err;
         }
     }
+    *out_ssid = ssid;
+    *out_pass = pass;
+    return ESP_OK;
+}
+
+static void wifi_fast_state_prepare(void) {
+    if (s_wifi_fast_state.magic == k_wifi_fast_magic) {
+        return;
+    }
+
+    memset(&s_wifi_fast_state, 0, sizeof(s_wifi_fast_state));
+    s_wifi_fast_state.magic = k_wifi_fast_magic;
+}
+
+static esp_err_t nvs_load_wifi_fast(wifi_fast_params_t *out_params) {
+    if (!s_record.wifi_fast_valid) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *out_params = s_record.wifi_fast;
+    return ESP_OK;
+}
+
+static void nvs_store_wifi_fast(const wifi_fast_params_t *params) {
+    lifecycle_record_lock();
+
+    if (params != NULL) {
+        if (s_record.wifi_fast_valid &&
+                memcmp(&s_record.wifi_fast, params, sizeof(*params)) == 0) {
+            lifecycle_record_unlock();
+            return;
+        }
+        s_record.wifi_fast = *params;
+        s_record.wifi_fast_valid = 1;
+    } else {
+        if (!s_record.wifi_fast_valid) {
+            lifecycle_record_unlock();
+            return;
+        }
+        memset(&s_record.wifi_fast, 0, sizeof(s_record.wifi_fast));
+        s_record.wifi_fast_valid = 0;
+    }
+
+    s_record_dirty = true;
+    lifecycle_record_commit(WIFI_TAG);
+    lifecycle_record_unlock();
+}
+
+// Apply the cached BSSID/channel/authmode to 'wc' when available. Returns
+// true when a directed connect will be attempted.
+static bool wifi_fast_reconnect_apply(wifi_config_t *wc) {
+#if CONFIG_LCM_WIFI_FAST_RECONNECT
+    wifi_fast_state_prepare();
+
+    if (!s_wifi_fast_state.valid) {
+        wifi_fast_params_t params;
+        if (nvs_load_wifi_fast(&params) == ESP_OK && params.channel != 0) {
+            s_wifi_fast_state.params = params;
+            s_wifi_fast_state.valid = 1;
+        }
+    }
+
+    if (!s_wifi_fast_state.valid) {
+        return false;
+    }
+
+    const wifi_fast_params_t *params = &s_wifi_fast_state.params;
+    memcpy(wc->sta.bssid, params->bssid, sizeof(wc->sta.bssid));
+    wc->sta.bssid_set = true;
+    wc->sta.channel = params->channel;
+    wc->sta.scan_method = WIFI_FAST_SCAN;
+    if (params->authmode > wc->sta.threshold.authmode && params->authmode < WIFI_AUTH_MAX) {
+        wc->sta.threshold.authmode = (wifi_auth_mode_t)params->authmode;
+    }
+
+    ESP_LOGI(WIFI_TAG, "Fast reconnect: directed connect to " MACSTR " on channel %u",
+             MAC2STR(params->bssid), params->channel);
+    return true;
+#else
+    (void)wc;
+    return false;
+#endif
+}
+
+static void wifi_record_boot_path(lifecycle_wifi_connect_path_t path) {
+    if (s_wifi_boot_path_recorded) {
+        return;
+    }
+
+    wifi_fast_state_prepare();
+    s_wifi_boot_path_recorded = true;
+    s_wifi_boot_path = path;
+    s_wifi_fast_state.last_path = (uint32_t)path;
+
+    switch (path) {
+        case LIFECYCLE_WIFI_CONNECT_PATH_FAST:
+            s_wifi_fast_state.fast_boots++;
+            break;
+        case LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK:
+            s_wifi_fast_state.fallback_boots++;
+            break;
+        case LIFECYCLE_WIFI_CONNECT_PATH_FULL_SCAN:
+            s_wifi_fast_state.full_scan_boots++;
+            break;
+        default:
+            break;
+    }
+
+    ESP_LOGI(WIFI_TAG, "Connect path=%d (fast=%" PRIu32 ", fallback=%" PRIu32 ", full_scan=%" PRIu32 ")",
+             (int)path,
+             s_wifi_fast_state.fast_boots,
+             s_wifi_fast_state.fallback_boots,
+             s_wifi_fast_state.full_scan_boots);
+}
+
+static void wifi_fast_reconnect_on_connected(const wifi_event_sta_connected_t *conn) {
+    if (s_wifi_directed_attempt) {
+        wifi_record_boot_path(LIFECYCLE_WIFI_CONNECT_PATH_FAST);
+    } else if (s_wifi_boot_path == LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK) {
+        wifi_record_boot_path(LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK);
+    } else {
+        wifi_record_boot_path(LIFECYCLE_WIFI_CONNECT_PATH_FULL_SCAN);
+    }
+    s_wifi_directed_attempt = false;
+
+#if CONFIG_LCM_WIFI_FAST_RECONNECT
+    if (conn == NULL) {
+        return;
+    }
+
+    wifi_fast_params_t params = { 0 };
+    memcpy(params.bssid, conn->bssid, sizeof(params.bssid));
+    params.channel = conn->channel;
+    params.authmode = (uint8_t)conn->authmode;
+
+    if (s_wifi_fast_state.valid &&
+            memcmp(&s_wifi_fast_state.params, &params, sizeof(params)) == 0) {
+        return;
+    }
+
+    s_wifi_fast_state.params = params;
+    s_wifi_fast_state.valid = 1;
+    nvs_store_wifi_fast(&params);
+#else
+    (void)conn;
+#endif
+}
+
+static void wifi_restore_full_scan_config(void) {
+    if (!s_wifi_directed_config_active) {
+        return;
+    }
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Failed to restore full scan config: %s", esp_err_to_name(err));
+        return;
+    }
+    s_wifi_directed_config_active = false;
+}
+
+// A failed directed connect invalidates the cache and retries with the
+// full-scan configuration. Returns true when the fallback was started.
+// Later disconnects also drop the BSSID lock so roaming to another AP of
+// the same SSID keeps working.
+static bool wifi_fast_reconnect_on_disconnected(void) {
+    if (!s_wifi_directed_attempt) {
+        wifi_restore_full_scan_config();
+        return false;
+    }
+
+    s_wifi_directed_attempt = false;
+    s_wifi_boot_path = LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK;
+    s_wifi_fast_state.valid = 0;
+    nvs_store_wifi_fast(NULL);
+
+    ESP_LOGW(WIFI_TAG, "Directed connect failed; falling back to full scan");
+    wifi_restore_full_scan_config();
+    esp_wifi_connect();
+    return true;
+}
+
+void lifecycle_get_wifi_connect_stats(lifecycle_wifi_connect_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+
+    wifi_fast_state_prepare();
+    out_stats->last_path = (lifecycle_wifi_connect_path_t)s_wifi_fast_state.last_path;
+    out_stats->fast_boots = s_wifi_fast_state.fast_boots;
+    out_stats->full_scan_boots = s_wifi_fast_state.full_scan_boots;
+    out_stats->fallback_boots = s_wifi_fast_state.fallback_boots;
+}
+
+#if CONFIG_LCM_WIFI_ROAMING
+// Roaming: the RSSI_LOW event starts one attempt, one query at a time. The
+// AP first gets a BTM query (11v) so it can steer us itself; the supplicant
+// then reassociates, with FT (11r) when the AP offers it. Without a BTM
+// request in time, a neighbor report (11k) names the channels of the other
+// APs and only those get a short active scan for our SSID. That fallback is
+// an ordinary disconnect plus directed connect to the best candidate, not an
+// FT transition: the link is down for a full association and 4-way
+// handshake, and TCP sessions live only as long as the controllers tolerate
+// the gap (the IP address is normally kept by the DHCP server).
+#define WIFI_ROAM_MAX_CHANNELS        4
+#define WIFI_ROAM_SCAN_RECORDS        8
+#define WIFI_ROAM_BTM_TIMEOUT_US      500000ULL
+#define WIFI_ROAM_NEIGHBOR_TIMEOUT_US 1000000ULL
+#define WIFI_EID_NEIGHBOR_REPORT      52
+#define WIFI_NEIGHBOR_REPORT_MIN_LEN  13
+
+typedef enum {
+    WIFI_ROAM_IDLE = 0,
+    WIFI_ROAM_BTM_QUERY,
+    WIFI_ROAM_NEIGHBOR_REQUEST,
+    WIFI_ROAM_SCANNING,
+    WIFI_ROAM_SWITCHING,
+} wifi_roam_state_t;
+
+// Which directed connect a roam is waiting on. Kept apart from the fast
+// reconnect attempt so a failed roam never invalidates the boot cache.
+typedef enum {
+    WIFI_ROAM_ATTEMPT_NONE = 0,
+    WIFI_ROAM_ATTEMPT_TARGET,
+    WIFI_ROAM_ATTEMPT_PREVIOUS,
+} wifi_roam_attempt_t;
+
+// Trace steps (EVENT_TRACE_ROAM 'a')
+enum {
+    WIFI_ROAM_STEP_RSSI_LOW = 0,
+    WIFI_ROAM_STEP_NEIGHBORS,
+    WIFI_ROAM_STEP_SWITCH,
+    WIFI_ROAM_STEP_NO_CANDIDATE,
+    WIFI_ROAM_STEP_BTM_QUERY,
+};
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    bool valid;
+} wifi_roam_candidate_t;
+
+// Transitions come from the event task, the supplicant task (neighbor
+// report) and the esp_timer task; the state is the only shared switch.
+static atomic_int s_wifi_roam_state = WIFI_ROAM_IDLE;
+static wifi_roam_attempt_t s_wifi_roam_attempt = WIFI_ROAM_ATTEMPT_NONE;
+static esp_timer_handle_t s_wifi_roam_timer = NULL;
+static uint8_t s_wifi_roam_channels[WIFI_ROAM_MAX_CHANNELS];
+static size_t s_wifi_roam_channel_count = 0;
+static size_t s_wifi_roam_channel_index = 0;
+static uint8_t s_wifi_roam_current_bssid[6];
+static uint8_t s_wifi_roam_current_channel = 0;
+static wifi_roam_candidate_t s_wifi_roam_best;
+static wifi_ap_record_t s_wifi_roam_records[WIFI_ROAM_SCAN_RECORDS];
+static uint32_t s_wifi_roams = 0;
+
+static bool wifi_roam_transition(wifi_roam_state_t from, wifi_roam_state_t to) {
+    int expected = (int)from;
+    return atomic_compare_exchange_strong(&s_wifi_roam_state, &expected, (int)to);
+}
+
+static void wifi_roam_arm(void) {
+    esp_err_t err = esp_wifi_set_rssi_threshold(CONFIG_LCM_WIFI_ROAM_RSSI_THRESHOLD);
+    if (err != ESP_OK) {
+        ESP_LOGW(WIFI_TAG, "Failed to arm roaming RSSI threshold: %s", esp_err_to_name(err));
+    }
+}
+
+// End of an attempt without a switch: re-arm the threshold after the cooldown
+static void wifi_roam_idle(void) {
+    atomic_store(&s_wifi_roam_state, WIFI_ROAM_IDLE);
+    if (s_wifi_roam_timer != NULL) {
+        esp_timer_stop(s_wifi_roam_timer);
+        esp_timer_start_once(s_wifi_roam_timer, (uint64_t)CONFIG_LCM_WIFI_ROAM_COOLDOWN_S * 1000000ULL);
+    }
+}
+
+static esp_err_t wifi_roam_scan_next(void) {
+    wifi_scan_config_t scan = {
+        .ssid = s_wifi_config.sta.ssid,
+        .channel = s_wifi_roam_channels[s_wifi_roam_channel_index],
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = 20, .max = 60 },
+    };
+    return esp_wifi_scan_start(&scan, false);
+}
+
+// Channel 0 scans all channels: the fallback when there is no neighbor report
+static void wifi_roam_start_scan(const uint8_t *channels, size_t count) {
+    if (count == 0U) {
+        s_wifi_roam_channels[0] = 0;
+        count = 1;
+    } else {
+        memcpy(s_wifi_roam_channels, channels, count);
+    }
+    s_wifi_roam_channel_count = count;
+    s_wifi_roam_channel_index = 0;
+
+    esp_err_t err = wifi_roam_scan_next();
+    if (err != ESP_OK) {
+        ESP_LOGW(WIFI_TAG, "Roaming scan failed to start: %s", esp_err_to_name(err));
+        wifi_roam_idle();
+    }
+}
+
+// Neighbor report elements: BSSID(6) BSSID info(4) op class(1) channel(1)
+// PHY type(1) [subelements]. Runs in the supplicant task.
+static void wifi_roam_on_neighbor_report(void *ctx, const uint8_t *report, size_t report_len) {
+    (void)ctx;
+    uint8_t channels[WIFI_ROAM_MAX_CHANNELS];
+    size_t count = 0;
+
+    const uint8_t *pos = report;
+    const uint8_t *end = (report != NULL) ? report + report_len : NULL;
+    while (pos != NULL && end - pos >= 2 && count < WIFI_ROAM_MAX_CHANNELS) {
+        uint8_t id = pos[0];
+        uint8_t len = pos[1];
+        pos += 2;
+        if (len > end - pos) {
+            break;
+        }
+        if (id == WIFI_EID_NEIGHBOR_REPORT && len >= WIFI_NEIGHBOR_REPORT_MIN_LEN &&
+                memcmp(pos, s_wifi_roam_current_bssid, 6) != 0) {
+            uint8_t channel = pos[11];
+            bool known = false;
+            for (size_t i = 0; i < count; ++i) {
+                known |= (channels[i] == channel);
+            }
+            if (channel != 0U && !known) {
+                channels[count++] = channel;
+            }
+        }
+        pos += len;
+    }
+
+    if (s_wifi_roam_timer == NULL || !wifi_roam_transition(WIFI_ROAM_NEIGHBOR_REQUEST, WIFI_ROAM_SCANNING)) {
+        return;
+    }
+    esp_timer_stop(s_wifi_roam_timer);
+
+    EVENT_TRACE(EVENT_TRACE_ROAM, WIFI_ROAM_STEP_NEIGHBORS, (uint32_t)count);
+    ESP_LOGI(WIFI_TAG, "Neighbor report: %u channel(s) to scan", (unsigned)count);
+    if (count == 0U) {
+        // The AP knows no other AP of this ESS
+        wifi_roam_idle();
+        return;
+    }
+    wifi_roam_start_scan(channels, count);
+}
+
+// Second step, after the BTM query went unanswered or was not possible:
+// neighbor report, or a scan of all channels without 11k
+static void wifi_roam_request_neighbors(void) {
+    if (esp_rrm_is_rrm_supported_connection() &&
+            esp_rrm_send_neighbor_rep_request(wifi_roam_on_neighbor_report, NULL) == 0) {
+        esp_timer_stop(s_wifi_roam_timer);
+        esp_timer_start_once(s_wifi_roam_timer, WIFI_ROAM_NEIGHBOR_TIMEOUT_US);
+        return;
+    }
+
+    if (wifi_roam_transition(WIFI_ROAM_NEIGHBOR_REQUEST, WIFI_ROAM_SCANNING)) {
+        wifi_roam_start_scan(NULL, 0);
+    }
+}
+
+// Cooldown expiry re-arms the threshold. During a query the same timer is
+// the answer timeout: no BTM request moves on to the neighbor report, no
+// neighbor report falls back to a scan of all channels.
+static void wifi_roam_timeout(void *arg) {
+    (void)arg;
+    if (s_wifi_stopping) {
+        return;
+    }
+    if (wifi_roam_transition(WIFI_ROAM_BTM_QUERY, WIFI_ROAM_NEIGHBOR_REQUEST)) {
+        ESP_LOGI(WIFI_TAG, "AP did not steer us; requesting a neighbor report");
+        wifi_roam_request_neighbors();
+    } else if (wifi_roam_transition(WIFI_ROAM_NEIGHBOR_REQUEST, WIFI_ROAM_SCANNING)) {
+        ESP_LOGI(WIFI_TAG, "No neighbor report; scanning all channels");
+        wifi_roam_start_scan(NULL, 0);
+    } else if (atomic_load(&s_wifi_roam_state) == WIFI_ROAM_IDLE) {
+        wifi_roam_arm();
+    }
+}
+
+static void wifi_roam_on_rssi_low(int32_t rssi) {
+    wifi_ap_record_t ap;
+    if (s_wifi_stopping || s_wifi_roam_timer == NULL || esp_wifi_sta_get_ap_info(&ap) != ESP_OK ||
+            !wifi_roam_transition(WIFI_ROAM_IDLE, WIFI_ROAM_BTM_QUERY)) {
+        return;
+    }
+
+    memcpy(s_wifi_roam_current_bssid, ap.bssid, sizeof(s_wifi_roam_current_bssid));
+    s_wifi_roam_current_channel = ap.primary;
+    memset(&s_wifi_roam_best, 0, sizeof(s_wifi_roam_best));
+    EVENT_TRACE(EVENT_TRACE_ROAM, WIFI_ROAM_STEP_RSSI_LOW, (uint32_t)rssi);
+    ESP_LOGI(WIFI_TAG, "RSSI %" PRId32 " dBm below %d dBm; looking for a better AP",
+             rssi, CONFIG_LCM_WIFI_ROAM_RSSI_THRESHOLD);
+
+    if (esp_wnm_is_btm_supported_connection() &&
+            esp_wnm_send_bss_transition_mgmt_query(REASON_FRAME_LOSS, NULL, 0) == 0) {
+        // A BTM request with candidates makes the supplicant roam on its own;
+        // the resulting disconnect/connect ends this attempt. Otherwise the
+        // timeout moves on to the neighbor report.
+        EVENT_TRACE(EVENT_TRACE_ROAM, WIFI_ROAM_STEP_BTM_QUERY, 0);
+        esp_timer_stop(s_wifi_roam_timer);
+        esp_timer_start_once(s_wifi_roam_timer, WIFI_ROAM_BTM_TIMEOUT_US);
+        return;
+    }
+
+    if (wifi_roam_transition(WIFI_ROAM_BTM_QUERY, WIFI_ROAM_NEIGHBOR_REQUEST)) {
+        wifi_roam_request_neighbors();
+    }
+}
+
+static void wifi_roam_on_scan_done(void) {
+    if (atomic_load(&s_wifi_roam_state) != WIFI_ROAM_SCANNING) {
+        return;
+    }
+
+    uint16_t count = WIFI_ROAM_SCAN_RECORDS;
+    if (esp_wifi_scan_get_ap_records(&count, s_wifi_roam_records) != ESP_OK) {
+        esp_wifi_clear_ap_list();
+        count = 0;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        const wifi_ap_record_t *rec = &s_wifi_roam_records[i];
+        if (memcmp(rec->bssid, s_wifi_roam_current_bssid, sizeof(rec->bssid)) == 0) {
+            continue;
+        }
+        if (!s_wifi_roam_best.valid || rec->rssi > s_wifi_roam_best.rssi) {
+            memcpy(s_wifi_roam_best.bssid, rec->bssid, sizeof(s_wifi_roam_best.bssid));
+            s_wifi_roam_best.channel = rec->primary;
+            s_wifi_roam_best.rssi = rec->rssi;
+            s_wifi_roam_best.valid = true;
+        }
+    }
+
+    if (++s_wifi_roam_channel_index < s_wifi_roam_channel_count && wifi_roam_scan_next() == ESP_OK) {
+        return;
+    }
+
+    wifi_ap_record_t ap;
+    int current_rssi = (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) ? ap.rssi : CONFIG_LCM_WIFI_ROAM_RSSI_THRESHOLD;
+    if (!s_wifi_roam_best.valid ||
+            s_wifi_roam_best.rssi < current_rssi + CONFIG_LCM_WIFI_ROAM_RSSI_HYSTERESIS) {
+        EVENT_TRACE(EVENT_TRACE_ROAM, WIFI_ROAM_STEP_NO_CANDIDATE,
+                    s_wifi_roam_best.valid ? (uint32_t)s_wifi_roam_best.rssi : 0U);
+        ESP_LOGI(WIFI_TAG, "No AP stronger than %d dBm (+%d dB); staying",
+                 current_rssi, CONFIG_LCM_WIFI_ROAM_RSSI_HYSTERESIS);
+        wifi_roam_idle();
+        return;
+    }
+
+    // The directed connect happens in the disconnect handler
+    if (!wifi_roam_transition(WIFI_ROAM_SCANNING, WIFI_ROAM_SWITCHING)) {
+        return;
+    }
+    EVENT_TRACE(EVENT_TRACE_ROAM, WIFI_ROAM_STEP_SWITCH,
+                ((uint32_t)s_wifi_roam_best.channel << 8) | (uint8_t)s_wifi_roam_best.rssi);
+    ESP_LOGI(WIFI_TAG, "Reconnecting to " MACSTR " (channel %u, %d dBm, current %d dBm)",
+             MAC2STR(s_wifi_roam_best.bssid), s_wifi_roam_best.channel,
+             s_wifi_roam_best.rssi, current_rssi);
+    if (esp_wifi_disconnect() != ESP_OK) {
+        wifi_roam_idle();
+    }
+}
+
+static void wifi_roam_connect_to(const uint8_t *bssid, uint8_t channel) {
+    wifi_config_t wc = s_wifi_config;
+    memcpy(wc.sta.bssid, bssid, sizeof(wc.sta.bssid));
+    wc.sta.bssid_set = true;
+    wc.sta.channel = channel;
+    wc.sta.scan_method = WIFI_FAST_SCAN;
+    if (esp_wifi_set_config(WIFI_IF_STA, &wc) == ESP_OK) {
+        // The next ordinary disconnect restores the full-scan configuration
+        s_wifi_directed_config_active = true;
+    }
+    esp_wifi_connect();
+}
+
+// A failed roam connect goes back to the AP we left, then to a full scan.
+// The fast reconnect cache stays as it is: the roam target was never in it.
+static bool wifi_roam_fall_back(void) {
+    wifi_roam_attempt_t attempt = s_wifi_roam_attempt;
+    s_wifi_roam_attempt = WIFI_ROAM_ATTEMPT_NONE;
+    if (attempt == WIFI_ROAM_ATTEMPT_NONE || s_wifi_stopping) {
+        return false;
+    }
+
+    if (attempt == WIFI_ROAM_ATTEMPT_TARGET) {
+        ESP_LOGW(WIFI_TAG, "Roam connect failed; back to " MACSTR, MAC2STR(s_wifi_roam_current_bssid));
+        s_wifi_roam_attempt = WIFI_ROAM_ATTEMPT_PREVIOUS;
+        wifi_roam_connect_to(s_wifi_roam_current_bssid, s_wifi_roam_current_channel);
+        return true;
+    }
+
+    ESP_LOGW(WIFI_TAG, "Previous AP unreachable; falling back to full scan");
+    wifi_restore_full_scan_config();
+    esp_wifi_connect();
+    return true;
+}
+
+// Returns true when the disconnect was ours and a roam (or roam fallback)
+// connect is started. Any other disconnect aborts a running attempt.
+static bool wifi_roam_on_disconnected(void) {
+    int state = atomic_exchange(&s_wifi_roam_state, WIFI_ROAM_IDLE);
+    if (state == WIFI_ROAM_SCANNING) {
+        esp_wifi_scan_stop();
+    }
+    if (state != WIFI_ROAM_IDLE && s_wifi_roam_timer != NULL) {
+        esp_timer_stop(s_wifi_roam_timer);
+    }
+    if (state != WIFI_ROAM_SWITCHING || s_wifi_stopping) {
+        return wifi_roam_fall_back();
+    }
+
+    s_wifi_roam_attempt = WIFI_ROAM_ATTEMPT_TARGET;
+    s_wifi_roams++;
+    wifi_roam_connect_to(s_wifi_roam_best.bssid, s_wifi_roam_best.channel);
+    return true;
+}
+
+static void wifi_roam_on_connected(void) {
+    s_wifi_roam_attempt = WIFI_ROAM_ATTEMPT_NONE;
+    if (s_wifi_roam_timer != NULL) {
+        esp_timer_stop(s_wifi_roam_timer);
+    }
+    atomic_store(&s_wifi_roam_state, WIFI_ROAM_IDLE);
+    if (s_wifi_roams > 0U) {
+        ESP_LOGI(WIFI_TAG, "Roams this boot: %" PRIu32, s_wifi_roams);
+    }
+    wifi_roam_arm();
+}
+#endif
+
+static void wifi_reconnect_timeout(void *arg) {
+    (void)arg;
+    if (s_wifi_stopping || !s_wifi_started) {
+        return;
+    }
+
+    ESP_LOGI(WIFI_TAG, "Reconnect attempt %" PRIu32, s_wifi_reconnect_stats.current_attempt);
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(WIFI_TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+    }
+}
+
+static void wifi_count_disconnect_reason(uint8_t reason) {
+    lifecycle_wifi_reconnect_stats_t *stats = &s_wifi_reconnect_stats;
+
+    stats->disconnects++;
+    stats->last_reason = reason;
+
+    for (size_t i = 0; i < LIFECYCLE_WIFI_DISCONNECT_REASON_SLOTS; ++i) {
+        lifecycle_wifi_disconnect_reason_count_t *slot = &stats->reasons[i];
+        if (slot->count != 0U && slot->reason == reason) {
+            slot->count++;
+            return;
+        }
+        if (slot->count == 0U) {
+            slot->reason = reason;
+            slot->count = 1;
+            return;
+        }
+    }
+
+    stats->other_reasons++;
+}
+
+// Exponential backoff (base << attempt, capped) with "equal jitter": half of
+// the delay is fixed, the other half random so a fleet of plugs spreads out
+// after an AP reboot instead of reconnecting in lockstep.
+static uint64_t wifi_reconnect_delay_ms(uint32_t attempt) {
+    uint64_t delay = CONFIG_LCM_WIFI_RECONNECT_BASE_MS;
+    while (attempt > 0U && delay < CONFIG_LCM_WIFI_RECONNECT_MAX_MS) {
+        delay <<= 1;
+        attempt--;
+    }
+    if (delay > CONFIG_LCM_WIFI_RECONNECT_MAX_MS) {
+        delay = CONFIG_LCM_WIFI_RECONNECT_MAX_MS;
+    }
+
+    uint64_t half = delay / 2U;
+    return half + (half > 0U ? (esp_random() % (half + 1U)) : 0U);
+}
+
+static void wifi_schedule_reconnect(uint8_t reason) {
+    uint32_t attempt;
+
+    taskENTER_CRITICAL(&s_wifi_stats_lock);
+    wifi_count_disconnect_reason(reason);
+    if (s_wifi_disconnected_since_us == 0) {
+        s_wifi_disconnected_since_us = esp_timer_get_time();
+    }
+    attempt = s_wifi_reconnect_stats.current_attempt++;
+    taskEXIT_CRITICAL(&s_wifi_stats_lock);
+
+    if (s_wifi_stopping) {
+        return;
+    }
+
+    uint64_t delay_ms = wifi_reconnect_delay_ms(attempt);
+    ESP_LOGW(WIFI_TAG, "Disconnected (reason=%u). Reconnecting in %llu ms",
+             reason, (unsigned long long)delay_ms);
+
+    if (s_wifi_reconnect_timer == NULL) {
+        esp_wifi_connect();
+        return;
+    }
+
+    esp_timer_stop(s_wifi_reconnect_timer);
+    esp_err_t err = esp_timer_start_once(s_wifi_reconnect_timer, delay_ms * 1000ULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Failed to arm reconnect timer: %s", esp_err_to_name(err));
+        esp_wifi_connect();
+    }
+}
+
+static void wifi_reconnect_on_got_ip(void) {
+    taskENTER_CRITICAL(&s_wifi_stats_lock);
+    if (s_wifi_disconnected_since_us != 0) {
+        uint64_t elapsed = (uint64_t)(esp_timer_get_time() - s_wifi_disconnected_since_us);
+        lifecycle_wifi_reconnect_stats_t *stats = &s_wifi_reconnect_stats;
+        stats->reconnects++;
+        stats->last_reconnect_us = elapsed;
+        stats->total_reconnect_us += elapsed;
+        if (elapsed > stats->max_reconnect_us) {
+            stats->max_reconnect_us = elapsed;
+        }
+        s_wifi_disconnected_since_us = 0;
+    }
+    s_wifi_reconnect_stats.current_attempt = 0;
+    taskEXIT_CRITICAL(&s_wifi_stats_lock);
+}
+
+#ifndef CONFIG_LCM_HAP_PORT
+#define CONFIG_LCM_HAP_PORT 5556
+#endif
+
+// Keepalive applied to HAP sessions that survived a network change: a dead
+// controller connection is dropped after idle + intvl * cnt seconds instead
+// of the server default of several minutes. Live controllers answer the
+// probes and keep their session.
+#define LIFECYCLE_HAP_RECOVERY_KEEPIDLE_S   5
+#define LIFECYCLE_HAP_RECOVERY_KEEPINTVL_S  2
+#define LIFECYCLE_HAP_RECOVERY_KEEPCNT      3
+
+static uint32_t s_network_last_ip = 0;
+static uint32_t s_network_changes = 0;
+
+// Call 'fn' for every connected TCP socket on the HAP port and return how many
+// there were. The listening socket has no peer and is skipped.
+static size_t lifecycle_hap_for_each_session(void (*fn)(int fd, void *ctx), void *ctx) {
+    size_t sessions = 0;
+
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; ++fd) {
+        int type = 0;
+        socklen_t len = sizeof(type);
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0 || type != SOCK_STREAM) {
+            continue;
+        }
+
+        struct sockaddr_in local;
+        struct sockaddr_in peer;
+        socklen_t local_len = sizeof(local);
+        socklen_t peer_len = sizeof(peer);
+        if (getsockname(fd, (struct sockaddr *)&local, &local_len) != 0 ||
+                local.sin_family != AF_INET ||
+                ntohs(local.sin_port) != CONFIG_LCM_HAP_PORT ||
+                getpeername(fd, (struct sockaddr *)&peer, &peer_len) != 0) {
+            // Not a connected HAP session (the listening socket has no peer)
+            continue;
+        }
+
+        if (fn != NULL) {
+            fn(fd, ctx);
+        }
+        sessions++;
+    }
+
+    return sessions;
+}
+
+static void lifecycle_hap_apply_recovery_keepalive(int fd, void *ctx) {
+    (void)ctx;
+    int enable = 1;
+    int idle = LIFECYCLE_HAP_RECOVERY_KEEPIDLE_S;
+    int intvl = LIFECYCLE_HAP_RECOVERY_KEEPINTVL_S;
+    int cnt = LIFECYCLE_HAP_RECOVERY_KEEPCNT;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+}
+
+static size_t lifecycle_hap_expedite_dead_sessions(void) {
+    return lifecycle_hap_for_each_session(lifecycle_hap_apply_recovery_keepalive, NULL);
+}
+
+// Called for every GOT_IP after the first one: a reconnect or a DHCP address
+// change. Controllers cache the _hap._tcp A record, so announce right away
+// instead of waiting for their cache to expire.
+static void lifecycle_network_changed(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info) {
+    bool ip_changed = (ip_info->ip.addr != s_network_last_ip);
+    s_network_changes++;
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (netif != NULL) {
+        err = mdns_netif_action(netif, MDNS_EVENT_ENABLE_IP4 | MDNS_EVENT_ANNOUNCE_IP4);
+    }
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(WIFI_TAG, "mDNS re-announce failed: %s", esp_err_to_name(err));
+    }
+
+    // With a new address lwIP already aborts sockets bound to the old one;
+    // sessions kept across a same-address reconnect may be half-open.
+    size_t sessions = lifecycle_hap_expedite_dead_sessions();
+
+    ESP_LOGI(WIFI_TAG, "[lifecycle] network change #%" PRIu32 " (%s): mDNS %s, %u HAP session(s) on fast keepalive",
+             s_network_changes,
+             ip_changed ? "new address" : "same address",
+             err == ESP_OK ? "re-announced" : "not running",
+             (unsigned)sessions);
+}
+
+void lifecycle_get_wifi_reconnect_stats(lifecycle_wifi_reconnect_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_wifi_stats_lock);
+    *out_stats = s_wifi_reconnect_stats;
+    taskEXIT_CRITICAL(&s_wifi_stats_lock);
+}
+
+#if CONFIG_LCM_WIFI_IP_STATIC
+static esp_err_t wifi_apply_static_ip(esp_netif_t *netif) {
+    esp_netif_ip_info_t ip_info = { 0 };
+    esp_netif_dns_info_t dns = { 0 };
+
+    if (esp_netif_str_to_ip4(CONFIG_LCM_WIFI_STATIC_IP, &ip_info.ip) != ESP_OK ||
+            esp_netif_str_to_ip4(CONFIG_LCM_WIFI_STATIC_NETMASK, &ip_info.netmask) != ESP_OK ||
+            esp_netif_str_to_ip4(CONFIG_LCM_WIFI_STATIC_GATEWAY, &ip_info.gw) != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Invalid static IP configuration");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = esp_netif_dhcpc_stop(netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_LOGE(WIFI_TAG, "Failed to stop DHCP client: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_netif_set_ip_info(netif, &ip_info);
+    if (err != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Failed to set static IP: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    if (esp_netif_str_to_ip4(CONFIG_LCM_WIFI_STATIC_DNS, &dns.ip.u_addr.ip4) == ESP_OK) {
+        esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+
+    ESP_LOGI(WIFI_TAG, "Static IP " IPSTR " configured", IP2STR(&ip_info.ip));
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_LCM_WIFI_IP_DHCP_CACHE
+static bool wifi_lease_expired(const wifi_lease_t *lease) {
+    // System time survives soft resets but restarts at zero after a power
+    // cycle; only judge the expiry when the clock moved forward.
+    int64_t now = (int64_t)time(NULL);
+    if (lease->lease_s == 0U || now < lease->obtained_at_s) {
+        return false;
+    }
+    return (now - lease->obtained_at_s) >= (int64_t)lease->lease_s;
+}
+
+// lwIP (CONFIG_LWIP_DHCP_RESTORE_LAST_IP) starts with a DHCP REQUEST for the
+// remembered address instead of DISCOVER. Seed DNS from the cached lease so
+// lookups work as soon as that REQUEST is acknowledged.
+static void wifi_lease_seed(esp_netif_t *netif) {
+    if (s_wifi_lease_state.magic != k_wifi_lease_magic || !s_wifi_lease_state.valid) {
+        wifi_lease_t lease;
+        size_t len = sizeof(lease);
+        nvs_handle_t handle;
+        memset(&s_wifi_lease_state, 0, sizeof(s_wifi_lease_state));
+        s_wifi_lease_state.magic = k_wifi_lease_magic;
+        if (lifecycle_nvs_session("wifi_cfg", &handle) == ESP_OK) {
+            if (LIFECYCLE_NVS_OP(reads, nvs_get_blob(handle, k_wifi_lease_key, &lease, &len)) == ESP_OK &&
+                    len == sizeof(lease)) {
+                s_wifi_lease_state.lease = lease;
+                s_wifi_lease_state.valid = 1;
+            }
+        }
+    }
+
+    if (!s_wifi_lease_state.valid) {
+        return;
+    }
+
+    const wifi_lease_t *lease = &s_wifi_lease_state.lease;
+    if (wifi_lease_expired(lease)) {
+        ESP_LOGI(WIFI_TAG, "Cached DHCP lease expired; doing full DHCP exchange");
+        s_wifi_lease_state.valid = 0;
+        return;
+    }
+
+    if (lease->dns != 0U) {
+        esp_netif_dns_info_t dns = { 0 };
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        dns.ip.u_addr.ip4.addr = lease->dns;
+        esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+
+    esp_ip4_addr_t ip = { .addr = lease->ip };
+    ESP_LOGI(WIFI_TAG, "Cached DHCP lease " IPSTR " (lease=%" PRIu32 " s)", IP2STR(&ip), lease->lease_s);
+}
+
+static void wifi_lease_store(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info) {
+    if (netif == NULL || ip_info == NULL) {
+        return;
+    }
+
+    wifi_lease_t lease = { 0 };
+    lease.ip = ip_info->ip.addr;
+    lease.netmask = ip_info->netmask.addr;
+    lease.gw = ip_info->gw.addr;
+    lease.obtained_at_s = (int64_t)time(NULL);
+
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK &&
+            dns.ip.type == ESP_IPADDR_TYPE_V4) {
+        lease.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    struct netif *lwip_netif = esp_netif_get_netif_impl(netif);
+    struct dhcp *dhcp = (lwip_netif != NULL) ? netif_dhcp_data(lwip_netif) : NULL;
+    if (dhcp != NULL) {
+        lease.lease_s = dhcp->offered_t0_lease;
+    }
+
+    const wifi_lease_t *cached = &s_wifi_lease_state.lease;
+    bool changed = !s_wifi_lease_state.valid ||
+            cached->ip != lease.ip || cached->netmask != lease.netmask ||
+            cached->gw != lease.gw || cached->dns != lease.dns;
+
+    s_wifi_lease_state.magic = k_wifi_lease_magic;
+    s_wifi_lease_state.lease = lease;
+    s_wifi_lease_state.valid = 1;
+
+    if (!changed) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = lifecycle_nvs_session("wifi_cfg", &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(WIFI_TAG, "NVS open failed for DHCP lease cache: %s", esp_err_to_name(err));
+        return;
+    }
 
-    nvs_close(handle);
-    *out_ssid = ssid;
-    *out_pass = pass;
-    return ESP_OK;
+    err = LIFECYCLE_NVS_OP(writes, nvs_set_blob(handle, k_wifi_lease_key, &lease, sizeof(lease)));
+    if (err == ESP_OK) {
+        lifecycle_nvs_mark_dirty("wifi_cfg");
+        err = lifecycle_nvs_commit("wifi_cfg");
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(WIFI_TAG, "Failed to store DHCP lease: %s", esp_err_to_name(err));
+    }
 }
+#endif
 
 static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
     if (base == WIFI_EVENT) {
         switch (id) {
             case WIFI_EVENT_STA_START:
+                EVENT_TRACE(EVENT_TRACE_WIFI, id, 0);
                 ESP_LOGI(WIFI_TAG, "STA start -> connect");
                 esp_wifi_connect();
                 break;
+            case WIFI_EVENT_STA_CONNECTED: {
+                wifi_event_sta_connected_t *conn = (wifi_event_sta_connected_t *)data;
+                EVENT_TRACE(EVENT_TRACE_WIFI, id, conn ? conn->channel : 0);
+                ESP_LOGI(WIFI_TAG, "Associated (channel=%d)", conn ? conn->channel : -1);
+                lifecycle_boot_mark(LIFECYCLE_BOOT_STA_CONNECTED);
+                wifi_fast_reconnect_on_connected(conn);
+#if CONFIG_LCM_WIFI_ROAMING
+                wifi_roam_on_connected();
+#endif
+                break;
+            }
             case WIFI_EVENT_STA_DISCONNECTED: {
                 wifi_event_sta_disconnected_t *disc = (wifi_event_sta_disconnected_t *)data;
-                ESP_LOGW(WIFI_TAG, "Disconnected (reason=%d). Reconnecting...", disc ? disc->reason : -1);
-                esp_wifi_connect();
+                EVENT_TRACE(EVENT_TRACE_WIFI, id, disc ? disc->reason : 0);
+#if CONFIG_LCM_WIFI_ROAMING
+                if (wifi_roam_on_disconnected()) {
+                    break;
+                }
+#endif
+                if (wifi_fast_reconnect_on_disconnected()) {
+                    break;
+                }
+                wifi_schedule_reconnect(disc ? disc->reason : 0);
+                break;
+            }
+#if CONFIG_LCM_WIFI_ROAMING
+            case WIFI_EVENT_STA_BSS_RSSI_LOW: {
+                wifi_event_bss_rssi_low_t *low = (wifi_event_bss_rssi_low_t *)data;
+                wifi_roam_on_rssi_low(low ? low->rssi : CONFIG_LCM_WIFI_ROAM_RSSI_THRESHOLD);
                 break;
             }
+            case WIFI_EVENT_SCAN_DONE:
+                wifi_roam_on_scan_done();
+                break;
+#endif
             default:
                 break;
         }
     } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)data;
+        EVENT_TRACE(EVENT_TRACE_GOT_IP, 0, event->ip_info.ip.addr);
         ESP_LOGI(WIFI_TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        lifecycle_boot_mark(LIFECYCLE_BOOT_GOT_IP);
+        wifi_reconnect_on_got_ip();
+#if CONFIG_LCM_WIFI_IP_DHCP_CACHE
+        wifi_lease_store(event->esp_netif, &event->ip_info);
+#endif
+        if (s_network_last_ip != 0) {
+            lifecycle_network_changed(event->esp_netif, &event->ip_info);
+        }
+        s_network_last_ip = event->ip_info.ip.addr;
         if (s_wifi_on_ready_cb != NULL) {
             s_wifi_on_ready_cb();
         }
     }
 }
 
+static void lifecycle_boot_timeline_start(void) {
+    if (s_boot_timeline_started) {
+        return;
+    }
+    s_boot_timeline_started = true;
+
+    if (s_boot_timeline.magic == k_boot_timeline_magic) {
+        memcpy(s_boot_timeline.previous, s_boot_timeline.current, sizeof(s_boot_timeline.previous));
+    } else {
+        memset(s_boot_timeline.previous, 0, sizeof(s_boot_timeline.previous));
+        s_boot_timeline.magic = k_boot_timeline_magic;
+    }
+    memset(s_boot_timeline.current, 0, sizeof(s_boot_timeline.current));
+}
+
+void lifecycle_boot_mark(lifecycle_boot_milestone_t milestone) {
+    if (milestone < 0 || milestone >= LIFECYCLE_BOOT_MILESTONE_COUNT) {
+        return;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    lifecycle_boot_timeline_start();
+
+    if (s_boot_timeline.current[milestone] == 0U) {
+        // 0 means "not reached"; a real stamp is never that early.
+        s_boot_timeline.current[milestone] = (now != 0U) ? now : 1U;
+        ESP_LOGD(LIFECYCLE_TAG, "[lifecycle] boot milestone %d at %" PRIu32 " us", (int)milestone, now);
+    }
+}
+
+uint32_t lifecycle_boot_get_stamp(lifecycle_boot_milestone_t milestone, bool previous) {
+    if (milestone < 0 || milestone >= LIFECYCLE_BOOT_MILESTONE_COUNT ||
+            s_boot_timeline.magic != k_boot_timeline_magic) {
+        return 0;
+    }
+    return previous ? s_boot_timeline.previous[milestone] : s_boot_timeline.current[milestone];
+}
+
+static size_t lifecycle_boot_timeline_format(char *buf, size_t size, const char *label,
+                                             const uint32_t *stamps) {
+    int written = snprintf(buf, size, "%s=", label);
+    size_t used = (written > 0) ? (size_t)written : 0U;
+
+    for (size_t i = 0; i < LIFECYCLE_BOOT_MILESTONE_COUNT && used < size; ++i) {
+        const char *sep = (i + 1U < LIFECYCLE_BOOT_MILESTONE_COUNT) ? "," : "";
+        if (stamps[i] == 0U) {
+            written = snprintf(buf + used, size - used, "-%s", sep);
+        } else {
+            written = snprintf(buf + used, size - used, "%" PRIu32 "%s", stamps[i] / 1000U, sep);
+        }
+        if (written < 0) {
+            break;
+        }
+        used += (size_t)written;
+    }
+
+    return (used < size) ? used : size - 1U;
+}
+
+homekit_value_t lifecycle_boot_timeline_get(const homekit_characteristic_t *characteristic) {
+    (void)characteristic;
+    lifecycle_boot_timeline_start();
+
+    size_t used = lifecycle_boot_timeline_format(s_boot_timeline_str, sizeof(s_boot_timeline_str),
+                                                 "cur", s_boot_timeline.current);
+    if (used + 1U < sizeof(s_boot_timeline_str)) {
+        s_boot_timeline_str[used++] = ';';
+        s_boot_timeline_str[used] = '\0';
+        lifecycle_boot_timeline_format(s_boot_timeline_str + used, sizeof(s_boot_timeline_str) - used,
+                                       "prev", s_boot_timeline.previous);
+    }
+
+    return HOMEKIT_STRING(s_boot_timeline_str, .is_static = true);
+}
+
 static void lifecycle_log_step(const char *step) {
     if (step == NULL) {
         return;
     }
+    // The pointer is enough: step strings are literals in flash
+    EVENT_TRACE(EVENT_TRACE_LIFECYCLE_STEP, 0, (uintptr_t)step);
     ESP_LOGI(LIFECYCLE_TAG, "[lifecycle] %s", step);
 }
 
@@ -235,6 +1387,305 @@ static void lifecycle_clear_post_reset_state(void) {
     s_post_reset_state.reason = LIFECYCLE_POST_RESET_NONE;
 }
 
+static lifecycle_nvs_session_t *lifecycle_nvs_find_session(const char *namespace) {
+    for (size_t i = 0; i < LIFECYCLE_NVS_SESSION_SLOTS; ++i) {
+        lifecycle_nvs_session_t *session = &s_nvs_sessions[i];
+        if (session->in_use && strncmp(session->namespace, namespace, sizeof(session->namespace)) == 0) {
+            return session;
+        }
+    }
+    return NULL;
+}
+
+// Cached handle for 'namespace'. Every namespace in this table is written at
+// some point, so the session is opened read-write from the start: a handle
+// that was handed out is never closed or swapped while another task (main
+// task, Wi-Fi event task) may still be using it.
+static esp_err_t lifecycle_nvs_session(const char *namespace, nvs_handle_t *out_handle) {
+    if (namespace == NULL || out_handle == NULL || s_nvs_session_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_nvs_session_lock, portMAX_DELAY);
+
+    lifecycle_nvs_session_t *session = lifecycle_nvs_find_session(namespace);
+
+    if (session == NULL) {
+        for (size_t i = 0; i < LIFECYCLE_NVS_SESSION_SLOTS && session == NULL; ++i) {
+            if (!s_nvs_sessions[i].in_use) {
+                session = &s_nvs_sessions[i];
+            }
+        }
+
+        if (session == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            nvs_handle_t handle;
+            err = LIFECYCLE_NVS_OP(opens, nvs_open(namespace, NVS_READWRITE, &handle));
+            if (err == ESP_OK) {
+                strlcpy(session->namespace, namespace, sizeof(session->namespace));
+                session->handle = handle;
+                session->dirty = false;
+                session->in_use = true;
+            } else {
+                session = NULL;
+            }
+        }
+    }
+
+    if (session != NULL) {
+        *out_handle = session->handle;
+    }
+
+    xSemaphoreGive(s_nvs_session_lock);
+    return err;
+}
+
+static void lifecycle_nvs_mark_dirty(const char *namespace) {
+    xSemaphoreTake(s_nvs_session_lock, portMAX_DELAY);
+    lifecycle_nvs_session_t *session = lifecycle_nvs_find_session(namespace);
+    if (session != NULL) {
+        session->dirty = true;
+    }
+    xSemaphoreGive(s_nvs_session_lock);
+}
+
+// Commit the pending changes of 'namespace', or of every session when NULL.
+static esp_err_t lifecycle_nvs_commit(const char *namespace) {
+    esp_err_t result = ESP_OK;
+
+    if (s_nvs_session_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_nvs_session_lock, portMAX_DELAY);
+    for (size_t i = 0; i < LIFECYCLE_NVS_SESSION_SLOTS; ++i) {
+        lifecycle_nvs_session_t *session = &s_nvs_sessions[i];
+        if (!session->in_use || !session->dirty) {
+            continue;
+        }
+        if (namespace != NULL && strncmp(session->namespace, namespace, sizeof(session->namespace)) != 0) {
+            continue;
+        }
+
+        esp_err_t err = LIFECYCLE_NVS_OP(commits, nvs_commit(session->handle));
+        if (err == ESP_OK) {
+            session->dirty = false;
+        } else {
+            ESP_LOGE(LIFECYCLE_TAG, "[lifecycle] Failed to commit NVS namespace '%s': %s",
+                     session->namespace, esp_err_to_name(err));
+            if (result == ESP_OK) {
+                result = err;
+            }
+        }
+    }
+    xSemaphoreGive(s_nvs_session_lock);
+
+    return result;
+}
+
+static void lifecycle_nvs_close_all(void) {
+    if (s_nvs_session_lock == NULL) {
+        return;
+    }
+
+    lifecycle_nvs_commit(NULL);
+
+    xSemaphoreTake(s_nvs_session_lock, portMAX_DELAY);
+    for (size_t i = 0; i < LIFECYCLE_NVS_SESSION_SLOTS; ++i) {
+        if (s_nvs_sessions[i].in_use) {
+            nvs_close(s_nvs_sessions[i].handle);
+            s_nvs_sessions[i].in_use = false;
+        }
+    }
+    xSemaphoreGive(s_nvs_session_lock);
+}
+
+void lifecycle_get_nvs_stats(lifecycle_nvs_stats_t *out_stats) {
+    if (out_stats != NULL) {
+        *out_stats = s_nvs_stats;
+    }
+}
+
+static const char *const k_io_op_names[LIFECYCLE_IO_OP_COUNT] = {
+    [LIFECYCLE_IO_POST_RESET_STATE] = "post_reset_state",
+    [LIFECYCLE_IO_FIRMWARE_REVISION] = "firmware_revision",
+    [LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT] = "restart_counter_timeout",
+    [LIFECYCLE_IO_UPDATE_REQUEST] = "update_request",
+    [LIFECYCLE_IO_FACTORY_RESET] = "factory_reset",
+};
+
+static void lifecycle_io_begin(lifecycle_io_scope_t *scope) {
+    scope->nvs = s_nvs_stats;
+    scope->partition_erases = s_partition_stats.erases;
+    scope->partition_erase_bytes = s_partition_stats.erase_bytes;
+    scope->start_us = esp_timer_get_time();
+}
+
+// Record and log the flash I/O and wall time of 'op' since lifecycle_io_begin().
+static void lifecycle_io_end(lifecycle_io_op_t op, const lifecycle_io_scope_t *scope) {
+    uint64_t elapsed = (uint64_t)(esp_timer_get_time() - scope->start_us);
+    lifecycle_io_cost_t run = {
+        .nvs = {
+            .opens = s_nvs_stats.opens - scope->nvs.opens,
+            .reads = s_nvs_stats.reads - scope->nvs.reads,
+            .writes = s_nvs_stats.writes - scope->nvs.writes,
+            .erases = s_nvs_stats.erases - scope->nvs.erases,
+            .commits = s_nvs_stats.commits - scope->nvs.commits,
+        },
+        .partition_erases = s_partition_stats.erases - scope->partition_erases,
+        .partition_erase_bytes = s_partition_stats.erase_bytes - scope->partition_erase_bytes,
+        .last_us = elapsed,
+    };
+
+    taskENTER_CRITICAL(&s_io_costs_lock);
+    lifecycle_io_cost_t *cost = &s_io_costs[op];
+    run.runs = cost->runs + 1U;
+    run.max_us = (elapsed > cost->max_us) ? elapsed : cost->max_us;
+    *cost = run;
+    taskEXIT_CRITICAL(&s_io_costs_lock);
+
+    ESP_LOGI(LIFECYCLE_TAG,
+             "[lifecycle] io %s: nvs opens=%" PRIu32 " reads=%" PRIu32 " writes=%" PRIu32
+             " erases=%" PRIu32 " commits=%" PRIu32 ", flash erases=%" PRIu32 " (%" PRIu32 " bytes), %llu us",
+             k_io_op_names[op],
+             run.nvs.opens, run.nvs.reads, run.nvs.writes, run.nvs.erases, run.nvs.commits,
+             run.partition_erases, run.partition_erase_bytes,
+             (unsigned long long)elapsed);
+}
+
+void lifecycle_get_io_cost(lifecycle_io_op_t op, lifecycle_io_cost_t *out_cost) {
+    if (out_cost == NULL || op >= LIFECYCLE_IO_OP_COUNT) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_io_costs_lock);
+    *out_cost = s_io_costs[op];
+    taskEXIT_CRITICAL(&s_io_costs_lock);
+}
+
+static uint32_t lifecycle_record_crc(const lifecycle_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(lifecycle_record_t, crc));
+}
+
+// Compatibility read of the pre-record keys (lcm/restart_count and
+// wifi_cfg/wifi_fast). fwcfg/installed_ver is resolved lazily by
+// lifecycle_init_firmware_revision() because the factory LCM owns it.
+static void lifecycle_record_migrate(void) {
+    nvs_handle_t handle;
+
+    if (lifecycle_nvs_session(k_restart_counter_namespace, &handle) == ESP_OK) {
+        uint32_t value = 0;
+        if (LIFECYCLE_NVS_OP(reads, nvs_get_u32(handle, k_restart_counter_key, &value)) == ESP_OK) {
+            s_record.restart_count = value;
+            s_record_drop_legacy = true;
+        }
+    }
+
+    if (lifecycle_nvs_session("wifi_cfg", &handle) == ESP_OK) {
+        wifi_fast_params_t params;
+        size_t len = sizeof(params);
+        if (LIFECYCLE_NVS_OP(reads, nvs_get_blob(handle, k_wifi_fast_key, &params, &len)) == ESP_OK &&
+                len == sizeof(params)) {
+            s_record.wifi_fast = params;
+            s_record.wifi_fast_valid = 1;
+        }
+    }
+}
+
+static void lifecycle_record_load(const char *log_tag) {
+    if (s_record_loaded) {
+        return;
+    }
+    s_record_loaded = true;
+
+    const char *tag = (log_tag != NULL) ? log_tag : LIFECYCLE_TAG;
+    lifecycle_record_t record;
+    size_t len = sizeof(record);
+    nvs_handle_t handle;
+    esp_err_t err = lifecycle_nvs_session(k_restart_counter_namespace, &handle);
+    if (err == ESP_OK) {
+        err = LIFECYCLE_NVS_OP(reads, nvs_get_blob(handle, k_lifecycle_record_key, &record, &len));
+    }
+
+    if (err == ESP_OK && len == sizeof(record) &&
+            record.version == LIFECYCLE_RECORD_VERSION &&
+            record.length == sizeof(record) &&
+            record.crc == lifecycle_record_crc(&record)) {
+        s_record = record;
+        s_record.running_ver[sizeof(s_record.running_ver) - 1] = '\0';
+        s_record.installed_ver[sizeof(s_record.installed_ver) - 1] = '\0';
+        s_record_dirty = false;
+        return;
+    }
+
+    if (err == ESP_OK) {
+        ESP_LOGW(tag, "[lifecycle] Lifecycle record invalid; rebuilding from legacy keys");
+    }
+
+    memset(&s_record, 0, sizeof(s_record));
+    s_record.version = LIFECYCLE_RECORD_VERSION;
+    s_record.length = sizeof(s_record);
+    lifecycle_record_migrate();
+    s_record_dirty = true;
+}
+
+static void lifecycle_record_lock(void) {
+    if (s_record_lock != NULL) {
+        xSemaphoreTakeRecursive(s_record_lock, portMAX_DELAY);
+    }
+}
+
+static void lifecycle_record_unlock(void) {
+    if (s_record_lock != NULL) {
+        xSemaphoreGiveRecursive(s_record_lock);
+    }
+}
+
+static esp_err_t lifecycle_record_commit(const char *log_tag) {
+    if (!s_record_dirty) {
+        return ESP_OK;
+    }
+
+    const char *tag = (log_tag != NULL) ? log_tag : LIFECYCLE_TAG;
+    s_record.version = LIFECYCLE_RECORD_VERSION;
+    s_record.length = sizeof(s_record);
+    s_record.crc = lifecycle_record_crc(&s_record);
+
+    nvs_handle_t handle;
+    esp_err_t err = lifecycle_nvs_session(k_restart_counter_namespace, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(tag,
+                 "[lifecycle] Failed to open NVS namespace '%s' for lifecycle record: %s",
+                 k_restart_counter_namespace,
+                 esp_err_to_name(err));
+        return err;
+    }
+
+    err = LIFECYCLE_NVS_OP(writes, nvs_set_blob(handle, k_lifecycle_record_key, &s_record, sizeof(s_record)));
+    if (err == ESP_OK && s_record_drop_legacy) {
+        esp_err_t erase_err = LIFECYCLE_NVS_OP(erases, nvs_erase_key(handle, k_restart_counter_key));
+        if (erase_err == ESP_OK || erase_err == ESP_ERR_NVS_NOT_FOUND) {
+            s_record_drop_legacy = false;
+        }
+    }
+    if (err == ESP_OK) {
+        lifecycle_nvs_mark_dirty(k_restart_counter_namespace);
+        err = lifecycle_nvs_commit(k_restart_counter_namespace);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(tag,
+                 "[lifecycle] Failed to store lifecycle record: %s",
+                 esp_err_to_name(err));
+        return err;
+    }
+
+    s_record_dirty = false;
+    return ESP_OK;
+}
+
 static esp_err_t lifecycle_ensure_nvs_initialized(const char *log_tag) {
     if (s_nvs_initialized) {
         return ESP_OK;
@@ -242,6 +1693,13 @@ static esp_err_t lifecycle_ensure_nvs_initialized(const char *log_tag) {
 
     const char *tag = (log_tag != NULL) ? log_tag : LIFECYCLE_TAG;
 
+    if (s_nvs_session_lock == NULL) {
+        s_nvs_session_lock = xSemaphoreCreateMutexStatic(&s_nvs_session_lock_buf);
+    }
+    if (s_record_lock == NULL) {
+        s_record_lock = xSemaphoreCreateRecursiveMutexStatic(&s_record_lock_buf);
+    }
+
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_LOGW(tag,
@@ -265,6 +1723,7 @@ static esp_err_t lifecycle_ensure_nvs_initialized(const char *log_tag) {
     }
 
     s_nvs_initialized = true;
+    lifecycle_record_load(tag);
     return ESP_OK;
 }
 
@@ -273,8 +1732,6 @@ static esp_err_t load_restart_counter_from_nvs(uint32_t *out_value, const char *
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint32_t value = 0;
-    nvs_handle_t handle;
     const char *tag = (log_tag != NULL) ? log_tag : LIFECYCLE_TAG;
 
     esp_err_t init_err = lifecycle_ensure_nvs_initialized(tag);
@@ -283,29 +1740,8 @@ static esp_err_t load_restart_counter_from_nvs(uint32_t *out_value, const char *
         return init_err;
     }
 
-    esp_err_t err = nvs_open(k_restart_counter_namespace, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(tag,
-                 "[lifecycle] Failed to open NVS namespace '%s' for restart counter: %s",
-                 k_restart_counter_namespace,
-                 esp_err_to_name(err));
-        *out_value = 0;
-        return err;
-    }
-
-    err = nvs_get_u32(handle, k_restart_counter_key, &value);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        value = 0;
-        err = ESP_OK;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(tag,
-                 "[lifecycle] Failed to read restart counter from NVS: %s",
-                 esp_err_to_name(err));
-    }
-
-    nvs_close(handle);
-    *out_value = value;
-    return err;
+    *out_value = s_record.restart_count;
+    return ESP_OK;
 }
 
 static esp_err_t save_restart_counter_to_nvs(uint32_t value, const char *log_tag) {
@@ -316,34 +1752,14 @@ static esp_err_t save_restart_counter_to_nvs(uint32_t value, const char *log_tag
         return init_err;
     }
 
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(k_restart_counter_namespace, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(tag,
-                 "[lifecycle] Failed to open NVS namespace '%s' for restart counter: %s",
-                 k_restart_counter_namespace,
-                 esp_err_to_name(err));
-        return err;
-    }
-
-    err = nvs_set_u32(handle, k_restart_counter_key, value);
-    if (err != ESP_OK) {
-        ESP_LOGE(tag,
-                 "[lifecycle] Failed to store restart counter in NVS: %s",
-                 esp_err_to_name(err));
-        nvs_close(handle);
-        return err;
-    }
-
-    esp_err_t commit_err = nvs_commit(handle);
-    if (commit_err != ESP_OK) {
-        ESP_LOGE(tag,
-                 "[lifecycle] Failed to commit restart counter to NVS: %s",
-                 esp_err_to_name(commit_err));
-        err = commit_err;
+    lifecycle_record_lock();
+    if (s_record.restart_count != value) {
+        s_record.restart_count = value;
+        s_record_dirty = true;
     }
 
-    nvs_close(handle);
+    esp_err_t err = lifecycle_record_commit(tag);
+    lifecycle_record_unlock();
     return err;
 }
 
@@ -387,7 +1803,10 @@ static void lifecycle_restart_counter_timeout(void *arg) {
                 (unsigned long long)k_restart_counter_timeout_ms);
     }
 
+    lifecycle_io_scope_t io;
+    lifecycle_io_begin(&io);
     lifecycle_reset_restart_counter();
+    lifecycle_io_end(LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT, &io);
 }
 
 static void lifecycle_schedule_restart_counter_timeout(const char *log_tag) {
@@ -431,6 +1850,9 @@ static void lifecycle_schedule_restart_counter_timeout(const char *log_tag) {
 
 void lifecycle_log_post_reset_state(const char *log_tag) {
     const char *tag = (log_tag != NULL) ? log_tag : LIFECYCLE_TAG;
+    lifecycle_io_scope_t io;
+    lifecycle_io_begin(&io);
+
     uint32_t persisted_count = 0;
     esp_err_t load_err = load_restart_counter_from_nvs(&persisted_count, tag);
     if (load_err == ESP_OK) {
@@ -457,6 +1879,7 @@ void lifecycle_log_post_reset_state(const char *log_tag) {
     lifecycle_schedule_restart_counter_timeout(tag);
 
     if (restart_count >= 10U) {
+        lifecycle_io_end(LIFECYCLE_IO_POST_RESET_STATE, &io);
         ESP_LOGW(tag, "[lifecycle] Detected 10 consecutive restarts; performing factory reset countdown");
         for (int i = 10; i >= 0; --i) {
             ESP_LOGW(tag, "[lifecycle] Factory reset in %d", i);
@@ -468,6 +1891,10 @@ void lifecycle_log_post_reset_state(const char *log_tag) {
         return;
     }
 
+#if CONFIG_ESP_EVENT_TRACE
+    event_trace_dump_previous(tag);
+#endif
+
     lifecycle_post_reset_reason_t reason = lifecycle_peek_post_reset_reason();
     const char *reason_str = "none";
 
@@ -491,23 +1918,187 @@ void lifecycle_log_post_reset_state(const char *log_tag) {
 
     ESP_LOGI(tag, "[lifecycle] post_reset_flag=%s", reason_str);
     lifecycle_clear_post_reset_state();
+
+    lifecycle_io_end(LIFECYCLE_IO_POST_RESET_STATE, &io);
+}
+
+#ifndef CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS
+#define CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS 1000
+#endif
+
+// Shutdown phases, reported in the log and the event trace
+typedef enum {
+    LIFECYCLE_SHUTDOWN_MDNS_GOODBYE = 0,
+    LIFECYCLE_SHUTDOWN_DRAIN_SESSIONS,
+    LIFECYCLE_SHUTDOWN_RESET_STORE,
+    LIFECYCLE_SHUTDOWN_PROVISIONING,
+    LIFECYCLE_SHUTDOWN_WIFI,
+    LIFECYCLE_SHUTDOWN_TOTAL,
+    LIFECYCLE_SHUTDOWN_PHASE_COUNT,
+} lifecycle_shutdown_phase_t;
+
+static uint32_t s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_PHASE_COUNT];
+// Open sessions as counted from the server's CLIENT_CONNECTED/DISCONNECTED
+// events; the same events identify the server task
+static atomic_int s_hap_sessions = 0;
+static TaskHandle_t s_hap_server_task = NULL;
+static TaskHandle_t s_hap_drain_waiter = NULL;
+static atomic_bool s_hap_drain_accepted = false;
+static bool s_hap_drain_fd[CONFIG_LWIP_MAX_SOCKETS];
+
+static int64_t lifecycle_shutdown_phase_end(lifecycle_shutdown_phase_t phase, int64_t start_us) {
+    int64_t now = esp_timer_get_time();
+    s_shutdown_phase_us[phase] = (uint32_t)(now - start_us);
+    EVENT_TRACE(EVENT_TRACE_SHUTDOWN, phase, s_shutdown_phase_us[phase]);
+    return now;
+}
+
+#ifndef CONFIG_LCM_HAP_SESSION_HEAP_BYTES
+#define CONFIG_LCM_HAP_SESSION_HEAP_BYTES 8192
+#endif
+#ifndef CONFIG_LCM_HAP_HEAP_RESERVE_BYTES
+#define CONFIG_LCM_HAP_HEAP_RESERVE_BYTES 24576
+#endif
+
+static uint32_t s_hap_client_budget = 0;
+static uint32_t s_hap_peak_sessions = 0;
+
+uint32_t lifecycle_hap_configure_client_budget(uint32_t max_clients) {
+#if CONFIG_LCM_HAP_ADAPTIVE_CLIENTS
+    // Measured with Wi-Fi and lwIP up, just before the server starts. The
+    // result goes into the server config as max_clients: the server closes
+    // an accepted socket over that limit before it allocates a session.
+    uint32_t free_heap = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t usable = (free_heap > CONFIG_LCM_HAP_HEAP_RESERVE_BYTES)
+            ? free_heap - CONFIG_LCM_HAP_HEAP_RESERVE_BYTES : 0U;
+    uint32_t budget = usable / CONFIG_LCM_HAP_SESSION_HEAP_BYTES;
+    if (budget > max_clients) {
+        budget = max_clients;
+    }
+    if (budget == 0U) {
+        // Always leave room for one controller, otherwise the plug is unreachable
+        budget = 1;
+    }
+
+    s_hap_client_budget = budget;
+    ESP_LOGI(LIFECYCLE_TAG, "[lifecycle] HAP client budget %" PRIu32 " of %" PRIu32 " (free heap %" PRIu32 ", %d per session, %d reserve)",
+             budget, max_clients, free_heap, CONFIG_LCM_HAP_SESSION_HEAP_BYTES, CONFIG_LCM_HAP_HEAP_RESERVE_BYTES);
+    return budget;
+#else
+    return max_clients;
+#endif
+}
+
+void lifecycle_get_hap_client_stats(lifecycle_hap_client_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+    int sessions = atomic_load(&s_hap_sessions);
+    out_stats->budget = s_hap_client_budget;
+    out_stats->sessions = sessions > 0 ? (uint32_t)sessions : 0U;
+    out_stats->peak_sessions = s_hap_peak_sessions;
+}
+
+void lifecycle_homekit_event(homekit_event_t event) {
+    // The server calls on_event from its own task
+    s_hap_server_task = xTaskGetCurrentTaskHandle();
+
+    if (event == HOMEKIT_EVENT_CLIENT_CONNECTED) {
+        int sessions = atomic_fetch_add(&s_hap_sessions, 1) + 1;
+        if ((uint32_t)sessions > s_hap_peak_sessions) {
+            s_hap_peak_sessions = (uint32_t)sessions;
+        }
+        TaskHandle_t waiter = s_hap_drain_waiter;
+        if (waiter != NULL) {
+            atomic_store(&s_hap_drain_accepted, true);
+            xTaskNotifyGive(waiter);
+        }
+    } else if (event == HOMEKIT_EVENT_CLIENT_DISCONNECTED) {
+        atomic_fetch_sub(&s_hap_sessions, 1);
+        TaskHandle_t waiter = s_hap_drain_waiter;
+        if (waiter != NULL) {
+            xTaskNotifyGive(waiter);
+        }
+    }
+}
+
+// Half-close a session once: lwIP sends the FIN after any queued response
+// data, the controller closes its side and the server reaps the session.
+// Sessions accepted while draining get the same treatment, so no new work
+// is taken on.
+static void lifecycle_hap_half_close(int fd, void *ctx) {
+    (void)ctx;
+    int slot = fd - LWIP_SOCKET_OFFSET;
+    if (s_hap_drain_fd[slot]) {
+        return;
+    }
+    s_hap_drain_fd[slot] = true;
+    shutdown(fd, SHUT_WR);
+}
+
+// Returns the number of sessions still open, by the event count
+static size_t lifecycle_hap_drain_sessions(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    TaskHandle_t server = s_hap_server_task;
+    UBaseType_t own_priority = uxTaskPriorityGet(NULL);
+    uint32_t timeout_ms = CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS;
+
+    if (server == self) {
+        // Called from a HomeKit setter: the server cannot process closes until we return
+        timeout_ms = 0;
+    } else if (server != NULL && uxTaskPriorityGet(server) <= own_priority) {
+        // Only run while the server loop is idle, so no response is in flight
+        UBaseType_t server_priority = uxTaskPriorityGet(server);
+        vTaskPrioritySet(NULL, server_priority > 0 ? server_priority - 1 : 0);
+    }
+
+    memset(s_hap_drain_fd, 0, sizeof(s_hap_drain_fd));
+    atomic_store(&s_hap_drain_accepted, false);
+    s_hap_drain_waiter = self;
+    xTaskNotifyStateClear(NULL);
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    lifecycle_hap_for_each_session(lifecycle_hap_half_close, NULL);
+    while (atomic_load(&s_hap_sessions) > 0) {
+        int64_t left_us = deadline - esp_timer_get_time();
+        if (left_us <= 0) {
+            break;
+        }
+        // Woken by every CLIENT_DISCONNECTED and CLIENT_CONNECTED event
+        TickType_t wait = pdMS_TO_TICKS(left_us / 1000);
+        ulTaskNotifyTake(pdTRUE, wait > 0 ? wait : 1);
+        if (atomic_exchange(&s_hap_drain_accepted, false)) {
+            // A session accepted while draining gets the same half-close
+            lifecycle_hap_for_each_session(lifecycle_hap_half_close, NULL);
+        }
+    }
+
+    s_hap_drain_waiter = NULL;
+    vTaskPrioritySet(NULL, own_priority);
+    int left = atomic_load(&s_hap_sessions);
+    return left > 0 ? (size_t)left : 0U;
 }
 
 static void lifecycle_shutdown_homekit(bool reset_store) {
     lifecycle_log_step("stop_homekit");
-    ESP_LOGD(LIFECYCLE_TAG,
-             "HomeKit stop requested; relying on network teardown for active sessions");
+    int64_t start_us = esp_timer_get_time();
 
-    lifecycle_log_step("wait_hap_clients");
-    vTaskDelay(pdMS_TO_TICKS(100));
-
-    lifecycle_log_step("stop_mdns");
+    // The goodbye (TTL 0) makes controllers drop the cached service right away
+    lifecycle_log_step("mdns_goodbye");
     esp_err_t mdns_err = mdns_service_remove("_hap", "_tcp");
     if (mdns_err != ESP_OK && mdns_err != ESP_ERR_NOT_FOUND &&
             mdns_err != ESP_ERR_INVALID_STATE) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to remove mDNS service: %s",
                  esp_err_to_name(mdns_err));
     }
+    int64_t now = lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_MDNS_GOODBYE, start_us);
+
+    lifecycle_log_step("drain_hap_sessions");
+    int sessions = atomic_load(&s_hap_sessions);
+    size_t left = lifecycle_hap_drain_sessions();
+    now = lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_DRAIN_SESSIONS, now);
+    ESP_LOGI(LIFECYCLE_TAG, "[lifecycle] drained %d HAP session(s) in %" PRIu32 " ms, %u left",
+             sessions, s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_DRAIN_SESSIONS] / 1000, (unsigned)left);
 
     mdns_free();
 
@@ -515,6 +2106,7 @@ static void lifecycle_shutdown_homekit(bool reset_store) {
         lifecycle_log_step("reset_homekit_store");
         homekit_server_reset();
     }
+    lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_RESET_STORE, now);
 }
 
 static void lifecycle_stop_provisioning_servers(void) {
@@ -528,14 +2120,93 @@ static void lifecycle_stop_provisioning_servers(void) {
 }
 
 static void lifecycle_perform_common_shutdown(bool reset_homekit_store) {
+    int64_t start_us = esp_timer_get_time();
+
     lifecycle_shutdown_homekit(reset_homekit_store);
+    int64_t now = esp_timer_get_time();
     lifecycle_stop_provisioning_servers();
+    now = lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_PROVISIONING, now);
 
     lifecycle_log_step("stop_wifi");
     esp_err_t stop_err = wifi_stop();
     if (stop_err != ESP_OK) {
         ESP_LOGW(LIFECYCLE_TAG, "wifi_stop failed: %s", esp_err_to_name(stop_err));
     }
+    lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_WIFI, now);
+    lifecycle_shutdown_phase_end(LIFECYCLE_SHUTDOWN_TOTAL, start_us);
+
+    ESP_LOGI(LIFECYCLE_TAG, "[lifecycle] shutdown: mdns=%" PRIu32 "us drain=%" PRIu32 "us store=%" PRIu32
+             "us provisioning=%" PRIu32 "us wifi=%" PRIu32 "us total=%" PRIu32 "us",
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_MDNS_GOODBYE],
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_DRAIN_SESSIONS],
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_RESET_STORE],
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_PROVISIONING],
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_WIFI],
+             s_shutdown_phase_us[LIFECYCLE_SHUTDOWN_TOTAL]);
+}
+
+#ifndef CONFIG_XTAL_FREQ
+#define CONFIG_XTAL_FREQ 40
+#endif
+
+const char *lifecycle_power_profile_name(void) {
+#if CONFIG_LCM_POWER_PROFILE_ECO
+    return "eco";
+#elif CONFIG_LCM_POWER_PROFILE_BALANCED
+    return "balanced";
+#else
+    return "performance";
+#endif
+}
+
+esp_err_t lifecycle_power_enable_gpio_wakeup(int gpio, bool active_low) {
+#if CONFIG_LCM_POWER_PROFILE_ECO
+    esp_err_t err = gpio_wakeup_enable((gpio_num_t)gpio,
+                                       active_low ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    if (err != ESP_OK) {
+        ESP_LOGE(LIFECYCLE_TAG, "[lifecycle] Failed to enable GPIO %d wakeup: %s", gpio, esp_err_to_name(err));
+        return err;
+    }
+    return esp_sleep_enable_gpio_wakeup();
+#else
+    (void)gpio;
+    (void)active_low;
+    return ESP_OK;
+#endif
+}
+
+// Modem power save matches the selected profile; the eco profile also lets
+// esp_pm scale the CPU clock and enter automatic light sleep between beacons.
+static esp_err_t wifi_apply_power_profile(void) {
+#if CONFIG_LCM_POWER_PROFILE_ECO
+    wifi_ps_type_t ps = WIFI_PS_MAX_MODEM;
+#elif CONFIG_LCM_POWER_PROFILE_BALANCED
+    wifi_ps_type_t ps = WIFI_PS_MIN_MODEM;
+#else
+    wifi_ps_type_t ps = WIFI_PS_NONE;
+#endif
+
+    esp_err_t err = esp_wifi_set_ps(ps);
+    if (err != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Failed to set power save mode: %s", esp_err_to_name(err));
+        return err;
+    }
+
+#if CONFIG_LCM_POWER_PROFILE_ECO
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+    err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(WIFI_TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+#endif
+
+    ESP_LOGI(WIFI_TAG, "Power profile: %s", lifecycle_power_profile_name());
+    return ESP_OK;
 }
 
 esp_err_t wifi_start(void (*on_ready)(void)) {
@@ -569,6 +2240,22 @@ esp_err_t wifi_start(void (*on_ready)(void)) {
         wc.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
     }
 
+#if CONFIG_LCM_POWER_PROFILE_ECO
+    wc.sta.listen_interval = CONFIG_LCM_WIFI_LISTEN_INTERVAL;
+#endif
+#if CONFIG_LCM_WIFI_ROAMING
+    wc.sta.rm_enabled = 1;
+    wc.sta.btm_enabled = 1;
+    wc.sta.ft_enabled = 1;
+#endif
+
+    // Keep the full-scan configuration around for the fast reconnect fallback
+    s_wifi_config = wc;
+    s_wifi_boot_path_recorded = false;
+    s_wifi_boot_path = LIFECYCLE_WIFI_CONNECT_PATH_NONE;
+    s_wifi_directed_attempt = wifi_fast_reconnect_apply(&wc);
+    s_wifi_directed_config_active = s_wifi_directed_attempt;
+
     err = esp_netif_init();
     if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(WIFI_TAG, "Failed to init netif: %s", esp_err_to_name(err));
@@ -587,6 +2274,31 @@ esp_err_t wifi_start(void (*on_ready)(void)) {
         }
     }
 
+#if CONFIG_LCM_WIFI_IP_STATIC
+    WIFI_CHECK(wifi_apply_static_ip(s_wifi_netif));
+#elif CONFIG_LCM_WIFI_IP_DHCP_CACHE
+    wifi_lease_seed(s_wifi_netif);
+#endif
+
+    if (s_wifi_reconnect_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = wifi_reconnect_timeout,
+            .name = "wifi_reconnect",
+        };
+        WIFI_CHECK(esp_timer_create(&timer_args, &s_wifi_reconnect_timer));
+    }
+#if CONFIG_LCM_WIFI_ROAMING
+    if (s_wifi_roam_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = wifi_roam_timeout,
+            .name = "wifi_roam",
+        };
+        WIFI_CHECK(esp_timer_create(&timer_args, &s_wifi_roam_timer));
+    }
+    atomic_store(&s_wifi_roam_state, WIFI_ROAM_IDLE);
+#endif
+    s_wifi_stopping = false;
+
     WIFI_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     WIFI_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
 
@@ -597,6 +2309,7 @@ esp_err_t wifi_start(void (*on_ready)(void)) {
 
     WIFI_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wc));
     WIFI_CHECK(esp_wifi_start());
+    WIFI_CHECK(wifi_apply_power_profile());
 
     s_wifi_on_ready_cb = on_ready;
     s_wifi_started = true;
@@ -614,6 +2327,20 @@ esp_err_t wifi_stop(void) {
 
     esp_err_t result = ESP_OK;
 
+    s_wifi_stopping = true;
+    if (s_wifi_reconnect_timer != NULL) {
+        esp_timer_stop(s_wifi_reconnect_timer);
+        esp_timer_delete(s_wifi_reconnect_timer);
+        s_wifi_reconnect_timer = NULL;
+    }
+#if CONFIG_LCM_WIFI_ROAMING
+    if (s_wifi_roam_timer != NULL) {
+        esp_timer_stop(s_wifi_roam_timer);
+        esp_timer_delete(s_wifi_roam_timer);
+        s_wifi_roam_timer = NULL;
+    }
+#endif
+
     esp_err_t disconnect_err = esp_wifi_disconnect();
     if (disconnect_err != ESP_OK && disconnect_err != ESP_ERR_WIFI_NOT_STARTED &&
             disconnect_err != ESP_ERR_WIFI_NOT_INIT) {
@@ -673,8 +2400,8 @@ esp_err_t lifecycle_nvs_init(void) {
     return lifecycle_ensure_nvs_initialized(LIFECYCLE_TAG);
 }
 
-esp_err_t lifecycle_init_firmware_revision(homekit_characteristic_t *revision,
-                                           const char *fallback_version) {
+static esp_err_t lifecycle_resolve_firmware_revision(homekit_characteristic_t *revision,
+                                                     const char *fallback_version) {
     if (revision == NULL || fallback_version == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -699,37 +2426,53 @@ esp_err_t lifecycle_init_firmware_revision(homekit_characteristic_t *revision,
         return init_err;
     }
 
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open("fwcfg", NVS_READWRITE, &handle);
-    if (err == ESP_OK) {
-        size_t required = sizeof(s_fw_revision);
-        err = nvs_get_str(handle, "installed_ver", s_fw_revision, &required);
-        if (err == ESP_OK && s_fw_revision[0] != '\0') {
-            used_stored_value = true;
-        } else if (err == ESP_ERR_NVS_NOT_FOUND || s_fw_revision[0] == '\0') {
-            strlcpy(s_fw_revision, current_version, sizeof(s_fw_revision));
-            esp_err_t set_err = nvs_set_str(handle, "installed_ver", s_fw_revision);
-            if (set_err != ESP_OK) {
-                ESP_LOGW(LIFECYCLE_TAG, "Failed to store firmware revision: %s",
-                         esp_err_to_name(set_err));
-                status = set_err;
-            } else {
-                esp_err_t commit_err = nvs_commit(handle);
-                if (commit_err != ESP_OK) {
-                    ESP_LOGW(LIFECYCLE_TAG, "Commit of firmware revision failed: %s",
-                             esp_err_to_name(commit_err));
-                    status = commit_err;
+    if (s_record.installed_ver[0] != '\0' &&
+            strncmp(s_record.running_ver, current_version, sizeof(s_record.running_ver)) == 0) {
+        // Same app as when the record was written: no fwcfg round trip needed
+        strlcpy(s_fw_revision, s_record.installed_ver, sizeof(s_fw_revision));
+        used_stored_value = true;
+    } else {
+        nvs_handle_t handle;
+        esp_err_t err = lifecycle_nvs_session("fwcfg", &handle);
+        if (err == ESP_OK) {
+            size_t required = sizeof(s_fw_revision);
+            err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "installed_ver", s_fw_revision, &required));
+            if (err == ESP_OK && s_fw_revision[0] != '\0') {
+                used_stored_value = true;
+            } else if (err == ESP_ERR_NVS_NOT_FOUND || s_fw_revision[0] == '\0') {
+                strlcpy(s_fw_revision, current_version, sizeof(s_fw_revision));
+                esp_err_t set_err = LIFECYCLE_NVS_OP(writes, nvs_set_str(handle, "installed_ver", s_fw_revision));
+                if (set_err != ESP_OK) {
+                    ESP_LOGW(LIFECYCLE_TAG, "Failed to store firmware revision: %s",
+                             esp_err_to_name(set_err));
+                    status = set_err;
+                } else {
+                    lifecycle_nvs_mark_dirty("fwcfg");
+                    esp_err_t commit_err = lifecycle_nvs_commit("fwcfg");
+                    if (commit_err != ESP_OK) {
+                        ESP_LOGW(LIFECYCLE_TAG, "Commit of firmware revision failed: %s",
+                                 esp_err_to_name(commit_err));
+                        status = commit_err;
+                    }
                 }
+            } else {
+                ESP_LOGW(LIFECYCLE_TAG, "Reading stored firmware revision failed: %s",
+                         esp_err_to_name(err));
+                strlcpy(s_fw_revision, current_version, sizeof(s_fw_revision));
             }
         } else {
-            ESP_LOGW(LIFECYCLE_TAG, "Reading stored firmware revision failed: %s",
-                     esp_err_to_name(err));
-            strlcpy(s_fw_revision, current_version, sizeof(s_fw_revision));
+            ESP_LOGW(LIFECYCLE_TAG, "Unable to open fwcfg namespace: %s", esp_err_to_name(err));
+            status = err;
+        }
+
+        if (status == ESP_OK) {
+            lifecycle_record_lock();
+            strlcpy(s_record.running_ver, current_version, sizeof(s_record.running_ver));
+            strlcpy(s_record.installed_ver, s_fw_revision, sizeof(s_record.installed_ver));
+            s_record_dirty = true;
+            lifecycle_record_commit(LIFECYCLE_TAG);
+            lifecycle_record_unlock();
         }
-        nvs_close(handle);
-    } else {
-        ESP_LOGW(LIFECYCLE_TAG, "Unable to open fwcfg namespace: %s", esp_err_to_name(err));
-        status = err;
     }
 
     revision->value.string_value = s_fw_revision;
@@ -754,6 +2497,172 @@ const char *lifecycle_get_firmware_revision_string(void) {
     return NULL;
 }
 
+esp_err_t lifecycle_init_firmware_revision(homekit_characteristic_t *revision,
+                                           const char *fallback_version) {
+    lifecycle_io_scope_t io;
+    lifecycle_io_begin(&io);
+    esp_err_t err = lifecycle_resolve_firmware_revision(revision, fallback_version);
+    lifecycle_io_end(LIFECYCLE_IO_FIRMWARE_REVISION, &io);
+    return err;
+}
+
+// Deferred OTA: a fleet-wide trigger spreads reboots into the factory LCM over
+// a window instead of hitting the update server in the same second.
+#ifndef CONFIG_LCM_OTA_JITTER_S
+#define CONFIG_LCM_OTA_JITTER_S 0
+#endif
+#ifndef CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT
+#define CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT 100
+#endif
+#ifndef CONFIG_LCM_OTA_SLOT_S
+#define CONFIG_LCM_OTA_SLOT_S 120
+#endif
+
+#if CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT <= 0 || CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT > 100
+#error "CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT must be between 1 and 100"
+#endif
+
+#define LIFECYCLE_OTA_SLOTS \
+    ((100U + CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT - 1U) / CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT)
+
+static esp_timer_handle_t s_ota_schedule_timer = NULL;
+static int64_t s_ota_due_us = 0;
+static homekit_characteristic_t *s_ota_pending = NULL;
+static portMUX_TYPE s_ota_schedule_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Stable per-device delay: FNV-1a over the STA MAC picks the slot and the
+// jitter inside it, so a repeated trigger lands on the same moment.
+static uint32_t lifecycle_ota_delay_s(void) {
+    uint8_t mac[6] = {0};
+    if (esp_read_mac(mac, ESP_MAC_WIFI_STA) != ESP_OK) {
+        esp_fill_random(mac, sizeof(mac));
+    }
+
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < sizeof(mac); ++i) {
+        hash ^= mac[i];
+        hash *= 16777619U;
+    }
+
+    uint32_t slot = hash % LIFECYCLE_OTA_SLOTS;
+    uint32_t jitter = 0;
+    if (CONFIG_LCM_OTA_JITTER_S > 0) {
+        jitter = (hash / LIFECYCLE_OTA_SLOTS) % ((uint32_t)CONFIG_LCM_OTA_JITTER_S + 1U);
+    }
+    return slot * (uint32_t)CONFIG_LCM_OTA_SLOT_S + jitter;
+}
+
+uint32_t lifecycle_ota_pending_seconds(void) {
+    portENTER_CRITICAL(&s_ota_schedule_lock);
+    int64_t due = s_ota_due_us;
+    portEXIT_CRITICAL(&s_ota_schedule_lock);
+
+    if (due == 0) {
+        return 0;
+    }
+    int64_t remaining = due - esp_timer_get_time();
+    // Round up: a pending update never reads as 0 s
+    return remaining > 0 ? (uint32_t)((remaining + 999999) / 1000000) : 1U;
+}
+
+homekit_value_t lifecycle_ota_pending_get(const homekit_characteristic_t *characteristic) {
+    (void)characteristic;
+    return HOMEKIT_UINT32(lifecycle_ota_pending_seconds());
+}
+
+void lifecycle_configure_ota_pending(homekit_characteristic_t *pending) {
+    s_ota_pending = pending;
+}
+
+static void lifecycle_ota_pending_notify(void) {
+    if (s_ota_pending == NULL) {
+        return;
+    }
+    s_ota_pending->value = HOMEKIT_UINT32(lifecycle_ota_pending_seconds());
+    notify_scheduler_submit(s_ota_pending, s_ota_pending->value, NOTIFY_PRIORITY_STATE);
+}
+
+static void lifecycle_ota_schedule_clear(void) {
+    portENTER_CRITICAL(&s_ota_schedule_lock);
+    s_ota_due_us = 0;
+    portEXIT_CRITICAL(&s_ota_schedule_lock);
+    lifecycle_ota_pending_notify();
+}
+
+static void lifecycle_ota_update_task(void *arg) {
+    (void)arg;
+    lifecycle_request_update_and_reboot();
+    vTaskDelete(NULL);
+}
+
+static void lifecycle_ota_schedule_timer_cb(void *arg) {
+    (void)arg;
+    // The schedule is used up: an in-app update that finds nothing newer
+    // returns without a reboot and UpdatePending must read 0 again
+    lifecycle_ota_schedule_clear();
+    // The update path shuts Wi-Fi down and blocks; keep it off the esp_timer task
+    if (xTaskCreate(lifecycle_ota_update_task, "lcm_update", 4096, NULL, 5, NULL) != pdPASS) {
+        lifecycle_request_update_and_reboot();
+    }
+}
+
+void lifecycle_schedule_update(void) {
+    uint32_t delay_s = lifecycle_ota_delay_s();
+    if (delay_s == 0) {
+        // Via a task: the shutdown drains HAP sessions, which the server task
+        // (our caller for HomeKit triggers) must be free to close
+        lifecycle_ota_schedule_timer_cb(NULL);
+        return;
+    }
+
+    if (s_ota_schedule_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = lifecycle_ota_schedule_timer_cb,
+            .name = "lcm_ota_sched",
+        };
+        if (esp_timer_create(&args, &s_ota_schedule_timer) != ESP_OK) {
+            ESP_LOGE(LIFECYCLE_TAG, "Failed to create OTA schedule timer, updating now");
+            lifecycle_request_update_and_reboot();
+            return;
+        }
+    }
+
+    if (lifecycle_ota_pending_seconds() != 0) {
+        ESP_LOGI(LIFECYCLE_TAG, "Firmware update already scheduled in %" PRIu32 " s",
+                 lifecycle_ota_pending_seconds());
+        return;
+    }
+
+    esp_err_t err = esp_timer_start_once(s_ota_schedule_timer, (uint64_t)delay_s * 1000000ULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(LIFECYCLE_TAG, "Failed to schedule update (%s), updating now", esp_err_to_name(err));
+        lifecycle_request_update_and_reboot();
+        return;
+    }
+
+    portENTER_CRITICAL(&s_ota_schedule_lock);
+    s_ota_due_us = esp_timer_get_time() + (int64_t)delay_s * 1000000LL;
+    portEXIT_CRITICAL(&s_ota_schedule_lock);
+    EVENT_TRACE(EVENT_TRACE_UPDATE, 0, delay_s);
+
+    ESP_LOGI(LIFECYCLE_TAG, "Firmware update scheduled in %" PRIu32 " s (slot %" PRIu32 "/%u of %d s)",
+             delay_s, delay_s / (uint32_t)CONFIG_LCM_OTA_SLOT_S + 1U, (unsigned)LIFECYCLE_OTA_SLOTS,
+             CONFIG_LCM_OTA_SLOT_S);
+    lifecycle_ota_pending_notify();
+}
+
+void lifecycle_cancel_scheduled_update(void) {
+    if (lifecycle_ota_pending_seconds() == 0) {
+        return;
+    }
+
+    if (s_ota_schedule_timer != NULL) {
+        esp_timer_stop(s_ota_schedule_timer);
+    }
+    ESP_LOGI(LIFECYCLE_TAG, "Scheduled firmware update cancelled");
+    lifecycle_ota_schedule_clear();
+}
+
 void lifecycle_handle_ota_trigger(homekit_characteristic_t *characteristic,
                                   const homekit_value_t value) {
     if (characteristic == NULL) {
@@ -766,11 +2675,14 @@ void lifecycle_handle_ota_trigger(homekit_characteristic_t *characteristic,
 
     bool requested = value.bool_value;
     characteristic->value.bool_value = false;
-    homekit_characteristic_notify(characteristic, HOMEKIT_BOOL(characteristic->value.bool_value));
+    notify_scheduler_submit(characteristic, HOMEKIT_BOOL(characteristic->value.bool_value),
+                            NOTIFY_PRIORITY_STATE);
 
     if (requested) {
         ESP_LOGI(LIFECYCLE_TAG, "HomeKit requested firmware update");
-        lifecycle_request_update_and_reboot();
+        lifecycle_schedule_update();
+    } else {
+        lifecycle_cancel_scheduled_update();
     }
 }
 
@@ -807,26 +2719,144 @@ esp_err_t lifecycle_configure_homekit(homekit_characteristic_t *revision,
     return rev_err;
 }
 
+#if CONFIG_LCM_UPDATE_IN_APP
+#define LIFECYCLE_INAPP_UPDATE_STACK_SIZE 8192
+
+static atomic_bool s_inapp_update_running = false;
+
+static void lifecycle_reboot_into_factory_update(void) __attribute__((noreturn));
+
+static esp_err_t lifecycle_store_installed_version(const char *version, const esp_partition_t *partition) {
+    nvs_handle_t handle;
+    esp_err_t err = lifecycle_nvs_session("fwcfg", &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Zelfde keys als de factory LCM, zodat de firmware revision na de reboot klopt
+    err = LIFECYCLE_NVS_OP(writes, nvs_set_str(handle, "installed_ver", version));
+    if (err == ESP_OK) {
+        err = LIFECYCLE_NVS_OP(writes, nvs_set_str(handle, "installed_part", partition->label));
+    }
+    if (err == ESP_OK) {
+        lifecycle_nvs_mark_dirty("fwcfg");
+        err = lifecycle_nvs_commit("fwcfg");
+    }
+    return err;
+}
+
+static void lifecycle_inapp_update_task(void *arg) {
+    (void)arg;
+    char repo[128] = {0};
+    uint8_t prerelease = 0;
+    nvs_handle_t handle;
+
+    esp_err_t err = lifecycle_nvs_session("fwcfg", &handle);
+    if (err == ESP_OK) {
+        size_t len = sizeof(repo);
+        err = LIFECYCLE_NVS_OP(reads, nvs_get_str(handle, "repo", repo, &len));
+        if (LIFECYCLE_NVS_OP(reads, nvs_get_u8(handle, "pre", &prerelease)) != ESP_OK) {
+            prerelease = 0;
+        }
+    }
+
+    ota_download_release_t release;
+    bool newer = false;
+    if (err == ESP_OK) {
+        err = ota_download_check(repo, prerelease != 0, lifecycle_get_firmware_revision_string(),
+                                 &release, &newer);
+    }
+    if (err == ESP_OK && !newer) {
+        ESP_LOGI(LIFECYCLE_TAG, "Firmware already up to date");
+        atomic_store(&s_inapp_update_running, false);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ota_download_result_t result;
+    if (err == ESP_OK) {
+        if (lifecycle_update_started) {
+            lifecycle_update_started();
+        }
+        // HomeKit blijft bedienbaar; deze task draait op lage prioriteit
+        err = ota_download_image(repo, &release, &result);
+    }
+
+    if (err == ESP_OK) {
+        err = lifecycle_store_installed_version(release.version, result.partition);
+        if (err != ESP_OK) {
+            ESP_LOGW(LIFECYCLE_TAG, "Failed to persist installed version %s: %s",
+                     release.version, esp_err_to_name(err));
+        }
+
+        lifecycle_log_step("set_boot=ota");
+        err = esp_ota_set_boot_partition(result.partition);
+    }
+
+    if (err != ESP_OK) {
+        // Fallback: de factory LCM probeert het opnieuw met zijn eigen download
+        ESP_LOGE(LIFECYCLE_TAG, "In-app update failed (%s); falling back to factory update",
+                 esp_err_to_name(err));
+        EVENT_TRACE(EVENT_TRACE_UPDATE, 2, (uint32_t)err);
+        lifecycle_reboot_into_factory_update();
+    }
+
+    ESP_LOGI(LIFECYCLE_TAG, "In-app update to %s ready in '%s' after %" PRIu32 " ms; rebooting once",
+             release.version, result.partition->label, result.elapsed_ms);
+    lifecycle_mark_post_reset(LIFECYCLE_POST_RESET_REASON_UPDATE);
+    lifecycle_perform_common_shutdown(false);
+
+    lifecycle_log_step("reboot");
+    esp_restart();
+}
+
+void lifecycle_request_update_and_reboot(void) {
+    if (atomic_exchange(&s_inapp_update_running, true)) {
+        ESP_LOGI(LIFECYCLE_TAG, "In-app update already running");
+        return;
+    }
+
+    ESP_LOGI(LIFECYCLE_TAG, "Starting in-app update into the inactive OTA partition");
+    EVENT_TRACE(EVENT_TRACE_UPDATE, 1, 0);
+    if (xTaskCreate(lifecycle_inapp_update_task, "lcm_ota", LIFECYCLE_INAPP_UPDATE_STACK_SIZE,
+                    NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+        ESP_LOGE(LIFECYCLE_TAG, "Failed to start in-app update task");
+        lifecycle_reboot_into_factory_update();
+    }
+}
+
+static void lifecycle_reboot_into_factory_update(void) {
+#else
 void lifecycle_request_update_and_reboot(void) {
+#endif
     ESP_LOGI(LIFECYCLE_TAG, "Requesting Lifecycle Manager update and reboot");
 
+    if (lifecycle_update_started) {
+        lifecycle_update_started();
+    }
+
+    lifecycle_io_scope_t io;
+    lifecycle_io_begin(&io);
+
     nvs_handle_t handle;
-    esp_err_t err = nvs_open("lcm", NVS_READWRITE, &handle);
+    esp_err_t err = lifecycle_nvs_session("lcm", &handle);
     if (err != ESP_OK) {
         ESP_LOGE(LIFECYCLE_TAG, "Failed to open NVS namespace 'lcm': %s", esp_err_to_name(err));
     } else {
-        err = nvs_set_u8(handle, "do_update", 1);
+        err = LIFECYCLE_NVS_OP(writes, nvs_set_u8(handle, "do_update", 1));
         if (err != ESP_OK) {
             ESP_LOGE(LIFECYCLE_TAG, "Failed to set do_update flag: %s", esp_err_to_name(err));
         } else {
-            err = nvs_commit(handle);
+            lifecycle_nvs_mark_dirty("lcm");
+            err = lifecycle_nvs_commit("lcm");
             if (err != ESP_OK) {
                 ESP_LOGE(LIFECYCLE_TAG, "Failed to commit update flag: %s", esp_err_to_name(err));
             }
         }
-        nvs_close(handle);
     }
 
+    lifecycle_io_end(LIFECYCLE_IO_UPDATE_REQUEST, &io);
+
     bool factory_boot_selected = false;
 
     const esp_partition_t *factory = esp_partition_find_first(
@@ -847,9 +2877,6 @@ void lifecycle_request_update_and_reboot(void) {
 
     lifecycle_perform_common_shutdown(false);
 
-    lifecycle_log_step("delay_before_reset");
-    vTaskDelay(pdMS_TO_TICKS(100));
-
     lifecycle_log_step("reboot");
     if (factory_boot_selected) {
         ESP_LOGI(LIFECYCLE_TAG, "Rebooting into factory partition for update");
@@ -876,13 +2903,37 @@ void lifecycle_reset_homekit_and_reboot(void) {
 
     lifecycle_perform_common_shutdown(true);
 
-    lifecycle_log_step("delay_before_reset");
-    vTaskDelay(pdMS_TO_TICKS(100));
-
     lifecycle_log_step("reboot");
     esp_restart();
 }
 
+static void erase_nvs_partition(void) {
+    lifecycle_log_step("erase_nvs_partition");
+
+    lifecycle_nvs_close_all();
+
+    esp_err_t err = nvs_flash_deinit();
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_INITIALIZED) {
+        ESP_LOGW(LIFECYCLE_TAG, "nvs_flash_deinit failed: %s", esp_err_to_name(err));
+    }
+
+    s_nvs_initialized = false;
+    s_record_loaded = false;
+    s_record_dirty = false;
+    memset(&s_record, 0, sizeof(s_record));
+
+    const esp_partition_t *nvs_part = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
+    s_partition_stats.erases++;
+    s_partition_stats.erase_bytes += (nvs_part != NULL) ? (uint32_t)nvs_part->size : 0U;
+
+    err = nvs_flash_erase();
+    if (err != ESP_OK) {
+        ESP_LOGE(LIFECYCLE_TAG, "nvs_flash_erase failed: %s", esp_err_to_name(err));
+    }
+}
+
+#if !CONFIG_LCM_FAST_FACTORY_RESET
 static void erase_wifi_credentials(void) {
     ESP_LOGI(LIFECYCLE_TAG, "Clearing Wi-Fi credentials from NVS namespace 'wifi_cfg'");
 
@@ -895,44 +2946,24 @@ static void erase_wifi_credentials(void) {
     }
 
     nvs_handle_t handle;
-    esp_err_t err = nvs_open("wifi_cfg", NVS_READWRITE, &handle);
+    esp_err_t err = lifecycle_nvs_session("wifi_cfg", &handle);
     if (err != ESP_OK) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to open wifi_cfg namespace: %s", esp_err_to_name(err));
         return;
     }
 
-    esp_err_t erase_err = nvs_erase_key(handle, "wifi_ssid");
+    esp_err_t erase_err = LIFECYCLE_NVS_OP(erases, nvs_erase_key(handle, "wifi_ssid"));
     if (erase_err != ESP_OK && erase_err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to erase wifi_ssid: %s", esp_err_to_name(erase_err));
     }
 
-    erase_err = nvs_erase_key(handle, "wifi_password");
+    erase_err = LIFECYCLE_NVS_OP(erases, nvs_erase_key(handle, "wifi_password"));
     if (erase_err != ESP_OK && erase_err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to erase wifi_password: %s", esp_err_to_name(erase_err));
     }
 
-    err = nvs_commit(handle);
-    if (err != ESP_OK) {
-        ESP_LOGW(LIFECYCLE_TAG, "Failed to commit Wi-Fi credential erase: %s", esp_err_to_name(err));
-    }
-
-    nvs_close(handle);
-}
-
-static void erase_nvs_partition(void) {
-    lifecycle_log_step("erase_nvs_partition");
-
-    esp_err_t err = nvs_flash_deinit();
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_INITIALIZED) {
-        ESP_LOGW(LIFECYCLE_TAG, "nvs_flash_deinit failed: %s", esp_err_to_name(err));
-    }
-
-    s_nvs_initialized = false;
-
-    err = nvs_flash_erase();
-    if (err != ESP_OK) {
-        ESP_LOGE(LIFECYCLE_TAG, "nvs_flash_erase failed: %s", esp_err_to_name(err));
-    }
+    // Committed together with the other namespaces by the caller.
+    lifecycle_nvs_mark_dirty("wifi_cfg");
 }
 
 static void clear_nvs_namespace(const char *namespace, const char *description) {
@@ -952,23 +2983,18 @@ static void clear_nvs_namespace(const char *namespace, const char *description)
     }
 
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(namespace, NVS_READWRITE, &handle);
+    esp_err_t err = lifecycle_nvs_session(namespace, &handle);
     if (err != ESP_OK) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to open namespace '%s' for clearing: %s", namespace, esp_err_to_name(err));
         return;
     }
 
-    err = nvs_erase_all(handle);
+    err = LIFECYCLE_NVS_OP(erases, nvs_erase_all(handle));
     if (err != ESP_OK) {
         ESP_LOGW(LIFECYCLE_TAG, "Failed to erase namespace '%s': %s", namespace, esp_err_to_name(err));
     } else {
-        err = nvs_commit(handle);
-        if (err != ESP_OK) {
-            ESP_LOGW(LIFECYCLE_TAG, "Failed to commit erase of namespace '%s': %s", namespace, esp_err_to_name(err));
-        }
+        lifecycle_nvs_mark_dirty(namespace);
     }
-
-    nvs_close(handle);
 }
 
 static void clear_lcm_namespace(void) {
@@ -979,6 +3005,8 @@ static void clear_fwcfg_namespace(void) {
     clear_nvs_namespace("fwcfg", "firmware configuration");
 }
 
+#endif
+
 static void erase_otadata_partition(void) {
     const esp_partition_t *otadata = esp_partition_find_first(
             ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, NULL);
@@ -990,69 +3018,47 @@ static void erase_otadata_partition(void) {
     ESP_LOGI(LIFECYCLE_TAG,
             "Erasing OTA data partition '%s' at offset 0x%08" PRIx32 " (size=%" PRIu32 ")",
             otadata->label, otadata->address, (uint32_t)otadata->size);
-    esp_err_t err = esp_partition_erase_range(otadata, 0, otadata->size);
+    esp_err_t err = LIFECYCLE_PARTITION_ERASE(otadata, 0, otadata->size);
     if (err != ESP_OK) {
         ESP_LOGE(LIFECYCLE_TAG, "Failed to erase OTA data partition: %s", esp_err_to_name(err));
     }
 }
 
-static bool erase_ota_partition_by_label(const char *label) {
-    if (label == NULL) {
-        return false;
-    }
+// Walk the app partitions once and invalidate every OTA slot. In fast mode only
+// the first sector is erased: it holds the image header, so the bootloader and
+// esp_ota_ops treat the slot as empty without erasing megabytes of flash.
+static void erase_ota_app_partitions(void) {
+    ESP_LOGI(LIFECYCLE_TAG, "Erasing OTA application partitions");
 
-    bool erased = false;
+    bool any_erased = false;
 
     esp_partition_iterator_t it = esp_partition_find(
             ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
 
     while (it != NULL) {
         const esp_partition_t *part = esp_partition_get(it);
-        esp_partition_iterator_t next = esp_partition_next(it);
-
-        if (part != NULL && strncmp(part->label, label, sizeof(part->label)) == 0) {
-            if (part->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MIN &&
-                    part->subtype <= ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
-                ESP_LOGI(LIFECYCLE_TAG,
-                        "Erasing OTA partition '%s' at offset 0x%08" PRIx32 " (size=%" PRIu32 ")",
-                        part->label, part->address, (uint32_t)part->size);
-                esp_err_t err = esp_partition_erase_range(part, 0, part->size);
-                if (err != ESP_OK) {
-                    ESP_LOGE(LIFECYCLE_TAG, "Failed to erase partition '%s': %s",
-                            part->label, esp_err_to_name(err));
-                } else {
-                    erased = true;
-                }
+
+        if (part != NULL &&
+                part->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MIN &&
+                part->subtype <= ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
+#if CONFIG_LCM_FAST_FACTORY_RESET
+            size_t erase_len = part->erase_size;
+#else
+            size_t erase_len = part->size;
+#endif
+            ESP_LOGI(LIFECYCLE_TAG,
+                    "Erasing OTA partition '%s' at offset 0x%08" PRIx32 " (%" PRIu32 " of %" PRIu32 " bytes)",
+                    part->label, part->address, (uint32_t)erase_len, (uint32_t)part->size);
+            esp_err_t err = LIFECYCLE_PARTITION_ERASE(part, 0, erase_len);
+            if (err != ESP_OK) {
+                ESP_LOGE(LIFECYCLE_TAG, "Failed to erase partition '%s': %s",
+                        part->label, esp_err_to_name(err));
             } else {
-                ESP_LOGW(LIFECYCLE_TAG,
-                        "Partition '%s' found but subtype %d is not an OTA application",
-                        part->label, part->subtype);
+                any_erased = true;
             }
         }
 
-        esp_partition_iterator_release(it);
-        it = next;
-    }
-
-    return erased;
-}
-
-static void erase_ota_app_partitions(void) {
-    ESP_LOGI(LIFECYCLE_TAG, "Erasing OTA application partitions");
-
-    const char *labels[] = {
-        "ota_1",
-        "ota_2",
-        "ota_0",
-    };
-
-    bool any_erased = false;
-    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); ++i) {
-        bool erased = erase_ota_partition_by_label(labels[i]);
-        if (!erased) {
-            ESP_LOGW(LIFECYCLE_TAG, "OTA partition '%s' not found or already empty", labels[i]);
-        }
-        any_erased |= erased;
+        it = esp_partition_next(it);
     }
 
     if (!any_erased) {
@@ -1063,6 +3069,9 @@ static void erase_ota_app_partitions(void) {
 void lifecycle_factory_reset_and_reboot(void) {
     ESP_LOGI(LIFECYCLE_TAG, "Performing factory reset (HomeKit + Wi-Fi)");
 
+    lifecycle_io_scope_t io;
+    lifecycle_io_begin(&io);
+
     lifecycle_reset_restart_counter();
 
     bool factory_boot_selected = false;
@@ -1083,11 +3092,12 @@ void lifecycle_factory_reset_and_reboot(void) {
         }
     }
 
-    lifecycle_log_step("reset_homekit_store");
-    homekit_server_reset();
-
-    lifecycle_perform_common_shutdown(false);
+    // Pairings are removed only after the sessions are drained
+    lifecycle_perform_common_shutdown(true);
 
+#if !CONFIG_LCM_FAST_FACTORY_RESET
+    // The whole NVS partition is erased below; fast mode skips the per-key
+    // erases that would only be wiped again.
     lifecycle_log_step("erase_wifi_credentials");
     erase_wifi_credentials();
 
@@ -1097,6 +3107,13 @@ void lifecycle_factory_reset_and_reboot(void) {
     lifecycle_log_step("clear_lcm_state");
     clear_lcm_namespace();
 
+    lifecycle_log_step("commit_nvs");
+    esp_err_t commit_err = lifecycle_nvs_commit(NULL);
+    if (commit_err != ESP_OK) {
+        ESP_LOGW(LIFECYCLE_TAG, "Failed to commit NVS erase: %s", esp_err_to_name(commit_err));
+    }
+#endif
+
     lifecycle_log_step("erase_otadata");
     erase_otadata_partition();
 
@@ -1111,8 +3128,7 @@ void lifecycle_factory_reset_and_reboot(void) {
 
     erase_nvs_partition();
 
-    lifecycle_log_step("delay_before_reset");
-    vTaskDelay(pdMS_TO_TICKS(100));
+    lifecycle_io_end(LIFECYCLE_IO_FACTORY_RESET, &io);
 
     lifecycle_log_step("reboot");
     if (factory_boot_selected) {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <sdkconfig.h>
 
 #include <esp_err.h>
@@ -26,6 +29,33 @@
 
 #define API_OTA_TRIGGER HOMEKIT_CHARACTERISTIC_(CUSTOM_OTA_TRIGGER, false)
 
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_BOOT_TIMELINE HOMEKIT_CUSTOM_UUID("F0000002")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_BOOT_TIMELINE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_BOOT_TIMELINE, \
+    .description = "BootTimeline", \
+    .format = homekit_format_string, \
+    .permissions = homekit_permissions_paired_read, \
+    .max_len = 256, \
+    .value = HOMEKIT_STRING_(_value), \
+    ##__VA_ARGS__
+
+#define API_BOOT_TIMELINE HOMEKIT_CHARACTERISTIC_(CUSTOM_BOOT_TIMELINE, "", \
+    .getter_ex = lifecycle_boot_timeline_get)
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_OTA_PENDING HOMEKIT_CUSTOM_UUID("F0000005")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_OTA_PENDING(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_OTA_PENDING, \
+    .description = "UpdatePending", \
+    .format = homekit_format_uint32, \
+    .unit = homekit_unit_seconds, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_notify, \
+    .value = HOMEKIT_UINT32_(_value), \
+    ##__VA_ARGS__
+
+#define API_OTA_PENDING HOMEKIT_CHARACTERISTIC_(CUSTOM_OTA_PENDING, 0, \
+    .getter_ex = lifecycle_ota_pending_get)
+
 #ifndef LIFECYCLE_DEFAULT_FW_VERSION
 #ifdef CONFIG_APP_PROJECT_VER
 #define LIFECYCLE_DEFAULT_FW_VERSION CONFIG_APP_PROJECT_VER
@@ -51,6 +81,38 @@ typedef enum {
 
 void lifecycle_log_post_reset_state(const char *log_tag);
 
+// Boot timeline milestones. The values are positions in the formatted
+// timeline (and in the previous boot's copy in RTC memory), so they keep their
+// original order. Since Wi-Fi starts first, a normal boot reaches them as
+// APP_MAIN, NVS_INIT, GPIO_INIT, WIFI_START, POST_RESET_STATE,
+// CONFIGURE_HOMEKIT, BUTTON_CREATE, then STA_CONNECTED, GOT_IP,
+// HOMEKIT_SERVER_INIT and FIRST_CLIENT_SESSION.
+typedef enum {
+    LIFECYCLE_BOOT_APP_MAIN = 0,
+    LIFECYCLE_BOOT_NVS_INIT,
+    LIFECYCLE_BOOT_POST_RESET_STATE,
+    LIFECYCLE_BOOT_CONFIGURE_HOMEKIT,
+    LIFECYCLE_BOOT_GPIO_INIT,
+    LIFECYCLE_BOOT_BUTTON_CREATE,
+    LIFECYCLE_BOOT_WIFI_START,
+    LIFECYCLE_BOOT_STA_CONNECTED,
+    LIFECYCLE_BOOT_GOT_IP,
+    LIFECYCLE_BOOT_HOMEKIT_SERVER_INIT,
+    LIFECYCLE_BOOT_FIRST_CLIENT_SESSION,
+    LIFECYCLE_BOOT_MILESTONE_COUNT,
+} lifecycle_boot_milestone_t;
+
+// Record an esp_timer_get_time() stamp for 'milestone'. Only the first stamp
+// per boot is kept. The previous boot's timeline is retained in RTC memory.
+void lifecycle_boot_mark(lifecycle_boot_milestone_t milestone);
+
+// Stamp in microseconds since boot, 0 when not (yet) reached. 'previous'
+// selects the timeline of the boot before this one.
+uint32_t lifecycle_boot_get_stamp(lifecycle_boot_milestone_t milestone, bool previous);
+
+// Getter for API_BOOT_TIMELINE: "cur=<ms>,...;prev=<ms>,..." ('-' = not reached).
+homekit_value_t lifecycle_boot_timeline_get(const homekit_characteristic_t *characteristic);
+
 // Initialiseer NVS en voer automatische herstelactie uit wanneer er geen ruimte is of versie verandert.
 esp_err_t lifecycle_nvs_init(void);
 
@@ -59,6 +121,28 @@ void lifecycle_request_update_and_reboot(void);
 void lifecycle_reset_homekit_and_reboot(void);
 void lifecycle_factory_reset_and_reboot(void);
 
+// Doorgeven vanuit de on_event hook van de HomeKit server: de shutdown wacht
+// op HOMEKIT_EVENT_CLIENT_DISCONNECTED in plaats van een vaste vertraging.
+void lifecycle_homekit_event(homekit_event_t event);
+
+typedef struct {
+    uint32_t budget;          // toegestane sessies (0 = geen limiet)
+    uint32_t sessions;
+    uint32_t peak_sessions;
+} lifecycle_hap_client_stats_t;
+
+// Bepaal vlak voor homekit_server_init uit de vrije heap hoeveel HAP sessies
+// passen (CONFIG_LCM_HAP_ADAPTIVE_CLIENTS), begrensd door 'max_clients'. Geef
+// het resultaat door als max_clients in homekit_server_config_t: de server
+// sluit een verbinding boven dat aantal direct na de accept, vóór pair-verify
+// zijn crypto buffers alloceert.
+uint32_t lifecycle_hap_configure_client_budget(uint32_t max_clients);
+void lifecycle_get_hap_client_stats(lifecycle_hap_client_stats_t *out_stats);
+
+// Optionele (weak) hook van de applicatie, aangeroepen zodra een update wordt
+// aangevraagd, bijvoorbeeld om een OTA indicatie te tonen.
+void lifecycle_update_started(void);
+
 // Koppel de firmware versie karakteristiek aan de opgeslagen versie in NVS.
 esp_err_t lifecycle_init_firmware_revision(homekit_characteristic_t *revision,
                                            const char *fallback_version);
@@ -68,9 +152,25 @@ esp_err_t lifecycle_init_firmware_revision(homekit_characteristic_t *revision,
 const char *lifecycle_get_firmware_revision_string(void);
 
 // Verwerk de custom HomeKit OTA trigger. Gebruik dit als setter van de characteristic.
+// 'true' plant de update in het rollout venster (zie lifecycle_schedule_update),
+// 'false' annuleert een geplande update.
 void lifecycle_handle_ota_trigger(homekit_characteristic_t *characteristic,
                                   const homekit_value_t value);
 
+// Plan een update na een vaste, van het MAC adres afgeleide vertraging:
+// slot (CONFIG_LCM_OTA_MAX_CONCURRENCY_PCT verdeelt de vloot over slots van
+// CONFIG_LCM_OTA_SLOT_S) plus jitter tot CONFIG_LCM_OTA_JITTER_S. Zonder
+// vertraging start de update direct. Een al geplande update blijft staan.
+void lifecycle_schedule_update(void);
+void lifecycle_cancel_scheduled_update(void);
+
+// Seconden tot de geplande update, 0 als er niets gepland is.
+uint32_t lifecycle_ota_pending_seconds(void);
+
+// Koppel de "pending update" characteristic (API_OTA_PENDING) voor notificaties.
+void lifecycle_configure_ota_pending(homekit_characteristic_t *pending);
+homekit_value_t lifecycle_ota_pending_get(const homekit_characteristic_t *characteristic);
+
 // Initialise the HomeKit-facing lifecycle characteristics using defaults and
 // stored NVS values. Logs using the provided tag (falls back to the lifecycle
 // tag when NULL) and returns the status from the firmware revision
@@ -86,6 +186,88 @@ esp_err_t wifi_start(void (*on_ready)(void));
 // Optioneel: stop WiFi netjes.
 esp_err_t wifi_stop(void);
 
+// Naam van het gekozen power-save profiel ("performance", "balanced", "eco").
+const char *lifecycle_power_profile_name(void);
+
+// Houd 'gpio' als wakeup bron tijdens automatic light sleep (alleen eco profiel;
+// anders een no-op).
+esp_err_t lifecycle_power_enable_gpio_wakeup(int gpio, bool active_low);
+
+typedef enum {
+    LIFECYCLE_WIFI_CONNECT_PATH_NONE = 0,
+    LIFECYCLE_WIFI_CONNECT_PATH_FULL_SCAN = 1,
+    LIFECYCLE_WIFI_CONNECT_PATH_FAST = 2,
+    LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK = 3,
+} lifecycle_wifi_connect_path_t;
+
+typedef struct {
+    lifecycle_wifi_connect_path_t last_path;
+    uint32_t fast_boots;
+    uint32_t full_scan_boots;
+    uint32_t fallback_boots;
+} lifecycle_wifi_connect_stats_t;
+
+// Which association path (directed fast reconnect, fallback or full scan) the
+// last boots took. Counters live in RTC memory and survive soft resets.
+void lifecycle_get_wifi_connect_stats(lifecycle_wifi_connect_stats_t *out_stats);
+
+#define LIFECYCLE_WIFI_DISCONNECT_REASON_SLOTS 12
+
+typedef struct {
+    uint8_t reason;          // wifi_err_reason_t
+    uint32_t count;
+} lifecycle_wifi_disconnect_reason_count_t;
+
+typedef struct {
+    uint32_t disconnects;
+    uint32_t reconnects;
+    uint32_t current_attempt;        // backoff step of the pending reconnect (0 when connected)
+    uint32_t last_reason;
+    uint64_t last_reconnect_us;      // first disconnect -> got IP
+    uint64_t max_reconnect_us;
+    uint64_t total_reconnect_us;
+    uint32_t other_reasons;          // reasons that did not fit in 'reasons'
+    lifecycle_wifi_disconnect_reason_count_t reasons[LIFECYCLE_WIFI_DISCONNECT_REASON_SLOTS];
+} lifecycle_wifi_reconnect_stats_t;
+
+// Snapshot of the reconnect engine: per-reason disconnect counters and
+// time-to-reconnect figures since boot.
+void lifecycle_get_wifi_reconnect_stats(lifecycle_wifi_reconnect_stats_t *out_stats);
+
+typedef struct {
+    uint32_t opens;
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t commits;
+} lifecycle_nvs_stats_t;
+
+// NVS operations issued by the lifecycle layer since boot. Handles are kept
+// open per namespace, so 'opens' only grows on first use of a namespace.
+void lifecycle_get_nvs_stats(lifecycle_nvs_stats_t *out_stats);
+
+typedef enum {
+    LIFECYCLE_IO_POST_RESET_STATE = 0,
+    LIFECYCLE_IO_FIRMWARE_REVISION,
+    LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT,
+    LIFECYCLE_IO_UPDATE_REQUEST,
+    LIFECYCLE_IO_FACTORY_RESET,
+    LIFECYCLE_IO_OP_COUNT,
+} lifecycle_io_op_t;
+
+typedef struct {
+    uint32_t runs;
+    lifecycle_nvs_stats_t nvs;       // NVS operations of the last run
+    uint32_t partition_erases;       // raw esp_partition / nvs_flash erases of the last run
+    uint32_t partition_erase_bytes;
+    uint64_t last_us;                // wall time of the last run
+    uint64_t max_us;
+} lifecycle_io_cost_t;
+
+// Flash I/O cost and wall time of a lifecycle operation, measured on every
+// run. Each run is also logged as "[lifecycle] io <op>: ...".
+void lifecycle_get_io_cost(lifecycle_io_op_t op, lifecycle_io_cost_t *out_cost);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,439 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <nvs.h>
+#include <mbedtls/md.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "espnow-group.h"
+
+#ifndef CONFIG_ESP_ESPNOW_GROUP_ID
+#define CONFIG_ESP_ESPNOW_GROUP_ID 1
+#endif
+#ifndef CONFIG_ESP_ESPNOW_GROUP_KEY
+#define CONFIG_ESP_ESPNOW_GROUP_KEY ""
+#endif
+
+static const char *ESPNOW_TAG = "ESPNOW_GROUP";
+
+// ESP-NOW versleutelt alleen unicast peers; broadcasts gaan in de klare lucht.
+// Daarom authenticeren we elk frame zelf met een HMAC-SHA256 over de
+// pre-shared group key, en blokkeren we replays met (epoch, counter): de epoch
+// staat in NVS en gaat elke boot één omhoog, de counter per verzonden frame.
+// De MAC van de afzender zit in de geauthenticeerde bytes en moet gelijk zijn
+// aan het bronadres, zodat een opgenomen frame niet onder een ander adres
+// opnieuw als "nieuwe afzender" binnenkomt.
+#define ESPNOW_GROUP_MAGIC     0x5350U   // "SP"
+#define ESPNOW_GROUP_VERSION   2         // 2: afzender MAC in het frame
+#define ESPNOW_GROUP_CMD_SET   1
+#define ESPNOW_GROUP_KEY_LEN   16
+#define ESPNOW_GROUP_TAG_LEN   16        // afgekapte HMAC
+#define ESPNOW_GROUP_PEERS     16        // cache van de in NVS bewaarde sequences
+#define ESPNOW_GROUP_REPEATS   2         // broadcast heeft geen ACK; kopieën hebben dezelfde seq
+// Counters die per NVS write voor een afzender vooruit gereserveerd worden.
+// Na een reboot van de ontvanger vallen er hoogstens zoveel frames van een
+// afzender weg (tot die zelf herstart); daarvoor één flash write per zoveel.
+#define ESPNOW_GROUP_SEQ_RESERVE 8U
+
+// Verwerking buiten de Wi-Fi task: HMAC en de NVS writes van de sequences
+#define ESPNOW_GROUP_TASK_PRIORITY  (configMAX_PRIORITIES - 5)
+#define ESPNOW_GROUP_TASK_STACK     4096
+#define ESPNOW_GROUP_QUEUE_LENGTH   4
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t group;
+    uint8_t cmd;
+    uint8_t state;
+    uint8_t sender[ESP_NOW_ETH_ALEN];
+    uint32_t epoch;
+    uint32_t counter;
+    uint8_t tag[ESPNOW_GROUP_TAG_LEN];
+} espnow_group_frame_t;
+
+typedef struct {
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    espnow_group_frame_t frame;
+} espnow_group_msg_t;
+
+typedef struct {
+    uint32_t epoch;
+    uint32_t counter;
+} espnow_group_seq_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool used;
+    espnow_group_seq_t seq;       // laatst toegepast
+    espnow_group_seq_t reserved;  // zo in NVS: alles t/m deze is na een reboot oud
+} espnow_group_peer_t;
+
+static const uint8_t k_broadcast[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const char *k_nvs_namespace = "espnow_grp";
+static const char *k_nvs_epoch_key = "epoch";
+
+static uint8_t s_key[ESPNOW_GROUP_KEY_LEN];
+static uint8_t s_own_mac[ESP_NOW_ETH_ALEN];
+static nvs_handle_t s_nvs = 0;
+static QueueHandle_t s_queue = NULL;
+static espnow_group_handler_t s_handler = NULL;
+static bool s_ready = false;
+static uint32_t s_epoch = 0;
+static uint32_t s_counter = 0;
+static portMUX_TYPE s_send_lock = portMUX_INITIALIZER_UNLOCKED;
+static espnow_group_peer_t s_peers[ESPNOW_GROUP_PEERS];
+static unsigned s_peer_next = 0;
+
+static atomic_uint s_sent = 0;
+static atomic_uint s_received = 0;
+static atomic_uint s_bad_auth = 0;
+static atomic_uint s_replayed = 0;
+static atomic_uint s_applied = 0;
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parse_key(const char *hex, uint8_t *out) {
+    if (strlen(hex) != ESPNOW_GROUP_KEY_LEN * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < ESPNOW_GROUP_KEY_LEN; ++i) {
+        int hi = hex_nibble(hex[2 * i]);
+        int lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+// HMAC over alles vóór de tag
+static bool frame_tag(const espnow_group_frame_t *frame, uint8_t *out) {
+    uint8_t digest[32];
+    const mbedtls_md_info_t *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    if (md == NULL || mbedtls_md_hmac(md, s_key, sizeof(s_key), (const uint8_t *)frame,
+                                      offsetof(espnow_group_frame_t, tag), digest) != 0) {
+        return false;
+    }
+    memcpy(out, digest, ESPNOW_GROUP_TAG_LEN);
+    return true;
+}
+
+static bool tag_equal(const uint8_t *a, const uint8_t *b) {
+    // Constante tijd vergelijking
+    uint8_t diff = 0;
+    for (size_t i = 0; i < ESPNOW_GROUP_TAG_LEN; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+static bool sequence_newer(const espnow_group_seq_t *last, uint32_t epoch, uint32_t counter) {
+    return epoch > last->epoch || (epoch == last->epoch && counter > last->counter);
+}
+
+// NVS key per afzender: "p" + MAC in hex
+static void peer_nvs_key(const uint8_t *mac, char *out, size_t out_len) {
+    snprintf(out, out_len, "p%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static espnow_group_peer_t *peer_lookup(const uint8_t *mac) {
+    for (size_t i = 0; i < ESPNOW_GROUP_PEERS; ++i) {
+        espnow_group_peer_t *peer = &s_peers[i];
+        if (peer->used && memcmp(peer->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return peer;
+        }
+    }
+
+    // Niet in de cache: gereserveerde sequence uit NVS, ook na een reboot of
+    // nadat het slot door andere afzenders is overschreven. Onbekend in NVS =
+    // nooit eerder een frame van deze afzender toegepast.
+    espnow_group_peer_t *peer = &s_peers[s_peer_next];
+    s_peer_next = (s_peer_next + 1U) % ESPNOW_GROUP_PEERS;
+    memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+    peer->used = true;
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    peer_nvs_key(mac, key, sizeof(key));
+    size_t len = sizeof(peer->reserved);
+    if (nvs_get_blob(s_nvs, key, &peer->reserved, &len) != ESP_OK || len != sizeof(peer->reserved)) {
+        memset(&peer->reserved, 0, sizeof(peer->reserved));
+    }
+    peer->seq = peer->reserved;
+    return peer;
+}
+
+// Accepteer alleen een (epoch, counter) die nieuwer is dan het laatst
+// toegepaste frame van deze afzender. Alleen de group task komt hier, geen
+// lock nodig.
+static espnow_group_peer_t *sequence_accept(const uint8_t *mac, uint32_t epoch, uint32_t counter) {
+    espnow_group_peer_t *peer = peer_lookup(mac);
+    if (!sequence_newer(&peer->seq, epoch, counter)) {
+        return NULL;
+    }
+
+    peer->seq.epoch = epoch;
+    peer->seq.counter = counter;
+    return peer;
+}
+
+// Na het schakelen: is de reservering op, dan de volgende
+// ESPNOW_GROUP_SEQ_RESERVE counters in NVS vastleggen. Een reboot opent het
+// venster zo niet, en niet elk frame kost een flash write.
+static void sequence_persist(espnow_group_peer_t *peer) {
+    if (sequence_newer(&peer->seq, peer->reserved.epoch, peer->reserved.counter)) {
+        return;
+    }
+
+    espnow_group_seq_t reserved = {
+        .epoch = peer->seq.epoch,
+        .counter = (peer->seq.counter > UINT32_MAX - ESPNOW_GROUP_SEQ_RESERVE)
+                ? UINT32_MAX : peer->seq.counter + ESPNOW_GROUP_SEQ_RESERVE,
+    };
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    peer_nvs_key(peer->mac, key, sizeof(key));
+    esp_err_t err = nvs_set_blob(s_nvs, key, &reserved, sizeof(reserved));
+    if (err == ESP_OK) {
+        err = nvs_commit(s_nvs);
+    }
+    if (err != ESP_OK) {
+        // De RAM cache blokkeert replays tot de volgende boot; volgend frame opnieuw
+        ESP_LOGW(ESPNOW_TAG, "Failed to store sequence of " MACSTR ": %s", MAC2STR(peer->mac), esp_err_to_name(err));
+        return;
+    }
+    peer->reserved = reserved;
+}
+
+static void espnow_group_process(const espnow_group_msg_t *msg) {
+    const espnow_group_frame_t *frame = &msg->frame;
+    uint8_t expected[ESPNOW_GROUP_TAG_LEN];
+
+    atomic_fetch_add(&s_received, 1U);
+
+    if (frame->group != CONFIG_ESP_ESPNOW_GROUP_ID || frame->cmd != ESPNOW_GROUP_CMD_SET ||
+        memcmp(frame->sender, msg->src, ESP_NOW_ETH_ALEN) != 0 ||
+        !frame_tag(frame, expected) || !tag_equal(expected, frame->tag)) {
+        atomic_fetch_add(&s_bad_auth, 1U);
+        return;
+    }
+    espnow_group_peer_t *peer = sequence_accept(frame->sender, frame->epoch, frame->counter);
+    if (peer == NULL) {
+        // Replay of een herhaalde kopie van een al toegepast frame
+        atomic_fetch_add(&s_replayed, 1U);
+        return;
+    }
+
+    atomic_fetch_add(&s_applied, 1U);
+    if (s_handler != NULL) {
+        s_handler(frame->state != 0U);
+    }
+    sequence_persist(peer);
+}
+
+static void espnow_group_task(void *arg) {
+    (void)arg;
+    espnow_group_msg_t msg;
+
+    for (;;) {
+        if (xQueueReceive(s_queue, &msg, portMAX_DELAY) == pdTRUE) {
+            espnow_group_process(&msg);
+        }
+    }
+}
+
+// Wi-Fi task: alleen filteren en doorgeven
+static void espnow_group_recv(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+    espnow_group_msg_t msg;
+
+    if (info == NULL || data == NULL || len != (int)sizeof(msg.frame)) {
+        return;
+    }
+    memcpy(&msg.frame, data, sizeof(msg.frame));
+    if (msg.frame.magic != ESPNOW_GROUP_MAGIC || msg.frame.version != ESPNOW_GROUP_VERSION) {
+        // Ander ESP-NOW verkeer, niet voor ons
+        return;
+    }
+    memcpy(msg.src, info->src_addr, ESP_NOW_ETH_ALEN);
+    // Vol: de afzender stuurt elk frame twee keer
+    xQueueSend(s_queue, &msg, 0);
+}
+
+// De handle blijft open: de group task schrijft er de peer sequences in
+static esp_err_t load_epoch(void) {
+    esp_err_t err = nvs_open(k_nvs_namespace, NVS_READWRITE, &s_nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint32_t epoch = 0;
+    err = nvs_get_u32(s_nvs, k_nvs_epoch_key, &epoch);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+        // Elke boot een nieuwe epoch: counters van een vorige boot zijn dan ouder
+        s_epoch = epoch + 1U;
+        err = nvs_set_u32(s_nvs, k_nvs_epoch_key, s_epoch);
+        if (err == ESP_OK) {
+            err = nvs_commit(s_nvs);
+        }
+    }
+    if (err != ESP_OK) {
+        nvs_close(s_nvs);
+        s_nvs = 0;
+    }
+    return err;
+}
+
+esp_err_t espnow_group_init(espnow_group_handler_t handler) {
+    if (s_ready) {
+        return ESP_OK;
+    }
+    if (!parse_key(CONFIG_ESP_ESPNOW_GROUP_KEY, s_key)) {
+        ESP_LOGE(ESPNOW_TAG, "Group key must be %d hex characters; ESP-NOW group disabled",
+                 ESPNOW_GROUP_KEY_LEN * 2);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // ESP-NOW zendt vanaf de STA interface
+    esp_err_t err = esp_wifi_get_mac(WIFI_IF_STA, s_own_mac);
+    if (err != ESP_OK) {
+        ESP_LOGE(ESPNOW_TAG, "Failed to read STA MAC: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Epoch en group task maar één keer, ook als een eerdere init later faalde
+    if (s_nvs == 0) {
+        err = load_epoch();
+        if (err != ESP_OK) {
+            ESP_LOGE(ESPNOW_TAG, "Failed to update sequence epoch: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    if (s_queue == NULL) {
+        s_queue = xQueueCreate(ESPNOW_GROUP_QUEUE_LENGTH, sizeof(espnow_group_msg_t));
+        if (s_queue == NULL || xTaskCreate(espnow_group_task, "espnow_group", ESPNOW_GROUP_TASK_STACK, NULL,
+                                           ESPNOW_GROUP_TASK_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(ESPNOW_TAG, "Failed to start ESP-NOW group task");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    err = esp_now_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(ESPNOW_TAG, "esp_now_init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Broadcast peer op het kanaal van de STA verbinding (channel 0 = huidig)
+    esp_now_peer_info_t peer = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, k_broadcast, ESP_NOW_ETH_ALEN);
+    err = esp_now_add_peer(&peer);
+    if (err == ESP_OK) {
+        s_handler = handler;
+        err = esp_now_register_recv_cb(espnow_group_recv);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(ESPNOW_TAG, "Failed to set up ESP-NOW group: %s", esp_err_to_name(err));
+        esp_now_deinit();
+        return err;
+    }
+
+    s_ready = true;
+    ESP_LOGI(ESPNOW_TAG, "ESP-NOW group %d active (epoch %" PRIu32 ")", CONFIG_ESP_ESPNOW_GROUP_ID, s_epoch);
+    return ESP_OK;
+}
+
+esp_err_t espnow_group_send(bool on) {
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    espnow_group_frame_t frame = {
+        .magic = ESPNOW_GROUP_MAGIC,
+        .version = ESPNOW_GROUP_VERSION,
+        .group = CONFIG_ESP_ESPNOW_GROUP_ID,
+        .cmd = ESPNOW_GROUP_CMD_SET,
+        .state = on ? 1U : 0U,
+        .epoch = s_epoch,
+    };
+    memcpy(frame.sender, s_own_mac, ESP_NOW_ETH_ALEN);
+    portENTER_CRITICAL(&s_send_lock);
+    frame.counter = ++s_counter;
+    portEXIT_CRITICAL(&s_send_lock);
+
+    if (!frame_tag(&frame, frame.tag)) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < ESPNOW_GROUP_REPEATS; ++i) {
+        esp_err_t send_err = esp_now_send(k_broadcast, (const uint8_t *)&frame, sizeof(frame));
+        if (send_err != ESP_OK) {
+            err = send_err;
+        }
+    }
+    if (err == ESP_OK) {
+        atomic_fetch_add(&s_sent, 1U);
+    } else {
+        ESP_LOGW(ESPNOW_TAG, "Group broadcast failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void espnow_group_get_stats(espnow_group_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+
+    out_stats->sent = atomic_load(&s_sent);
+    out_stats->received = atomic_load(&s_received);
+    out_stats->bad_auth = atomic_load(&s_bad_auth);
+    out_stats->replayed = atomic_load(&s_replayed);
+    out_stats->applied = atomic_load(&s_applied);
+}
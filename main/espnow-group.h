@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Aangeroepen (vanuit de ESP-NOW group task) voor elk geldig group command van een peer
+typedef void (*espnow_group_handler_t)(bool on);
+
+typedef struct {
+    uint32_t sent;
+    uint32_t received;
+    uint32_t bad_auth;      // verkeerde groep, afzender of HMAC
+    uint32_t replayed;      // sequence niet nieuwer dan de laatst toegepaste (ook na een reboot)
+    uint32_t applied;
+} espnow_group_stats_t;
+
+// Start ESP-NOW naast de STA verbinding (na wifi_start()). De group key komt
+// uit CONFIG_ESP_ESPNOW_GROUP_KEY; zonder geldige key blijft de groep uit.
+esp_err_t espnow_group_init(espnow_group_handler_t handler);
+
+// Broadcast de nieuwe state naar alle plugs in de groep. Een absolute state
+// (geen toggle) houdt de groep gelijk, ook als een peer een frame mist.
+esp_err_t espnow_group_send(bool on);
+
+void espnow_group_get_stats(espnow_group_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,198 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_app_desc.h>
+#include <esp_memory_utils.h>
+
+#include "event-trace.h"
+
+#ifndef CONFIG_ESP_EVENT_TRACE_ENTRIES
+#define CONFIG_ESP_EVENT_TRACE_ENTRIES 128
+#endif
+
+#if (CONFIG_ESP_EVENT_TRACE_ENTRIES & (CONFIG_ESP_EVENT_TRACE_ENTRIES - 1)) != 0
+#error "CONFIG_ESP_EVENT_TRACE_ENTRIES must be a power of two"
+#endif
+
+#define EVENT_TRACE_MASK  (CONFIG_ESP_EVENT_TRACE_ENTRIES - 1U)
+#define EVENT_TRACE_MAGIC 0x54524331U   // "TRC1"
+
+static const char *TRACE_TAG = "TRACE";
+
+typedef struct {
+    uint32_t seq;       // als laatste geschreven; 0 = leeg
+    uint32_t ts_us;
+    uint16_t event;
+    uint16_t a;
+    uint32_t b;
+} event_trace_slot_t;
+
+// Overleeft soft resets; na power-on is de inhoud willekeurig (magic mismatch)
+RTC_NOINIT_ATTR static struct {
+    uint32_t magic;
+    uint32_t entries;
+    uint32_t image_id;          // app waarvan de string pointers zijn
+    uint32_t prev_image_id;
+    uint32_t boot_seq;          // eerste seq van deze boot
+    uint32_t prev_boot_seq;     // eerste seq van de vorige boot
+    event_trace_slot_t slots[CONFIG_ESP_EVENT_TRACE_ENTRIES];
+} s_trace;
+
+// Teller in gewoon DRAM: atomics op RTC geheugen zijn niet op elke chip gegarandeerd
+static atomic_uint s_next_seq = 0;
+static bool s_ready = false;
+static uint32_t s_read_cursor = 0;
+static char s_trace_str[256];
+
+static uint32_t event_trace_image_id(void) {
+    const esp_app_desc_t *desc = esp_app_get_description();
+    uint32_t id = 0;
+    memcpy(&id, desc->app_elf_sha256, sizeof(id));
+    return id;
+}
+
+void event_trace_init(void) {
+    if (s_ready) {
+        return;
+    }
+
+    uint32_t image_id = event_trace_image_id();
+    uint32_t next = 1;
+    if (s_trace.magic != EVENT_TRACE_MAGIC || s_trace.entries != CONFIG_ESP_EVENT_TRACE_ENTRIES) {
+        memset(&s_trace, 0, sizeof(s_trace));
+        s_trace.magic = EVENT_TRACE_MAGIC;
+        s_trace.entries = CONFIG_ESP_EVENT_TRACE_ENTRIES;
+        s_trace.image_id = image_id;
+    } else {
+        // Verder tellen na het nieuwste record van de vorige boot
+        for (size_t i = 0; i < CONFIG_ESP_EVENT_TRACE_ENTRIES; ++i) {
+            if (s_trace.slots[i].seq >= next) {
+                next = s_trace.slots[i].seq + 1U;
+            }
+        }
+    }
+
+    s_trace.prev_image_id = s_trace.image_id;
+    s_trace.image_id = image_id;
+    s_trace.prev_boot_seq = s_trace.boot_seq;
+    s_trace.boot_seq = next;
+    atomic_store(&s_next_seq, next);
+    s_ready = true;
+
+    EVENT_TRACE(EVENT_TRACE_BOOT, esp_reset_reason(), 0);
+}
+
+void IRAM_ATTR event_trace_record(event_trace_event_t event, uint16_t a, uint32_t b) {
+    if (!s_ready) {
+        return;
+    }
+
+    uint32_t seq = atomic_fetch_add_explicit(&s_next_seq, 1U, memory_order_relaxed);
+    event_trace_slot_t *slot = &s_trace.slots[seq & EVENT_TRACE_MASK];
+    slot->seq = 0;
+    slot->ts_us = (uint32_t)esp_timer_get_time();
+    slot->event = (uint16_t)event;
+    slot->a = a;
+    slot->b = b;
+    atomic_signal_fence(memory_order_release);
+    slot->seq = seq;
+}
+
+static const event_trace_slot_t *event_trace_find(uint32_t seq) {
+    const event_trace_slot_t *slot = &s_trace.slots[seq & EVENT_TRACE_MASK];
+    return (slot->seq == seq) ? slot : NULL;
+}
+
+void event_trace_dump_previous(const char *log_tag) {
+    const char *tag = (log_tag != NULL) ? log_tag : TRACE_TAG;
+    if (!s_ready || s_trace.prev_boot_seq == 0) {
+        return;
+    }
+
+    uint32_t end = s_trace.boot_seq;
+    uint32_t start = s_trace.prev_boot_seq;
+    if (end - start > CONFIG_ESP_EVENT_TRACE_ENTRIES) {
+        start = end - CONFIG_ESP_EVENT_TRACE_ENTRIES;
+    }
+    // Step pointers zijn alleen geldig in hetzelfde image
+    bool same_image = (s_trace.prev_image_id == s_trace.image_id);
+
+    ESP_LOGI(tag, "[trace] previous boot: %" PRIu32 " events", end - start);
+    for (uint32_t seq = start; seq != end; ++seq) {
+        const event_trace_slot_t *slot = event_trace_find(seq);
+        if (slot == NULL) {
+            continue;
+        }
+        const char *step = (const char *)(uintptr_t)slot->b;
+        if (slot->event == EVENT_TRACE_LIFECYCLE_STEP && same_image && esp_ptr_in_drom(step)) {
+            ESP_LOGI(tag, "[trace] %" PRIu32 " %10" PRIu32 " step %s", seq, slot->ts_us, step);
+        } else {
+            ESP_LOGI(tag, "[trace] %" PRIu32 " %10" PRIu32 " ev=%u a=%u b=0x%08" PRIx32,
+                     seq, slot->ts_us, slot->event, slot->a, slot->b);
+        }
+    }
+}
+
+homekit_value_t event_trace_get(const homekit_characteristic_t *characteristic) {
+    (void)characteristic;
+    uint32_t end = atomic_load(&s_next_seq);
+    uint32_t oldest = (end > CONFIG_ESP_EVENT_TRACE_ENTRIES) ? end - CONFIG_ESP_EVENT_TRACE_ENTRIES : 1U;
+
+    if (s_read_cursor < oldest || s_read_cursor >= end) {
+        s_read_cursor = oldest;
+    }
+
+    int used = snprintf(s_trace_str, sizeof(s_trace_str), "%" PRIu32 ":", s_read_cursor);
+    size_t count = 0;
+    while (count < EVENT_TRACE_HK_RECORDS && s_read_cursor < end && used > 0 &&
+           (size_t)used + 25 <= sizeof(s_trace_str)) {
+        const event_trace_slot_t *slot = event_trace_find(s_read_cursor);
+        event_trace_slot_t copy = {0};
+        if (slot != NULL) {
+            copy = *slot;
+        }
+        const uint8_t *p = (const uint8_t *)&copy.ts_us;
+        for (size_t i = 0; i < 12; ++i) {
+            used += snprintf(s_trace_str + used, sizeof(s_trace_str) - used, "%02x", p[i]);
+        }
+        s_read_cursor++;
+        count++;
+    }
+
+    return HOMEKIT_STRING(s_trace_str, .is_static = true);
+}
+
+void event_trace_set(homekit_characteristic_t *characteristic, homekit_value_t value) {
+    (void)characteristic;
+    (void)value;
+    s_read_cursor = 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <sdkconfig.h>
+#include <esp_attr.h>
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "esp32-lcm.h"
+
+// Lezen: "<seq>:<hex>" met tot EVENT_TRACE_HK_RECORDS records vanaf 'seq'; elk
+// record is 12 bytes little endian { u32 ts_us, u16 event, u16 a, u32 b }. Elke
+// read schuift door naar de volgende records; schrijven (elke waarde) begint
+// weer bij het oudste record.
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_EVENT_TRACE HOMEKIT_CUSTOM_UUID("F0000006")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_EVENT_TRACE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_EVENT_TRACE, \
+    .description = "EventTrace", \
+    .format = homekit_format_string, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_paired_write, \
+    .max_len = 256, \
+    .value = HOMEKIT_STRING_(_value), \
+    ##__VA_ARGS__
+
+#define API_EVENT_TRACE HOMEKIT_CHARACTERISTIC_(CUSTOM_EVENT_TRACE, "", \
+    .getter_ex = event_trace_get, \
+    .setter_ex = event_trace_set)
+
+#define EVENT_TRACE_HK_RECORDS 10
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    EVENT_TRACE_BOOT = 1,          // a = esp_reset_reason()
+    EVENT_TRACE_LIFECYCLE_STEP,    // b = pointer naar de step string (rodata)
+    EVENT_TRACE_WIFI,              // a = WIFI_EVENT id, b = reason / channel
+    EVENT_TRACE_GOT_IP,            // b = IPv4 adres
+    EVENT_TRACE_RELAY,             // a = gewijzigde kanalen, b = nieuwe mask | source << 16
+    EVENT_TRACE_BUTTON,            // a = button_event_t
+    EVENT_TRACE_UPDATE,            // a = 0 gepland / 1 gestart / 2 mislukt, b = detail
+    EVENT_TRACE_SHUTDOWN,          // a = shutdown fase, b = duur in us
+    EVENT_TRACE_ROAM,              // a = roam stap, b = RSSI / kanaal
+} event_trace_event_t;
+
+// Zet de ring in RTC_NOINIT geheugen klaar; de inhoud van vóór een soft reset
+// blijft staan. Roep dit als eerste in app_main aan.
+void event_trace_init(void);
+
+// Eén record: een atomic slot claim plus vier stores, geen formatting
+void IRAM_ATTR event_trace_record(event_trace_event_t event, uint16_t a, uint32_t b);
+
+// Log de records van de vorige boot (aangeroepen door lifecycle_log_post_reset_state)
+void event_trace_dump_previous(const char *log_tag);
+
+homekit_value_t event_trace_get(const homekit_characteristic_t *characteristic);
+void event_trace_set(homekit_characteristic_t *characteristic, homekit_value_t value);
+
+#if CONFIG_ESP_EVENT_TRACE
+#define EVENT_TRACE(_event, _a, _b) event_trace_record((_event), (uint16_t)(_a), (uint32_t)(_b))
+#else
+#define EVENT_TRACE(_event, _a, _b) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
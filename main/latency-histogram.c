@@ -0,0 +1,141 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <esp_log.h>
+
+#include "latency-histogram.h"
+
+static const char *LATENCY_TAG = "LATENCY";
+
+typedef struct {
+    atomic_uint count;
+    atomic_uint max_us;
+    atomic_uint buckets[LATENCY_HISTOGRAM_BUCKETS];
+} latency_histogram_t;
+
+static latency_histogram_t s_histograms[LATENCY_HIST_COUNT];
+
+static const char *const k_histogram_names[LATENCY_HIST_COUNT] = {
+    [LATENCY_HIST_HOMEKIT_WRITE] = "hk",
+    [LATENCY_HIST_BUTTON_NOTIFY] = "btn",
+    [LATENCY_HIST_BUTTON_RELAY] = "press",
+};
+
+static char s_histogram_str[256];
+
+// floor(log2(value)), 0 voor 0 en 1
+static inline uint32_t latency_bucket(uint32_t elapsed_us) {
+    uint32_t bucket = (elapsed_us > 1U) ? (31U - (uint32_t)__builtin_clz(elapsed_us)) : 0U;
+    return (bucket < LATENCY_HISTOGRAM_BUCKETS) ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1U;
+}
+
+void IRAM_ATTR latency_histogram_record(latency_histogram_id_t id, uint32_t elapsed_us) {
+    if ((unsigned)id >= LATENCY_HIST_COUNT) {
+        return;
+    }
+
+    latency_histogram_t *hist = &s_histograms[id];
+    atomic_fetch_add_explicit(&hist->buckets[latency_bucket(elapsed_us)], 1U, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1U, memory_order_relaxed);
+
+    unsigned max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+    while (elapsed_us > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max_us, &max, elapsed_us,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void latency_histogram_get_snapshot(latency_histogram_id_t id, latency_histogram_snapshot_t *out_snapshot) {
+    if (out_snapshot == NULL || (unsigned)id >= LATENCY_HIST_COUNT) {
+        return;
+    }
+
+    latency_histogram_t *hist = &s_histograms[id];
+    out_snapshot->count = atomic_load(&hist->count);
+    out_snapshot->max_us = atomic_load(&hist->max_us);
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        out_snapshot->buckets[i] = atomic_load(&hist->buckets[i]);
+    }
+}
+
+void latency_histogram_reset(void) {
+    for (size_t id = 0; id < LATENCY_HIST_COUNT; ++id) {
+        latency_histogram_t *hist = &s_histograms[id];
+        for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+            atomic_store(&hist->buckets[i], 0U);
+        }
+        atomic_store(&hist->count, 0U);
+        atomic_store(&hist->max_us, 0U);
+    }
+    ESP_LOGI(LATENCY_TAG, "Latency histograms reset");
+}
+
+static size_t latency_histogram_format(char *buf, size_t size) {
+    size_t used = 0;
+    buf[0] = '\0';
+
+    for (size_t id = 0; id < LATENCY_HIST_COUNT; ++id) {
+        latency_histogram_snapshot_t snap;
+        latency_histogram_get_snapshot((latency_histogram_id_t)id, &snap);
+
+        int written = snprintf(buf + used, size - used, "%s%s n=%" PRIu32 " max=%" PRIu32,
+                               id > 0 ? ";" : "", k_histogram_names[id], snap.count, snap.max_us);
+        if (written < 0 || (size_t)written >= size - used) {
+            return size - 1;
+        }
+        used += (size_t)written;
+
+        // Alleen gevulde buckets: past ruim binnen max_len
+        char sep = ' ';
+        for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+            if (snap.buckets[i] == 0U) {
+                continue;
+            }
+            written = snprintf(buf + used, size - used, "%c%u:%" PRIu32, sep, (unsigned)i, snap.buckets[i]);
+            if (written < 0 || (size_t)written >= size - used) {
+                return size - 1;
+            }
+            used += (size_t)written;
+            sep = ',';
+        }
+    }
+
+    return used;
+}
+
+homekit_value_t latency_histogram_get(const homekit_characteristic_t *characteristic) {
+    (void)characteristic;
+    latency_histogram_format(s_histogram_str, sizeof(s_histogram_str));
+    return HOMEKIT_STRING(s_histogram_str, .is_static = true);
+}
+
+void latency_histogram_set(homekit_characteristic_t *characteristic, homekit_value_t value) {
+    (void)characteristic;
+    (void)value;
+    latency_histogram_reset();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_attr.h>
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "esp32-lcm.h"
+
+// Lezen: "<hist> n=<count> max=<us> <bucket>:<count>,...;..." waarbij bucket b
+// latencies in [2^b, 2^(b+1)) us telt. Schrijven (elke waarde) reset alles.
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_LATENCY_HISTOGRAMS HOMEKIT_CUSTOM_UUID("F0000004")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_LATENCY_HISTOGRAMS(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_LATENCY_HISTOGRAMS, \
+    .description = "LatencyHistograms", \
+    .format = homekit_format_string, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_paired_write, \
+    .max_len = 256, \
+    .value = HOMEKIT_STRING_(_value), \
+    ##__VA_ARGS__
+
+#define API_LATENCY_HISTOGRAMS HOMEKIT_CHARACTERISTIC_(CUSTOM_LATENCY_HISTOGRAMS, "", \
+    .getter_ex = latency_histogram_get, \
+    .setter_ex = latency_histogram_set)
+
+// 2^21 us ~ 2 s; alles daarboven valt in de laatste bucket
+#define LATENCY_HISTOGRAM_BUCKETS 22
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    LATENCY_HIST_HOMEKIT_WRITE = 0,   // relay_on_set() entry -> relay GPIO edge
+    LATENCY_HIST_BUTTON_NOTIFY,       // button event -> HomeKit notify queued
+    LATENCY_HIST_BUTTON_RELAY,        // button press-down (ISR flank) -> relay GPIO edge
+    LATENCY_HIST_COUNT,
+} latency_histogram_id_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} latency_histogram_snapshot_t;
+
+// Lock-free en zonder allocatie; veilig vanuit taken en ISRs
+void IRAM_ATTR latency_histogram_record(latency_histogram_id_t id, uint32_t elapsed_us);
+
+void latency_histogram_get_snapshot(latency_histogram_id_t id, latency_histogram_snapshot_t *out_snapshot);
+void latency_histogram_reset(void);
+
+homekit_value_t latency_histogram_get(const homekit_characteristic_t *characteristic);
+void latency_histogram_set(homekit_characteristic_t *characteristic, homekit_value_t value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,200 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "led-effects.h"
+
+static const char *LED_TAG = "LED";
+
+typedef struct {
+    bool on;
+    uint16_t duration_ms;
+} led_step_t;
+
+typedef struct {
+    const led_step_t *steps;
+    uint8_t step_count;
+    uint8_t repeat;     // 0 = herhalen tot led_effects_stop()
+} led_pattern_t;
+
+static const led_step_t k_identify_steps[] = {
+    { true, 100 }, { false, 100 }, { true, 100 }, { false, 100 }, { false, 250 },
+};
+static const led_step_t k_provisioning_steps[] = {
+    { true, 500 }, { false, 500 },
+};
+static const led_step_t k_wifi_lost_steps[] = {
+    { true, 100 }, { false, 150 }, { true, 100 }, { false, 1000 },
+};
+static const led_step_t k_ota_steps[] = {
+    { true, 100 }, { false, 100 },
+};
+
+#define LED_PATTERN(_steps, _repeat) \
+    { .steps = (_steps), .step_count = sizeof(_steps) / sizeof((_steps)[0]), .repeat = (_repeat) }
+
+static const led_pattern_t k_patterns[LED_EFFECT_COUNT] = {
+    [LED_EFFECT_NONE] = { 0 },
+    [LED_EFFECT_PROVISIONING] = LED_PATTERN(k_provisioning_steps, 0),
+    [LED_EFFECT_WIFI_LOST] = LED_PATTERN(k_wifi_lost_steps, 0),
+    [LED_EFFECT_OTA] = LED_PATTERN(k_ota_steps, 0),
+    [LED_EFFECT_IDENTIFY] = LED_PATTERN(k_identify_steps, 3),
+};
+
+static esp_timer_handle_t s_timer = NULL;
+static void (*s_write)(bool on) = NULL;
+static bool (*s_live_state)(void) = NULL;
+
+// Bitmask van gevraagde effecten; alleen de timer callback bepaalt wat speelt
+static atomic_uint s_requested = 0;
+static atomic_bool s_kicked = false;
+static led_effect_t s_current = LED_EFFECT_NONE;
+static uint8_t s_step = 0;
+static uint8_t s_iteration = 0;
+// Telt elke led_effects_play() per effect. Een eindig patroon dat bij zijn
+// laatste iteratie opnieuw gevraagd is, begint daardoor opnieuw.
+static atomic_uint s_generation[LED_EFFECT_COUNT];
+static unsigned s_current_generation = 0;
+
+static led_effect_t led_effects_highest(unsigned requested) {
+    for (int effect = LED_EFFECT_COUNT - 1; effect > LED_EFFECT_NONE; --effect) {
+        if (requested & (1U << effect)) {
+            return (led_effect_t)effect;
+        }
+    }
+    return LED_EFFECT_NONE;
+}
+
+static void led_effects_show_live(void) {
+    if (s_write != NULL && s_live_state != NULL) {
+        s_write(s_live_state());
+    }
+}
+
+static void led_effects_tick(void *arg) {
+    (void)arg;
+    bool kicked = atomic_exchange(&s_kicked, false);
+    led_effect_t wanted = led_effects_highest(atomic_load(&s_requested));
+
+    if (wanted != s_current) {
+        s_current = wanted;
+        s_step = 0;
+        s_iteration = 0;
+        s_current_generation = atomic_load(&s_generation[s_current]);
+    } else if (!kicked && s_current != LED_EFFECT_NONE) {
+        // Volgende stap van het lopende patroon
+        const led_pattern_t *pattern = &k_patterns[s_current];
+        if (++s_step >= pattern->step_count) {
+            s_step = 0;
+            if (pattern->repeat != 0U && ++s_iteration >= pattern->repeat) {
+                // Eerst wissen, dan de generatie lezen: een play() daartussen
+                // zet het bit na ons weer, een eerdere zien we hier
+                atomic_fetch_and(&s_requested, ~(1U << s_current));
+                unsigned generation = atomic_load(&s_generation[s_current]);
+                if (generation != s_current_generation) {
+                    atomic_fetch_or(&s_requested, 1U << s_current);
+                }
+                s_current = led_effects_highest(atomic_load(&s_requested));
+                s_current_generation = atomic_load(&s_generation[s_current]);
+                s_iteration = 0;
+            }
+        }
+    }
+
+    if (s_current == LED_EFFECT_NONE) {
+        led_effects_show_live();
+        return;
+    }
+
+    const led_step_t *step = &k_patterns[s_current].steps[s_step];
+    s_write(step->on);
+    esp_timer_start_once(s_timer, (uint64_t)step->duration_ms * 1000ULL);
+}
+
+// Laat de timer callback de nieuwe gewenste toestand oppakken, tenzij dat
+// effect al speelt (dan loopt het patroon gewoon door).
+static void led_effects_kick(void) {
+    if (s_timer == NULL) {
+        return;
+    }
+    if (led_effects_highest(atomic_load(&s_requested)) == s_current) {
+        return;
+    }
+    atomic_store(&s_kicked, true);
+    esp_timer_stop(s_timer);
+    esp_timer_start_once(s_timer, 0);
+}
+
+esp_err_t led_effects_init(void (*write)(bool on), bool (*live_state)(void)) {
+    if (write == NULL || live_state == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_timer != NULL) {
+        return ESP_OK;
+    }
+
+    s_write = write;
+    s_live_state = live_state;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = led_effects_tick,
+        .name = "led_effects",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(LED_TAG, "Failed to create LED effects timer: %s", esp_err_to_name(err));
+        s_timer = NULL;
+    }
+    return err;
+}
+
+void led_effects_play(led_effect_t effect) {
+    if (effect <= LED_EFFECT_NONE || effect >= LED_EFFECT_COUNT) {
+        return;
+    }
+
+    atomic_fetch_add(&s_generation[effect], 1U);
+    atomic_fetch_or(&s_requested, 1U << effect);
+    led_effects_kick();
+}
+
+void led_effects_stop(led_effect_t effect) {
+    if (effect <= LED_EFFECT_NONE || effect >= LED_EFFECT_COUNT) {
+        return;
+    }
+
+    atomic_fetch_and(&s_requested, ~(1U << effect));
+    led_effects_kick();
+}
+
+void led_effects_refresh(void) {
+    if (s_current == LED_EFFECT_NONE && atomic_load(&s_requested) == 0U) {
+        led_effects_show_live();
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In volgorde van prioriteit: een hogere waarde gaat voor een lagere.
+typedef enum {
+    LED_EFFECT_NONE = 0,
+    LED_EFFECT_PROVISIONING,    // geen Wi-Fi configuratie (loopt tot stop)
+    LED_EFFECT_WIFI_LOST,       // verbinding weg (loopt tot stop)
+    LED_EFFECT_OTA,             // update bezig (loopt tot stop)
+    LED_EFFECT_IDENTIFY,        // eenmalig, daarna terug naar het vorige effect / live state
+    LED_EFFECT_COUNT,
+} led_effect_t;
+
+// 'write' stuurt de LED aan, 'live_state' geeft de LED-stand als er geen effect
+// speelt (normaal: relay state). Alles draait op één esp_timer, zonder tasks of
+// heap allocatie per effect.
+esp_err_t led_effects_init(void (*write)(bool on), bool (*live_state)(void));
+
+void led_effects_play(led_effect_t effect);
+void led_effects_stop(led_effect_t effect);
+
+// Toon de live state opnieuw (bijv. na een relay wijziging) als er geen effect actief is.
+void led_effects_refresh(void);
+
+#ifdef __cplusplus
+}
+#endif
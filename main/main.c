@@ -22,34 +22,129 @@
  **/
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 #include <esp_log.h>
 #include <esp_err.h>
 #include <nvs.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <driver/gpio.h>
+#include <esp_event.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 
 #include "esp32-lcm.h"
+#include "zero-cross.h"
+#include "power-meter.h"
+#include "notify-scheduler.h"
+#include "led-effects.h"
+#include "relay-state.h"
+#include "mem-telemetry.h"
+#include "latency-histogram.h"
+#include "relay-group.h"
+#include "espnow-group.h"
+#include "event-trace.h"
+#include "button-edge.h"
 #include <button.h>
 
 // -------- GPIO configuration (set these in sdkconfig) --------
 #define BUTTON_GPIO      CONFIG_ESP_BUTTON_GPIO
-#define RELAY_GPIO       CONFIG_ESP_RELAY_GPIO
 #define BLUE_LED_GPIO    CONFIG_ESP_BLUE_LED_GPIO
+#define ZERO_CROSS_GPIO  CONFIG_ESP_ZERO_CROSS_GPIO
+
+#ifndef CONFIG_ESP_RELAY_CHANNELS
+#define CONFIG_ESP_RELAY_CHANNELS 1
+#endif
+#define RELAY_CHANNEL_COUNT CONFIG_ESP_RELAY_CHANNELS
+
+#ifndef CONFIG_HOMEKIT_MAX_CLIENTS
+#define CONFIG_HOMEKIT_MAX_CLIENTS 16
+#endif
+
+// Zero-cross sync schakelt één relais vanuit de timer ISR; alleen bij één kanaal
+#define RELAY_ZERO_CROSS_ENABLED (CONFIG_ESP_ZERO_CROSS_GPIO >= 0 && RELAY_CHANNEL_COUNT == 1)
+
+// Maximale wachttijd op een zero crossing voordat we toch direct schakelen
+#define RELAY_ZERO_CROSS_TIMEOUT_MS  60
 
 static const char *RELAY_TAG   = "RELAY";
 static const char *BUTTON_TAG  = "BUTTON";
 static const char *IDENT_TAG   = "IDENT";
 
-// Relay / plug state (enige bron van waarheid)
-static bool relay_on = false;
+// Channel tabel (Kconfig); index n = bit n in alle relay masks
+static const relay_channel_desc_t relay_channels[RELAY_CHANNEL_COUNT] = {
+    { CONFIG_ESP_RELAY_GPIO, "HomeKit Plug" },
+#if RELAY_CHANNEL_COUNT >= 2
+    { CONFIG_ESP_RELAY2_GPIO, "Outlet 2" },
+#endif
+#if RELAY_CHANNEL_COUNT >= 3
+    { CONFIG_ESP_RELAY3_GPIO, "Outlet 3" },
+#endif
+#if RELAY_CHANNEL_COUNT >= 4
+    { CONFIG_ESP_RELAY4_GPIO, "Outlet 4" },
+#endif
+#if RELAY_CHANNEL_COUNT >= 5
+    { CONFIG_ESP_RELAY5_GPIO, "Outlet 5" },
+#endif
+#if RELAY_CHANNEL_COUNT >= 6
+    { CONFIG_ESP_RELAY6_GPIO, "Outlet 6" },
+#endif
+};
+
+#define RELAY_ALL_MASK ((1U << RELAY_CHANNEL_COUNT) - 1U)
+
+// Relay state per kanaal (enige bron van waarheid). Alleen de actuator task schrijft.
+static atomic_uint relay_mask = 0;
+
+// Actuator: alle state-wijzigingen lopen via één high-priority task. Producers
+// (HomeKit setter, button callback) schrijven een command in een 1-slot mailbox
+// met atomic CAS. Een nog niet verwerkt command wordt samengevoegd: per kanaal
+// wint de laatste schrijver, de notify-vlag wordt ge-OR'd zodat geen notify
+// verloren gaat.
+#define RELAY_ACTUATOR_STACK_SIZE   2560
+#define RELAY_ACTUATOR_PRIORITY     (configMAX_PRIORITIES - 5)
+
+#define RELAY_CMD_VALID   (1U << 0)
+#define RELAY_CMD_NOTIFY  (1U << 2)
+#define RELAY_CMD_HOMEKIT (1U << 3)   // afkomstig van een HomeKit write (latency meting)
+#define RELAY_CMD_BUTTON  (1U << 4)   // afkomstig van de knop (latency meting)
+#define RELAY_CMD_SOURCE  (RELAY_CMD_HOMEKIT | RELAY_CMD_BUTTON)
+#define RELAY_CMD_SELECT_SHIFT  8     // kanalen waarop het command betrekking heeft
+#define RELAY_CMD_STATE_SHIFT   16    // gewenste state van die kanalen
+#define RELAY_CMD_SELECT(cmd)   (((cmd) >> RELAY_CMD_SELECT_SHIFT) & 0xFFU)
+#define RELAY_CMD_STATE(cmd)    (((cmd) >> RELAY_CMD_STATE_SHIFT) & 0xFFU)
+
+static _Atomic uint32_t relay_cmd_slot = 0;
+static TaskHandle_t relay_actuator_handle = NULL;
+static atomic_uint relay_cmd_collapsed = 0;
+
+// HomeKit write -> relay GPIO latency (low 32 bits van esp_timer_get_time())
+static atomic_uint relay_write_stamp_us = 0;
+// Button event -> relay edge / notify queued latency
+static atomic_uint relay_button_stamp_us = 0;
+static struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} relay_write_latency;
 
 // ---------- Low-level GPIO helpers ----------
 
-static inline void relay_write(bool on) {
-    gpio_set_level(RELAY_GPIO, on ? 1 : 0);
+// Schakel de kanalen in 'changed' naar hun bit in 'next'. Eén kanaal met
+// zero-cross detectie wacht op de zero crossing; anders gaat alles in één
+// group write.
+static void relay_switch(uint32_t changed, uint32_t next) {
+#if RELAY_ZERO_CROSS_ENABLED
+    if (zero_cross_switch((next & 1U) != 0U, pdMS_TO_TICKS(RELAY_ZERO_CROSS_TIMEOUT_MS)) == ESP_OK) {
+        return;
+    }
+#endif
+    relay_group_write(changed, next);
 }
 
 static inline void blue_led_write(bool on) {
@@ -57,77 +152,199 @@ static inline void blue_led_write(bool on) {
     gpio_set_level(BLUE_LED_GPIO, on ? 0 : 1);
 }
 
-// Forward declaration van de characteristic zodat we hem in functies kunnen gebruiken
-extern homekit_characteristic_t relay_on_characteristic;
+static bool blue_led_live_state(void) {
+    // LED brandt zolang er een kanaal aan staat
+    return atomic_load(&relay_mask) != 0U;
+}
 
-// Centrale functie: zet state, stuurt hardware aan en (optioneel) HomeKit-notify
-static void relay_set_state(bool on, bool notify_homekit) {
-    if (relay_on == on) {
+// Forward declaration van de characteristics zodat we ze in functies kunnen gebruiken
+extern homekit_characteristic_t relay_on_characteristic[RELAY_CHANNEL_COUNT];
+
+static void relay_record_write_latency(void) {
+    uint32_t elapsed = (uint32_t)esp_timer_get_time() - atomic_load(&relay_write_stamp_us);
+
+    latency_histogram_record(LATENCY_HIST_HOMEKIT_WRITE, elapsed);
+    relay_write_latency.count++;
+    relay_write_latency.last_us = elapsed;
+    relay_write_latency.total_us += elapsed;
+    if (elapsed > relay_write_latency.max_us) {
+        relay_write_latency.max_us = elapsed;
+    }
+
+    ESP_LOGI(RELAY_TAG, "HomeKit write->relay %" PRIu32 " us (avg %" PRIu32 ", max %" PRIu32 ", profile %s)",
+             elapsed,
+             (uint32_t)(relay_write_latency.total_us / relay_write_latency.count),
+             relay_write_latency.max_us,
+             lifecycle_power_profile_name());
+}
+
+// Voer een command uit: eerst GPIO, daarna pas snapshot, logging en notify
+static void relay_apply_state(uint32_t select, uint32_t state, bool notify_homekit, uint32_t source) {
+    uint32_t current = atomic_load(&relay_mask);
+    uint32_t next = ((current & ~select) | (state & select)) & RELAY_ALL_MASK;
+    uint32_t changed = current ^ next;
+    if (changed == 0U) {
         // Geen verandering, niets te doen
         return;
     }
 
-    relay_on = on;
+    // Hardware aansturen; de LED volgt de relays tenzij er een effect speelt
+    relay_switch(changed, next);
+    if ((source & RELAY_CMD_BUTTON) != 0U) {
+        latency_histogram_record(LATENCY_HIST_BUTTON_RELAY,
+                                 (uint32_t)esp_timer_get_time() - atomic_load(&relay_button_stamp_us));
+    }
+    atomic_store(&relay_mask, next);
+    EVENT_TRACE(EVENT_TRACE_RELAY, changed, next | (source << 16));
+    relay_state_record((uint8_t)next);
+    if ((source & RELAY_CMD_HOMEKIT) != 0U) {
+        relay_record_write_latency();
+    }
+    led_effects_refresh();
 
-    // Hardware aansturen
-    relay_write(relay_on);
-    blue_led_write(relay_on);
+    for (size_t i = 0; i < RELAY_CHANNEL_COUNT; ++i) {
+        if ((changed & (1U << i)) == 0U) {
+            continue;
+        }
+
+        // HomeKit characteristic-snapshot updaten
+        bool on = (next & (1U << i)) != 0U;
+        relay_on_characteristic[i].value = HOMEKIT_BOOL(on);
 
-    ESP_LOGI(RELAY_TAG, "Relay state -> %s", relay_on ? "ON" : "OFF");
+        ESP_LOGI(RELAY_TAG, "Relay %u state -> %s (collapsed commands: %u)", (unsigned)(i + 1),
+                 on ? "ON" : "OFF", atomic_load(&relay_cmd_collapsed));
 
-    // HomeKit characteristic-snapshot updaten
-    relay_on_characteristic.value = HOMEKIT_BOOL(relay_on);
+        // Eventueel HomeKit-clients informeren
+        if (notify_homekit) {
+            notify_scheduler_submit(&relay_on_characteristic[i], relay_on_characteristic[i].value,
+                                    NOTIFY_PRIORITY_STATE);
+        }
+    }
 
-    // Eventueel HomeKit-clients informeren
-    if (notify_homekit) {
-        homekit_characteristic_notify(&relay_on_characteristic,
-                                      relay_on_characteristic.value);
+    if (notify_homekit && (source & RELAY_CMD_BUTTON) != 0U) {
+        latency_histogram_record(LATENCY_HIST_BUTTON_NOTIFY,
+                                 (uint32_t)esp_timer_get_time() - atomic_load(&relay_button_stamp_us));
     }
 }
 
-// All GPIO Settings
-void gpio_init(void) {
-    // Relay
-    gpio_reset_pin(RELAY_GPIO);
-    gpio_set_direction(RELAY_GPIO, GPIO_MODE_OUTPUT);
+static void relay_execute_command(uint32_t cmd) {
+    if ((cmd & RELAY_CMD_VALID) == 0U) {
+        return;
+    }
 
-    // Blue LED
-    gpio_reset_pin(BLUE_LED_GPIO);
-    gpio_set_direction(BLUE_LED_GPIO, GPIO_MODE_OUTPUT);
+    relay_apply_state(RELAY_CMD_SELECT(cmd), RELAY_CMD_STATE(cmd), (cmd & RELAY_CMD_NOTIFY) != 0U,
+                      cmd & RELAY_CMD_SOURCE);
+}
 
-    // Initial state: alles uit, in sync brengen
-    relay_on = false;
-    relay_on_characteristic.value = HOMEKIT_BOOL(false);
-    relay_write(false);
-    blue_led_write(false);
+static void relay_actuator_task(void *args) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        relay_execute_command(atomic_exchange(&relay_cmd_slot, 0U));
+    }
 }
 
-// ---------- Accessory identification (Blue LED) ----------
+// Group-set API: plaats een command voor de kanalen in 'select' in de mailbox.
+// De actuator schakelt alle gewijzigde kanalen in één register write, ook als
+// meerdere HomeKit writes (bv. een "alles uit" scene) samengevoegd zijn. 'toggle'
+// rekent t.o.v. het laatst gevraagde (nog niet uitgevoerde) command, anders
+// t.o.v. relay_mask: staat er een geselecteerd kanaal aan, dan gaan ze allemaal
+// uit, anders allemaal aan. Geeft de gevraagde state van 'select' terug.
+static uint32_t relay_post_command(uint32_t select, uint32_t state, bool toggle, bool notify_homekit,
+                                   uint32_t source) {
+    uint32_t expected = atomic_load(&relay_cmd_slot);
+    uint32_t desired;
+    uint32_t target;
+
+    select &= RELAY_ALL_MASK;
+
+    do {
+        bool pending = (expected & RELAY_CMD_VALID) != 0U;
+        uint32_t pending_select = pending ? RELAY_CMD_SELECT(expected) : 0U;
+        uint32_t pending_state = pending ? RELAY_CMD_STATE(expected) : 0U;
+
+        target = state & select;
+        if (toggle) {
+            uint32_t current = (atomic_load(&relay_mask) & ~pending_select) | (pending_state & pending_select);
+            target = ((current & select) != 0U) ? 0U : select;
+        }
 
-void accessory_identify_task(void *args) {
-    // Blink BLUE LED to identify, then restore previous state
-    bool previous_led_state = relay_on;  // LED volgt normaal relay_on
+        uint32_t merged_select = pending_select | select;
+        uint32_t merged_state = (pending_state & ~select) | (target & select);
 
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 2; j++) {
-            blue_led_write(true);
-            vTaskDelay(pdMS_TO_TICKS(100));
-            blue_led_write(false);
-            vTaskDelay(pdMS_TO_TICKS(100));
+        desired = RELAY_CMD_VALID |
+                  (merged_select << RELAY_CMD_SELECT_SHIFT) |
+                  (merged_state << RELAY_CMD_STATE_SHIFT);
+        if (notify_homekit || (pending && (expected & RELAY_CMD_NOTIFY) != 0U)) {
+            desired |= RELAY_CMD_NOTIFY;
         }
-        vTaskDelay(pdMS_TO_TICKS(250));
+        desired |= source & RELAY_CMD_SOURCE;
+    } while (!atomic_compare_exchange_weak(&relay_cmd_slot, &expected, desired));
+
+    if ((expected & RELAY_CMD_VALID) != 0U) {
+        atomic_fetch_add(&relay_cmd_collapsed, 1U);
     }
 
-    // Zet LED terug naar de normale toestand (afhankelijk van relay_on)
-    blue_led_write(previous_led_state);
+    if (relay_actuator_handle == NULL) {
+        // Actuator nog niet gestart (vroeg in de boot): direct uitvoeren
+        relay_execute_command(atomic_exchange(&relay_cmd_slot, 0U));
+        return target;
+    }
+
+    xTaskNotifyGive(relay_actuator_handle);
+    return target;
+}
+
+static uint32_t relay_toggle_group(uint32_t select, bool notify_homekit, uint32_t source) {
+    return relay_post_command(select, 0U, true, notify_homekit, source);
+}
 
-    vTaskDelete(NULL);
+static void relay_actuator_start(void) {
+    if (relay_actuator_handle != NULL) {
+        return;
+    }
+
+    if (xTaskCreate(relay_actuator_task, "relay_actuator", RELAY_ACTUATOR_STACK_SIZE,
+                    NULL, RELAY_ACTUATOR_PRIORITY, &relay_actuator_handle) != pdPASS) {
+        relay_actuator_handle = NULL;
+        ESP_LOGE(RELAY_TAG, "Failed to start relay actuator task; switching inline");
+    }
 }
 
+// All GPIO Settings
+void gpio_init(void) {
+    // Blue LED
+    gpio_reset_pin(BLUE_LED_GPIO);
+    gpio_set_direction(BLUE_LED_GPIO, GPIO_MODE_OUTPUT);
+
+    // Relays: initial state volgens power-on gedrag (off/on/last), vóór Wi-Fi
+    uint32_t initial_mask = relay_state_init() & RELAY_ALL_MASK;
+    if (relay_group_init(relay_channels, RELAY_CHANNEL_COUNT, initial_mask) != ESP_OK) {
+        ESP_LOGE(RELAY_TAG, "Failed to initialize relay channels");
+    }
+    atomic_store(&relay_mask, initial_mask);
+    for (size_t i = 0; i < RELAY_CHANNEL_COUNT; ++i) {
+        relay_on_characteristic[i].value = HOMEKIT_BOOL((initial_mask & (1U << i)) != 0U);
+    }
+    blue_led_write(initial_mask != 0U);
+    led_effects_init(blue_led_write, blue_led_live_state);
+
+#if RELAY_ZERO_CROSS_ENABLED
+    esp_err_t zc_err = zero_cross_init(ZERO_CROSS_GPIO, CONFIG_ESP_RELAY_GPIO, CONFIG_ESP_RELAY_ACTUATION_DELAY_US);
+    if (zc_err != ESP_OK) {
+        ESP_LOGE(RELAY_TAG, "Zero-cross init failed (%s); switching unsynchronised",
+                 esp_err_to_name(zc_err));
+    }
+#elif CONFIG_ESP_ZERO_CROSS_GPIO >= 0
+    ESP_LOGW(RELAY_TAG, "Zero-cross sync needs a single relay channel; switching unsynchronised");
+#endif
+}
+
+// ---------- Accessory identification (Blue LED) ----------
+
 void accessory_identify(homekit_value_t _value) {
     ESP_LOGI(IDENT_TAG, "Accessory identify");
-    xTaskCreate(accessory_identify_task, "Accessory identify", configMINIMAL_STACK_SIZE,
-                NULL, 2, NULL);
+    // Blink BLUE LED to identify, then restore the live relay state
+    led_effects_play(LED_EFFECT_IDENTIFY);
 }
 
 // ---------- HomeKit characteristics ----------
@@ -144,74 +361,241 @@ homekit_characteristic_t serial = HOMEKIT_CHARACTERISTIC_(SERIAL_NUMBER, DEVICE_
 homekit_characteristic_t model = HOMEKIT_CHARACTERISTIC_(MODEL, DEVICE_MODEL);
 homekit_characteristic_t revision = HOMEKIT_CHARACTERISTIC_(FIRMWARE_REVISION, LIFECYCLE_DEFAULT_FW_VERSION);
 homekit_characteristic_t ota_trigger = API_OTA_TRIGGER;
+homekit_characteristic_t boot_timeline = API_BOOT_TIMELINE;
+homekit_characteristic_t ota_pending = API_OTA_PENDING;
+#if CONFIG_ESP_EVENT_TRACE
+homekit_characteristic_t event_trace = API_EVENT_TRACE;
+#endif
+homekit_characteristic_t mem_telemetry = API_MEM_TELEMETRY;
+homekit_characteristic_t latency_histograms = API_LATENCY_HISTOGRAMS;
+
+#if CONFIG_ESP_METER_CF_GPIO >= 0
+// ---------- Power metering ----------
+
+static const char *METER_TAG = "METER";
+
+homekit_characteristic_t outlet_in_use = HOMEKIT_CHARACTERISTIC_(OUTLET_IN_USE, false);
+homekit_characteristic_t meter_power = HOMEKIT_CHARACTERISTIC_(CUSTOM_EVE_POWER, 0);
+homekit_characteristic_t meter_voltage = HOMEKIT_CHARACTERISTIC_(CUSTOM_EVE_VOLTAGE, 0);
+homekit_characteristic_t meter_current = HOMEKIT_CHARACTERISTIC_(CUSTOM_EVE_CURRENT, 0);
+homekit_characteristic_t meter_energy = HOMEKIT_CHARACTERISTIC_(CUSTOM_EVE_TOTAL_ENERGY, 0);
+
+// Alleen notify sturen bij een merkbare wijziging
+static void meter_update_float(homekit_characteristic_t *ch, float value, float min_change) {
+    float delta = value - ch->value.float_value;
+    if (delta < 0) {
+        delta = -delta;
+    }
+    if (delta < min_change) {
+        return;
+    }
+    ch->value = HOMEKIT_FLOAT(value);
+    notify_scheduler_submit(ch, ch->value, NOTIFY_PRIORITY_TELEMETRY);
+}
+
+static void meter_on_reading(const power_meter_reading_t *reading) {
+    meter_update_float(&meter_power, reading->power_w, 1.0f);
+    meter_update_float(&meter_voltage, reading->voltage_v, 1.0f);
+    meter_update_float(&meter_current, reading->current_a, 0.01f);
+    meter_update_float(&meter_energy, reading->energy_kwh, 0.01f);
+
+    if (outlet_in_use.value.bool_value != reading->in_use) {
+        ESP_LOGI(METER_TAG, "Outlet in use -> %s (%.1f W)", reading->in_use ? "yes" : "no",
+                 reading->power_w);
+        outlet_in_use.value = HOMEKIT_BOOL(reading->in_use);
+        notify_scheduler_submit(&outlet_in_use, outlet_in_use.value, NOTIFY_PRIORITY_STATE);
+    }
+}
+#endif
 
-// Getter: HomeKit vraagt huidige toestand op
-homekit_value_t relay_on_get() {
-    return HOMEKIT_BOOL(relay_on);
+static uint32_t relay_channel_bit(const homekit_characteristic_t *ch) {
+    ptrdiff_t index = ch - relay_on_characteristic;
+    return (index >= 0 && index < RELAY_CHANNEL_COUNT) ? (1U << index) : 0U;
+}
+
+// Getter: HomeKit vraagt huidige toestand van een kanaal op
+homekit_value_t relay_on_get(const homekit_characteristic_t *ch) {
+    return HOMEKIT_BOOL((atomic_load(&relay_mask) & relay_channel_bit(ch)) != 0U);
 }
 
 // Setter: aangeroepen door HomeKit (Home-app / Siri / automations)
-void relay_on_set(homekit_value_t value) {
+void relay_on_set(homekit_characteristic_t *ch, homekit_value_t value) {
     if (value.format != homekit_format_bool) {
         ESP_LOGE(RELAY_TAG, "Invalid value format: %d", value.format);
         return;
     }
 
-    bool new_state = value.bool_value;
+    uint32_t bit = relay_channel_bit(ch);
+    atomic_store(&relay_write_stamp_us, (uint32_t)esp_timer_get_time());
 
     // Via centrale functie, maar ZONDER notify (originator is HomeKit zelf)
-    relay_set_state(new_state, false);
+    relay_post_command(bit, value.bool_value ? bit : 0U, false, false, RELAY_CMD_HOMEKIT);
 }
 
-// We keep a handle to ON characteristic so we can notify on button presses
-homekit_characteristic_t relay_on_characteristic =
-    HOMEKIT_CHARACTERISTIC_(ON, false, .getter = relay_on_get, .setter = relay_on_set);
+#define RELAY_ON_CHARACTERISTIC \
+    HOMEKIT_CHARACTERISTIC_(ON, false, .getter_ex = relay_on_get, .setter_ex = relay_on_set)
+
+// We keep handles to the ON characteristics so we can notify on button presses
+homekit_characteristic_t relay_on_characteristic[RELAY_CHANNEL_COUNT] = {
+    RELAY_ON_CHARACTERISTIC,
+#if RELAY_CHANNEL_COUNT >= 2
+    RELAY_ON_CHARACTERISTIC,
+#endif
+#if RELAY_CHANNEL_COUNT >= 3
+    RELAY_ON_CHARACTERISTIC,
+#endif
+#if RELAY_CHANNEL_COUNT >= 4
+    RELAY_ON_CHARACTERISTIC,
+#endif
+#if RELAY_CHANNEL_COUNT >= 5
+    RELAY_ON_CHARACTERISTIC,
+#endif
+#if RELAY_CHANNEL_COUNT >= 6
+    RELAY_ON_CHARACTERISTIC,
+#endif
+};
+
+// ---------- Accessory database ----------
+//
+// Alleen de pointer tabellen (accessories, services, characteristics) staan
+// als const in flash (rodata). De characteristic-, service- en accessory
+// objecten zelf blijven in DRAM: homekit_accessories_init schrijft daar
+// aid/iid en de service pointer in, en de ON, OTA en meter characteristics
+// dragen live waarden. Van de metadata staan type/description strings en de
+// Eve meter grenzen (POWER_METER_LIMIT) in rodata.
+//
+// esp32-homekit declareert de tabellen als homekit_*_t ** zonder const; de
+// casts hieronder halen const er daarom weg. De library leest de tabellen
+// alleen, en een schrijfpoging naar flash zou direct een StoreProhibited
+// exception geven in plaats van stil geheugen te beschadigen.
+// accessory-db-size.cmake telt na de link alleen de accessory_db_* pointer
+// tabellen; de objecten waar ze naar wijzen vallen daar buiten.
+#define ACCESSORY_DB_CHARACTERISTICS(_table) ((homekit_characteristic_t **)(_table))
+#define ACCESSORY_DB_SERVICES(_table) ((homekit_service_t **)(_table))
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Woverride-init"
-homekit_accessory_t *accessories[] = {
+static homekit_characteristic_t *const accessory_db_information[] = {
+    &name,
+    &manufacturer,
+    &serial,
+    &model,
+    &revision,
+    HOMEKIT_CHARACTERISTIC(IDENTIFY, accessory_identify),
+    NULL
+};
+
+static homekit_characteristic_t *const accessory_db_outlet[] = {
+    HOMEKIT_CHARACTERISTIC(NAME, "HomeKit Plug"),
+    &relay_on_characteristic[0],
+    &ota_trigger,
+    &ota_pending,
+    &boot_timeline,
+    &mem_telemetry,
+    &latency_histograms,
+#if CONFIG_ESP_EVENT_TRACE
+    &event_trace,
+#endif
+#if CONFIG_ESP_METER_CF_GPIO >= 0
+    &outlet_in_use,
+    &meter_power,
+    &meter_voltage,
+    &meter_current,
+    &meter_energy,
+#endif
+    NULL
+};
+
+// Extra OUTLET service per kanaal boven het eerste
+#define RELAY_OUTLET_CHARACTERISTICS(_index, _name) \
+    static homekit_characteristic_t *const accessory_db_outlet_##_index[] = { \
+        HOMEKIT_CHARACTERISTIC(NAME, _name), \
+        &relay_on_characteristic[_index], \
+        NULL \
+    }
+
+#define RELAY_OUTLET_SERVICE(_index) \
+    HOMEKIT_SERVICE(OUTLET, .characteristics = ACCESSORY_DB_CHARACTERISTICS(accessory_db_outlet_##_index))
+
+#if RELAY_CHANNEL_COUNT >= 2
+RELAY_OUTLET_CHARACTERISTICS(1, "Outlet 2");
+#endif
+#if RELAY_CHANNEL_COUNT >= 3
+RELAY_OUTLET_CHARACTERISTICS(2, "Outlet 3");
+#endif
+#if RELAY_CHANNEL_COUNT >= 4
+RELAY_OUTLET_CHARACTERISTICS(3, "Outlet 4");
+#endif
+#if RELAY_CHANNEL_COUNT >= 5
+RELAY_OUTLET_CHARACTERISTICS(4, "Outlet 5");
+#endif
+#if RELAY_CHANNEL_COUNT >= 6
+RELAY_OUTLET_CHARACTERISTICS(5, "Outlet 6");
+#endif
+
+static homekit_service_t *const accessory_db_services[] = {
+    HOMEKIT_SERVICE(ACCESSORY_INFORMATION, .characteristics = ACCESSORY_DB_CHARACTERISTICS(accessory_db_information)),
+    HOMEKIT_SERVICE(OUTLET, .primary = true, .characteristics = ACCESSORY_DB_CHARACTERISTICS(accessory_db_outlet)),
+#if RELAY_CHANNEL_COUNT >= 2
+    RELAY_OUTLET_SERVICE(1),
+#endif
+#if RELAY_CHANNEL_COUNT >= 3
+    RELAY_OUTLET_SERVICE(2),
+#endif
+#if RELAY_CHANNEL_COUNT >= 4
+    RELAY_OUTLET_SERVICE(3),
+#endif
+#if RELAY_CHANNEL_COUNT >= 5
+    RELAY_OUTLET_SERVICE(4),
+#endif
+#if RELAY_CHANNEL_COUNT >= 6
+    RELAY_OUTLET_SERVICE(5),
+#endif
+    NULL
+};
+
+static homekit_accessory_t *const accessory_db_accessories[] = {
     HOMEKIT_ACCESSORY(
         .id = 1,
         .category = homekit_accessory_category_outlets,  // Smart plug / outlet
-        .services = (homekit_service_t *[]) {
-            HOMEKIT_SERVICE(ACCESSORY_INFORMATION, .characteristics = (homekit_characteristic_t *[]) {
-                &name,
-                &manufacturer,
-                &serial,
-                &model,
-                &revision,
-                HOMEKIT_CHARACTERISTIC(IDENTIFY, accessory_identify),
-                NULL
-            }),
-            HOMEKIT_SERVICE(OUTLET, .primary = true, .characteristics = (homekit_characteristic_t *[]) {
-                HOMEKIT_CHARACTERISTIC(NAME, "HomeKit Plug"),
-                &relay_on_characteristic,
-                &ota_trigger,
-                NULL
-            }),
-            NULL
-        }),
+        .services = ACCESSORY_DB_SERVICES(accessory_db_services)),
     NULL
 };
 #pragma GCC diagnostic pop
 
+// HomeKit server events (eerste geverifieerde sessie voor de boot timeline)
+void homekit_on_event(homekit_event_t event) {
+    lifecycle_homekit_event(event);
+    if (event == HOMEKIT_EVENT_CLIENT_VERIFIED) {
+        lifecycle_boot_mark(LIFECYCLE_BOOT_FIRST_CLIENT_SESSION);
+    }
+}
+
 homekit_server_config_t config = {
-    .accessories = accessories,
+    .accessories = (homekit_accessory_t **)accessory_db_accessories,
     .password = CONFIG_ESP_SETUP_CODE,
     .setupId = CONFIG_ESP_SETUP_ID,
+    .on_event = homekit_on_event,
 };
 
 // ---------- Button handling ----------
 
-void button_callback(button_event_t event, void *context) {
+// 'stamp_us': tijd van de press (ISR flank bij de instant knop) voor de latency histogrammen
+static void button_handle_event(button_event_t event, uint32_t stamp_us) {
+    EVENT_TRACE(EVENT_TRACE_BUTTON, event, 0);
     switch (event) {
     case button_event_single_press: {
-        ESP_LOGI(BUTTON_TAG, "Single press -> toggle relay");
-
-        bool new_state = !relay_on;
-
-        // 1) Zelfde logica als HomeKit, maar nu MET notify
-        relay_set_state(new_state, true);
+        atomic_store(&relay_button_stamp_us, stamp_us);
+        ESP_LOGI(BUTTON_TAG, "Single press -> toggle all relays");
+
+        // Zelfde logica als HomeKit, maar nu MET notify; alle kanalen in één write
+        uint32_t target = relay_toggle_group(RELAY_ALL_MASK, true, RELAY_CMD_BUTTON);
+#if CONFIG_ESP_ESPNOW_GROUP
+        // Peers direct meenemen, zonder omweg via de home hub
+        espnow_group_send(target != 0U);
+#else
+        (void)target;
+#endif
 
         break;
     }
@@ -229,30 +613,160 @@ void button_callback(button_event_t event, void *context) {
     }
 }
 
+void button_callback(button_event_t event, void *context) {
+    button_handle_event(event, (uint32_t)esp_timer_get_time());
+}
+
+#if CONFIG_ESP_BUTTON_INSTANT
+#ifndef CONFIG_ESP_BUTTON_DEBOUNCE_MS
+#define CONFIG_ESP_BUTTON_DEBOUNCE_MS 30
+#endif
+
+#ifndef CONFIG_ESP_BUTTON_MULTI_PRESS_MS
+#define CONFIG_ESP_BUTTON_MULTI_PRESS_MS 0
+#endif
+
+#if CONFIG_LCM_POWER_PROFILE_ECO
+#define BUTTON_SLEEP_WAKEUP true
+#else
+#define BUTTON_SLEEP_WAKEUP false
+#endif
+
+// Zelfde events als esp32-button, met de tijd van de press-down flank
+static void button_edge_callback(const button_edge_event_t *event, void *ctx) {
+    (void)ctx;
+    switch (event->type) {
+    case BUTTON_EDGE_PRESS:
+        button_handle_event(button_event_single_press, (uint32_t)event->edge_us);
+        break;
+    case BUTTON_EDGE_MULTI_PRESS:
+        button_handle_event(button_event_double_press, (uint32_t)event->edge_us);
+        break;
+    case BUTTON_EDGE_LONG_PRESS:
+        button_handle_event(button_event_long_press, (uint32_t)event->edge_us);
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
 // ---------- Wi-Fi / HomeKit startup ----------
 
-void on_wifi_ready() {
-    static bool homekit_started = false;
+// LED status bij verlies en herstel van de Wi-Fi verbinding
+static void wifi_led_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        led_effects_play(LED_EFFECT_WIFI_LOST);
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        led_effects_stop(LED_EFFECT_WIFI_LOST);
+    }
+}
+
+#if CONFIG_ESP_ESPNOW_GROUP
+// Group command van een andere plug: rechtstreeks door de relay path, MET
+// notify zodat de eigen HomeKit clients de nieuwe state zien
+static void espnow_group_on_command(bool on) {
+    relay_post_command(RELAY_ALL_MASK, on ? RELAY_ALL_MASK : 0U, false, true, 0U);
+}
+#endif
 
-    if (homekit_started) {
+// Lifecycle hook: update aangevraagd, toon OTA effect tot de reboot
+void lifecycle_update_started(void) {
+    led_effects_play(LED_EFFECT_OTA);
+    // Uitgestelde relay state niet verliezen door de reboot naar de factory app
+    relay_state_flush();
+}
+
+// Startup pipeline: Wi-Fi associeert terwijl app_main de rest van de
+// configuratie afmaakt. De HomeKit server start pas als beide klaar zijn; wie
+// als laatste zijn bit zet, start hem.
+#define STARTUP_WIFI_READY   (1U << 0)
+#define STARTUP_CONFIG_DONE  (1U << 1)
+#define STARTUP_ALL          (STARTUP_WIFI_READY | STARTUP_CONFIG_DONE)
+
+static atomic_uint startup_flags = 0;
+static atomic_bool homekit_started = false;
+
+static void homekit_start_when_ready(uint32_t flag) {
+    uint32_t prev = atomic_fetch_or(&startup_flags, flag);
+    if ((prev | flag) != STARTUP_ALL) {
+        return;
+    }
+
+    if (atomic_exchange(&homekit_started, true)) {
         ESP_LOGI("INFORMATION", "HomeKit server already running; skipping re-initialization");
         return;
     }
 
     ESP_LOGI("INFORMATION", "Starting HomeKit server...");
+    // Sessiebudget uit de heap die er nu, met Wi-Fi actief, nog vrij is; de
+    // server weigert zelf elke verbinding boven max_clients
+    config.max_clients = (int)lifecycle_hap_configure_client_budget(CONFIG_HOMEKIT_MAX_CLIENTS);
     homekit_server_init(&config);
-    homekit_started = true;
+    lifecycle_boot_mark(LIFECYCLE_BOOT_HOMEKIT_SERVER_INIT);
+}
+
+void on_wifi_ready() {
+    homekit_start_when_ready(STARTUP_WIFI_READY);
 }
 
 // ---------- app_main ----------
 
 void app_main(void) {
+#if CONFIG_ESP_EVENT_TRACE
+    // Vóór alles: ook de vroegste lifecycle steps komen in de ring
+    event_trace_init();
+#endif
+    lifecycle_boot_mark(LIFECYCLE_BOOT_APP_MAIN);
+
     ESP_ERROR_CHECK(lifecycle_nvs_init());
-    lifecycle_log_post_reset_state("INFORMATION");
-    ESP_ERROR_CHECK(lifecycle_configure_homekit(&revision, &ota_trigger, "INFORMATION"));
+    lifecycle_boot_mark(LIFECYCLE_BOOT_NVS_INIT);
 
+    notify_scheduler_init();
+
+    // Relais (power-on state) en LED vóór Wi-Fi; dit kost geen flash I/O op warme resets
     gpio_init();
+    relay_actuator_start();
+    lifecycle_boot_mark(LIFECYCLE_BOOT_GPIO_INIT);
 
+    // Radio zo vroeg mogelijk: alleen de credentials zijn nodig om te associëren
+    esp_err_t wifi_err = wifi_start(on_wifi_ready);
+    lifecycle_boot_mark(LIFECYCLE_BOOT_WIFI_START);
+    if (wifi_err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW("WIFI", "WiFi configuration not found; provisioning required");
+        led_effects_play(LED_EFFECT_PROVISIONING);
+    } else if (wifi_err == ESP_OK) {
+        esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_led_event_handler, NULL);
+        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_led_event_handler, NULL);
+#if CONFIG_ESP_ESPNOW_GROUP
+        espnow_group_init(espnow_group_on_command);
+#endif
+    } else if (wifi_err != ESP_OK) {
+        ESP_LOGE("WIFI", "Failed to start WiFi: %s", esp_err_to_name(wifi_err));
+    }
+
+    // Onderstaande loopt parallel aan scan/associatie/DHCP
+    lifecycle_log_post_reset_state("INFORMATION");
+    lifecycle_boot_mark(LIFECYCLE_BOOT_POST_RESET_STATE);
+
+    ESP_ERROR_CHECK(lifecycle_configure_homekit(&revision, &ota_trigger, "INFORMATION"));
+    lifecycle_configure_ota_pending(&ota_pending);
+    lifecycle_boot_mark(LIFECYCLE_BOOT_CONFIGURE_HOMEKIT);
+
+#if CONFIG_ESP_BUTTON_INSTANT
+    const button_edge_config_t btn_cfg = {
+        .gpio = BUTTON_GPIO,
+        .active_low = true,
+        .debounce_ms = CONFIG_ESP_BUTTON_DEBOUNCE_MS,
+        .long_press_ms = 10000,  // 10 seconds for lifecycle_factory_reset_and_reboot
+        .multi_press_ms = CONFIG_ESP_BUTTON_MULTI_PRESS_MS,
+        .sleep_wakeup = BUTTON_SLEEP_WAKEUP,  // knop blijft werken tijdens automatic light sleep
+    };
+
+    if (button_edge_init(&btn_cfg, button_edge_callback, NULL) != ESP_OK) {
+        ESP_LOGE(BUTTON_TAG, "Failed to initialize button");
+    }
+#else
     button_config_t btn_cfg = button_config_default(button_active_low);
     btn_cfg.max_repeat_presses = 3;
     btn_cfg.long_press_time = 10000;  // 10 seconds for lifecycle_factory_reset_and_reboot
@@ -260,11 +774,25 @@ void app_main(void) {
     if (button_create(BUTTON_GPIO, btn_cfg, button_callback, NULL)) {
         ESP_LOGE(BUTTON_TAG, "Failed to initialize button");
     }
+    // Knop blijft werken tijdens automatic light sleep (eco profiel)
+    lifecycle_power_enable_gpio_wakeup(BUTTON_GPIO, true);
+#endif
+    lifecycle_boot_mark(LIFECYCLE_BOOT_BUTTON_CREATE);
+
+#if CONFIG_ESP_METER_CF_GPIO >= 0
+    if (power_meter_init(CONFIG_ESP_METER_CF_GPIO, CONFIG_ESP_METER_CF1_GPIO,
+                         CONFIG_ESP_METER_SEL_GPIO, meter_on_reading) != ESP_OK) {
+        ESP_LOGE(METER_TAG, "Failed to initialize power metering");
+    }
+#endif
 
-    esp_err_t wifi_err = wifi_start(on_wifi_ready);
-    if (wifi_err == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGW("WIFI", "WiFi configuration not found; provisioning required");
-    } else if (wifi_err != ESP_OK) {
-        ESP_LOGE("WIFI", "Failed to start WiFi: %s", esp_err_to_name(wifi_err));
+    // Periodieke heap/stack watermarks; de eerste sample legt ook het
+    // stackgebruik van de main task vast voordat die eindigt
+    if (mem_telemetry_init() != ESP_OK) {
+        ESP_LOGE("MEM", "Failed to start memory telemetry");
     }
+
+    // Configuratie klaar: start HomeKit als Wi-Fi er al was. Daarna keert
+    // app_main terug en geeft ESP-IDF de main task stack vrij.
+    homekit_start_when_ready(STARTUP_CONFIG_DONE);
 }
@@ -0,0 +1,202 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "mem-telemetry.h"
+
+static const char *MEM_TAG = "MEM";
+
+#ifndef CONFIG_ESP_MEM_TELEMETRY_INTERVAL_MS
+#define CONFIG_ESP_MEM_TELEMETRY_INTERVAL_MS 60000
+#endif
+
+typedef struct {
+    const char *task_name;
+    const char *alias;        // korte naam in de characteristic
+    int32_t headroom;         // laatst gemeten high water mark, -1 = nooit gezien
+} mem_task_slot_t;
+
+// Taken die stack-budget uit sdkconfig of uit deze firmware krijgen. Taken die
+// inmiddels gestopt zijn (main) houden hun laatste meting.
+static mem_task_slot_t s_tasks[] = {
+    { "main",           "main", -1 },
+    { "HomeKit Server", "hap",  -1 },
+    { "esp_timer",      "tmr",  -1 },
+    { "sys_evt",        "evt",  -1 },
+    { "tiT",            "ip",   -1 },
+    { "relay_actuator", "rly",  -1 },
+    { "power_meter",    "mtr",  -1 },
+    { "button",         "btn",  -1 },
+};
+
+#define MEM_TASK_COUNT (sizeof(s_tasks) / sizeof(s_tasks[0]))
+
+static mem_telemetry_heap_t s_heap;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_timer = NULL;
+static char s_telemetry_str[256];
+
+void mem_telemetry_sample(void) {
+    int32_t headroom[MEM_TASK_COUNT];
+    for (size_t i = 0; i < MEM_TASK_COUNT; ++i) {
+        TaskHandle_t task = xTaskGetHandle(s_tasks[i].task_name);
+        // ESP-IDF rapporteert de high water mark in bytes
+        headroom[i] = (task != NULL) ? (int32_t)uxTaskGetStackHighWaterMark(task) : -1;
+    }
+
+    uint32_t free_heap = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t min_free = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    uint32_t largest = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < MEM_TASK_COUNT; ++i) {
+        if (headroom[i] >= 0) {
+            s_tasks[i].headroom = headroom[i];
+        }
+    }
+    s_heap.free_heap = free_heap;
+    s_heap.min_free_heap = min_free;
+    s_heap.largest_block = largest;
+    if (s_heap.min_largest_block == 0 || largest < s_heap.min_largest_block) {
+        s_heap.min_largest_block = largest;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static size_t mem_telemetry_format(char *buf, size_t size) {
+    mem_telemetry_heap_t heap;
+    int32_t headroom[MEM_TASK_COUNT];
+
+    portENTER_CRITICAL(&s_lock);
+    heap = s_heap;
+    for (size_t i = 0; i < MEM_TASK_COUNT; ++i) {
+        headroom[i] = s_tasks[i].headroom;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    int written = snprintf(buf, size,
+                           "free=%" PRIu32 ",min=%" PRIu32 ",blk=%" PRIu32 ",minblk=%" PRIu32 ";",
+                           heap.free_heap, heap.min_free_heap, heap.largest_block, heap.min_largest_block);
+    if (written < 0 || (size_t)written >= size) {
+        return size > 0 ? size - 1 : 0;
+    }
+    size_t used = (size_t)written;
+
+    for (size_t i = 0; i < MEM_TASK_COUNT; ++i) {
+        const char *sep = (i + 1U < MEM_TASK_COUNT) ? "," : "";
+        if (headroom[i] >= 0) {
+            written = snprintf(buf + used, size - used, "%s=%" PRId32 "%s", s_tasks[i].alias, headroom[i], sep);
+        } else {
+            written = snprintf(buf + used, size - used, "%s=-%s", s_tasks[i].alias, sep);
+        }
+        if (written < 0 || (size_t)written >= size - used) {
+            return size - 1;
+        }
+        used += (size_t)written;
+    }
+
+    // HAP sessies naast de heap minima: onder load laat dit zien hoeveel
+    // sessies het budget toeliet en hoeveel er tegelijk open waren
+    lifecycle_hap_client_stats_t hap;
+    lifecycle_get_hap_client_stats(&hap);
+    written = snprintf(buf + used, size - used, ";hap=%" PRIu32 "/%" PRIu32 ",peak=%" PRIu32,
+                       hap.sessions, hap.budget, hap.peak_sessions);
+    if (written < 0 || (size_t)written >= size - used) {
+        return size - 1;
+    }
+    used += (size_t)written;
+
+    return used;
+}
+
+static void mem_telemetry_timer_cb(void *arg) {
+    // Eigen buffer: s_telemetry_str hoort bij de HomeKit getter
+    char line[sizeof(s_telemetry_str)];
+
+    mem_telemetry_sample();
+    mem_telemetry_format(line, sizeof(line));
+    ESP_LOGI(MEM_TAG, "%s", line);
+}
+
+esp_err_t mem_telemetry_init(void) {
+    if (s_timer != NULL) {
+        return ESP_OK;
+    }
+
+    mem_telemetry_sample();
+
+    const esp_timer_create_args_t args = {
+        .callback = mem_telemetry_timer_cb,
+        .name = "mem_telemetry",
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+        s_timer = NULL;
+        return err;
+    }
+
+    // Lage prioriteit: de sample mag best een tick later komen
+    return esp_timer_start_periodic(s_timer, (uint64_t)CONFIG_ESP_MEM_TELEMETRY_INTERVAL_MS * 1000ULL);
+}
+
+void mem_telemetry_get_heap(mem_telemetry_heap_t *out_heap) {
+    if (out_heap == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *out_heap = s_heap;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int32_t mem_telemetry_get_stack_headroom(const char *task_name) {
+    if (task_name == NULL) {
+        return -1;
+    }
+
+    int32_t headroom = -1;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < MEM_TASK_COUNT; ++i) {
+        if (strcmp(s_tasks[i].task_name, task_name) == 0) {
+            headroom = s_tasks[i].headroom;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return headroom;
+}
+
+homekit_value_t mem_telemetry_get(const homekit_characteristic_t *characteristic) {
+    (void)characteristic;
+    mem_telemetry_sample();
+    mem_telemetry_format(s_telemetry_str, sizeof(s_telemetry_str));
+    return HOMEKIT_STRING(s_telemetry_str, .is_static = true);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "esp32-lcm.h"
+
+// "free=<B>,min=<B>,blk=<B>,minblk=<B>;<task>=<B>,...;hap=<open>/<budget>,peak=<n>"
+// (stack headroom in bytes, '-' = taak niet gevonden; budget 0 = geen limiet)
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_MEM_TELEMETRY HOMEKIT_CUSTOM_UUID("F0000003")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_MEM_TELEMETRY(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_MEM_TELEMETRY, \
+    .description = "MemoryTelemetry", \
+    .format = homekit_format_string, \
+    .permissions = homekit_permissions_paired_read, \
+    .max_len = 256, \
+    .value = HOMEKIT_STRING_(_value), \
+    ##__VA_ARGS__
+
+#define API_MEM_TELEMETRY HOMEKIT_CHARACTERISTIC_(CUSTOM_MEM_TELEMETRY, "", \
+    .getter_ex = mem_telemetry_get)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t free_heap;
+    uint32_t min_free_heap;       // laagste vrije heap sinds boot
+    uint32_t largest_block;       // grootste vrije blok nu (fragmentatie)
+    uint32_t min_largest_block;   // kleinste "grootste blok" sinds boot
+} mem_telemetry_heap_t;
+
+// Start de periodieke sampling (CONFIG_ESP_MEM_TELEMETRY_INTERVAL_MS) met logregel
+esp_err_t mem_telemetry_init(void);
+
+// Neem direct een sample; bv. vlak voordat de main task eindigt
+void mem_telemetry_sample(void);
+
+void mem_telemetry_get_heap(mem_telemetry_heap_t *out_heap);
+
+// Stack headroom (bytes) van een gevolgde taak, of -1 als die nooit gezien is
+int32_t mem_telemetry_get_stack_headroom(const char *task_name);
+
+homekit_value_t mem_telemetry_get(const homekit_characteristic_t *characteristic);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,266 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "notify-scheduler.h"
+
+static const char *NOTIFY_TAG = "NOTIFY";
+
+#ifndef CONFIG_ESP_NOTIFY_STATE_WINDOW_MS
+#define CONFIG_ESP_NOTIFY_STATE_WINDOW_MS 100
+#endif
+#ifndef CONFIG_ESP_NOTIFY_TELEMETRY_WINDOW_MS
+#define CONFIG_ESP_NOTIFY_TELEMETRY_WINDOW_MS 5000
+#endif
+
+#define NOTIFY_SLOTS                  16
+// Maximaal aantal telemetry notifies per flush; state gaat altijd voor
+#define NOTIFY_TELEMETRY_PER_FLUSH    2
+
+typedef struct {
+    homekit_characteristic_t *characteristic;
+    homekit_value_t value;
+    notify_priority_t priority;
+    bool pending;
+    int64_t last_sent_us;
+} notify_slot_t;
+
+static notify_slot_t s_slots[NOTIFY_SLOTS];
+static notify_scheduler_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_flush_timer = NULL;
+static int64_t s_flush_at_us = 0;
+// esp_timer calls mogen niet binnen s_lock; deze mutex houdt s_flush_at_us
+// en de gewapende timer gelijk tussen submitters en de flush
+static SemaphoreHandle_t s_arm_mutex = NULL;
+
+static int64_t notify_window_us(notify_priority_t priority) {
+    int64_t window_ms = (priority == NOTIFY_PRIORITY_STATE) ?
+            CONFIG_ESP_NOTIFY_STATE_WINDOW_MS : CONFIG_ESP_NOTIFY_TELEMETRY_WINDOW_MS;
+    return window_ms * 1000;
+}
+
+static void notify_send(homekit_characteristic_t *characteristic, homekit_value_t value) {
+    // Strings zijn niet in het slot gekopieerd; stuur de actuele waarde
+    if (value.format == homekit_format_string) {
+        value = characteristic->value;
+    }
+    homekit_characteristic_notify(characteristic, value);
+}
+
+// Vroegste deadline van alle pending slots; 0 als er niets pending is.
+// Aanroepen met s_lock.
+static int64_t notify_next_deadline_locked(void) {
+    int64_t next = 0;
+    for (size_t i = 0; i < NOTIFY_SLOTS; ++i) {
+        const notify_slot_t *slot = &s_slots[i];
+        if (slot->characteristic == NULL || !slot->pending) {
+            continue;
+        }
+        int64_t due = slot->last_sent_us + notify_window_us(slot->priority);
+        if (next == 0 || due < next) {
+            next = due;
+        }
+    }
+    return next;
+}
+
+static void notify_arm_timer(int64_t deadline_us) {
+    if (s_flush_timer == NULL || deadline_us == 0) {
+        return;
+    }
+
+    xSemaphoreTake(s_arm_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&s_lock);
+    bool rearm = (s_flush_at_us == 0 || deadline_us < s_flush_at_us);
+    if (rearm) {
+        s_flush_at_us = deadline_us;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (rearm) {
+        int64_t delay = deadline_us - esp_timer_get_time();
+        esp_timer_stop(s_flush_timer);
+        esp_timer_start_once(s_flush_timer, (delay > 0) ? (uint64_t)delay : 1U);
+    }
+    xSemaphoreGive(s_arm_mutex);
+}
+
+static void notify_flush(void *arg) {
+    homekit_characteristic_t *due_ch[NOTIFY_SLOTS];
+    homekit_value_t due_value[NOTIFY_SLOTS];
+    size_t due_count = 0;
+    size_t telemetry_sent = 0;
+    int64_t now = esp_timer_get_time();
+
+    // Geen submitter tussen het wissen van s_flush_at_us en zijn timer start
+    xSemaphoreTake(s_arm_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&s_lock);
+    s_flush_at_us = 0;
+    // Twee passes: eerst state, dan (gelimiteerd) telemetry
+    for (int pass = NOTIFY_PRIORITY_STATE; pass <= NOTIFY_PRIORITY_TELEMETRY; ++pass) {
+        for (size_t i = 0; i < NOTIFY_SLOTS; ++i) {
+            notify_slot_t *slot = &s_slots[i];
+            if (slot->characteristic == NULL || !slot->pending || (int)slot->priority != pass) {
+                continue;
+            }
+            if (now < slot->last_sent_us + notify_window_us(slot->priority)) {
+                continue;
+            }
+            if (pass == NOTIFY_PRIORITY_TELEMETRY) {
+                if (telemetry_sent >= NOTIFY_TELEMETRY_PER_FLUSH) {
+                    s_stats.deferred++;
+                    continue;
+                }
+                telemetry_sent++;
+            }
+            slot->pending = false;
+            slot->last_sent_us = now;
+            due_ch[due_count] = slot->characteristic;
+            due_value[due_count] = slot->value;
+            due_count++;
+            s_stats.sent++;
+        }
+    }
+    int64_t next = notify_next_deadline_locked();
+    taskEXIT_CRITICAL(&s_lock);
+    xSemaphoreGive(s_arm_mutex);
+
+    for (size_t i = 0; i < due_count; ++i) {
+        notify_send(due_ch[i], due_value[i]);
+    }
+
+    if (next != 0) {
+        // Doorgeschoven telemetry: volgende flush op zijn vroegst een state-window later
+        int64_t floor = now + notify_window_us(NOTIFY_PRIORITY_STATE);
+        notify_arm_timer(next > floor ? next : floor);
+    }
+}
+
+esp_err_t notify_scheduler_init(void) {
+    if (s_flush_timer != NULL) {
+        return ESP_OK;
+    }
+
+    if (s_arm_mutex == NULL) {
+        s_arm_mutex = xSemaphoreCreateMutex();
+        if (s_arm_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = notify_flush,
+        .name = "notify_flush",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_flush_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(NOTIFY_TAG, "Failed to create notify timer: %s", esp_err_to_name(err));
+        s_flush_timer = NULL;
+    }
+    return err;
+}
+
+void notify_scheduler_submit(homekit_characteristic_t *characteristic,
+                             homekit_value_t value,
+                             notify_priority_t priority) {
+    if (characteristic == NULL) {
+        return;
+    }
+
+    if (s_flush_timer == NULL) {
+        // Scheduler (nog) niet actief: direct doorgeven
+        notify_send(characteristic, value);
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bool send_now = false;
+    int64_t deadline = 0;
+    notify_slot_t *slot = NULL;
+
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.submitted++;
+    for (size_t i = 0; i < NOTIFY_SLOTS; ++i) {
+        if (s_slots[i].characteristic == characteristic) {
+            slot = &s_slots[i];
+            break;
+        }
+        if (slot == NULL && s_slots[i].characteristic == NULL) {
+            slot = &s_slots[i];
+        }
+    }
+
+    if (slot == NULL) {
+        // Alle slots bezet: liever een ongecoalescede notify dan een verloren
+        // state change
+        s_stats.unslotted++;
+        s_stats.sent++;
+        send_now = true;
+    } else {
+        if (slot->characteristic == NULL) {
+            slot->characteristic = characteristic;
+            slot->last_sent_us = now - notify_window_us(priority);
+        }
+        slot->priority = priority;
+
+        if (slot->pending) {
+            s_stats.merged++;
+        }
+
+        if (!slot->pending && now >= slot->last_sent_us + notify_window_us(priority)) {
+            // Leading edge: direct versturen
+            slot->last_sent_us = now;
+            send_now = true;
+            s_stats.sent++;
+        } else {
+            slot->value = value;
+            slot->pending = true;
+            deadline = slot->last_sent_us + notify_window_us(priority);
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (send_now) {
+        notify_send(characteristic, value);
+    } else if (deadline != 0) {
+        notify_arm_timer(deadline);
+    }
+}
+
+void notify_scheduler_get_stats(notify_scheduler_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    *out_stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
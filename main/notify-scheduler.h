@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    NOTIFY_PRIORITY_STATE = 0,      // ON, OutletInUse, lifecycle flags
+    NOTIFY_PRIORITY_TELEMETRY = 1,  // metering / diagnostics
+} notify_priority_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;
+    uint32_t merged;     // overschreven door een nieuwere waarde binnen het window
+    uint32_t deferred;   // telemetry doorgeschoven door de rate limit
+    uint32_t unslotted;  // geen vrij slot: direct verstuurd, zonder coalescing
+} notify_scheduler_stats_t;
+
+// Maak de flush timer aan. Zonder init worden notifies direct doorgegeven.
+esp_err_t notify_scheduler_init(void);
+
+// Plan een homekit_characteristic_notify(). Per characteristic gaat de eerste
+// wijziging direct uit; wijzigingen binnen het window van de prioriteit worden
+// samengevoegd en alleen de laatste waarde wordt aan het einde verstuurd.
+void notify_scheduler_submit(homekit_characteristic_t *characteristic,
+                             homekit_value_t value,
+                             notify_priority_t priority);
+
+void notify_scheduler_get_stats(notify_scheduler_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,456 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
+#include <esp_http_client.h>
+#include <esp_crt_bundle.h>
+#include <mbedtls/sha512.h>
+
+#include "ota-download.h"
+
+static const char *DOWNLOAD_TAG = "OTA_DOWNLOAD";
+
+#define OTA_DOWNLOAD_URL_MAX_LEN    256
+#define OTA_DOWNLOAD_CHUNK_SIZE     1024
+#define OTA_DOWNLOAD_MAX_REDIRECTS  5
+#define OTA_DOWNLOAD_TIMEOUT_MS     15000
+
+// main.bin.sig van de factory LCM: SHA-384 van main.bin + lengte (u32 big endian)
+#define OTA_DOWNLOAD_SIG_HASH_LEN   48
+#define OTA_DOWNLOAD_SIG_MIN_LEN    (OTA_DOWNLOAD_SIG_HASH_LEN + 4)
+#define OTA_DOWNLOAD_SIG_MAX_LEN    128
+
+typedef struct {
+    esp_ota_handle_t ota;
+    mbedtls_sha512_context sha;
+    uint32_t written;
+} image_writer_t;
+
+static esp_http_client_handle_t http_client_create(const char *url) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .user_agent = "esp32-ota",
+        .timeout_ms = OTA_DOWNLOAD_TIMEOUT_MS,
+        .buffer_size = OTA_DOWNLOAD_CHUNK_SIZE,
+        .disable_auto_redirect = true,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    return esp_http_client_init(&config);
+}
+
+// Open 'client' en volg redirects (release assets verwijzen naar een CDN)
+static esp_err_t http_open(esp_http_client_handle_t client) {
+    for (int redirects = 0; redirects <= OTA_DOWNLOAD_MAX_REDIRECTS; ++redirects) {
+        esp_err_t err = esp_http_client_open(client, 0);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (esp_http_client_fetch_headers(client) < 0) {
+            esp_http_client_close(client);
+            return ESP_ERR_HTTP_FETCH_HEADER;
+        }
+
+        int status = esp_http_client_get_status_code(client);
+        if (status == 200) {
+            return ESP_OK;
+        }
+        if (status == 301 || status == 302 || status == 303 || status == 307 || status == 308) {
+            esp_http_client_flush_response(client, NULL);
+            err = esp_http_client_set_redirection(client);
+            esp_http_client_close(client);
+            if (err != ESP_OK) {
+                return err;
+            }
+            continue;
+        }
+
+        ESP_LOGE(DOWNLOAD_TAG, "Unexpected HTTP status %d", status);
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    ESP_LOGE(DOWNLOAD_TAG, "Too many redirects");
+    return ESP_ERR_HTTP_MAX_REDIRECT;
+}
+
+// Open het image van 'release'. Met CONFIG_LCM_OTA_COMPRESSED_DELTA eerst de
+// kleinere varianten die ota-stream kan decoderen: een delta patch tegen het
+// draaiende image ("main.bin.<eerste 4 bytes sha256 hex>.delta", eventueel
+// zlib) en het zlib image ("main.bin.z"). Ontbreekt een asset, dan de
+// volgende; elke variant levert hetzelfde main.bin op, dus main.bin.sig
+// controleert ze allemaal.
+static esp_err_t image_open(const char *repo, const char *tag, const esp_partition_t *running,
+                            esp_http_client_handle_t *out_client) {
+    char assets[3][48];
+    size_t count = 0;
+
+#if CONFIG_LCM_OTA_COMPRESSED_DELTA
+    uint8_t base_sha[32];
+    if (running != NULL && esp_partition_get_sha256(running, base_sha) == ESP_OK) {
+        snprintf(assets[count++], sizeof(assets[0]), "main.bin.%02x%02x%02x%02x.delta",
+                 base_sha[0], base_sha[1], base_sha[2], base_sha[3]);
+    }
+    snprintf(assets[count++], sizeof(assets[0]), "main.bin.z");
+#else
+    (void)running;
+#endif
+    snprintf(assets[count++], sizeof(assets[0]), "main.bin");
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    for (size_t i = 0; i < count; ++i) {
+        char url[OTA_DOWNLOAD_URL_MAX_LEN];
+        snprintf(url, sizeof(url), "https://github.com/%s/releases/download/%s/%s", repo, tag, assets[i]);
+        ESP_LOGI(DOWNLOAD_TAG, "Starting OTA from %s", url);
+
+        esp_http_client_handle_t client = http_client_create(url);
+        if (client == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        err = http_open(client);
+        if (err == ESP_OK) {
+            *out_client = client;
+            return ESP_OK;
+        }
+        esp_http_client_cleanup(client);
+    }
+    return err;
+}
+
+// Download 'url' in 'buf' (max 'cap' bytes, wordt afgesloten met '\0')
+static esp_err_t http_get_small(const char *url, char *buf, size_t cap, size_t *out_len) {
+    esp_http_client_handle_t client = http_client_create(url);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = http_open(client);
+    size_t len = 0;
+    while (err == ESP_OK) {
+        if (len + 1 >= cap) {
+            ESP_LOGE(DOWNLOAD_TAG, "Response from %s exceeds %u bytes", url, (unsigned)cap);
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        int n = esp_http_client_read(client, buf + len, cap - 1 - len);
+        if (n < 0) {
+            err = ESP_FAIL;
+        } else if (n == 0) {
+            break;
+        } else {
+            len += (size_t)n;
+        }
+    }
+    if (err == ESP_OK && !esp_http_client_is_complete_data_received(client)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    buf[len] = '\0';
+    *out_len = len;
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+// Lees de release JSON als stream tot de eerste "tag_name" en stop dan. De
+// body (release notes, assets) wordt niet bewaard, dus de grootte van de
+// response maakt niet uit. In de GitHub release staat tag_name vóór assets en
+// body; een "tag_name" binnen een string is ge-escaped (\") en telt niet.
+#define OTA_DOWNLOAD_TAG_KEY        "\"tag_name\""
+// Wat van een stuk bewaard blijft: sleutel, wat witruimte en de hele waarde
+#define OTA_DOWNLOAD_TAG_WINDOW     (sizeof(OTA_DOWNLOAD_TAG_KEY) + 8 + OTA_DOWNLOAD_VERSION_MAX_LEN)
+
+static esp_err_t http_find_release_tag(const char *url, char *out_tag, size_t tag_cap) {
+    // De rest van het vorige stuk plus een nieuw stuk
+    char buf[OTA_DOWNLOAD_TAG_WINDOW + OTA_DOWNLOAD_CHUNK_SIZE + 1];
+    if (tag_cap > OTA_DOWNLOAD_VERSION_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_http_client_handle_t client = http_client_create(url);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = http_open(client);
+    size_t len = 0;
+    bool found = false;
+    while (err == ESP_OK && !found) {
+        int n = esp_http_client_read(client, buf + len, OTA_DOWNLOAD_CHUNK_SIZE);
+        if (n < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (n == 0) {
+            err = ESP_ERR_NOT_FOUND;
+            break;
+        }
+        len += (size_t)n;
+        buf[len] = '\0';
+
+        char *key = buf;
+        while ((key = strstr(key, OTA_DOWNLOAD_TAG_KEY)) != NULL) {
+            if (key > buf && key[-1] == '\\') {
+                key++;
+                continue;
+            }
+            char *p = key + strlen(OTA_DOWNLOAD_TAG_KEY);
+            p += strspn(p, " \t\r\n");
+            if (*p == ':') {
+                p++;
+                p += strspn(p, " \t\r\n");
+            }
+            char *end = (*p == '"') ? strchr(p + 1, '"') : NULL;
+            if (end == NULL) {
+                // Waarde loopt door in het volgende stuk
+                break;
+            }
+            size_t tag_len = (size_t)(end - p - 1);
+            if (tag_len == 0 || tag_len >= tag_cap || memchr(p + 1, '\\', tag_len) != NULL) {
+                err = ESP_ERR_INVALID_RESPONSE;
+            } else {
+                memcpy(out_tag, p + 1, tag_len);
+                out_tag[tag_len] = '\0';
+            }
+            found = true;
+            break;
+        }
+
+        if (!found && len > OTA_DOWNLOAD_TAG_WINDOW) {
+            memmove(buf, buf + len - OTA_DOWNLOAD_TAG_WINDOW, OTA_DOWNLOAD_TAG_WINDOW);
+            len = OTA_DOWNLOAD_TAG_WINDOW;
+        }
+    }
+
+    // Rest van de response niet meer nodig
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+static bool parse_version(const char *text, int out[3]) {
+    if (text == NULL) {
+        return false;
+    }
+    if (*text == 'v' || *text == 'V') {
+        text++;
+    }
+    return sscanf(text, "%d.%d.%d", &out[0], &out[1], &out[2]) == 3;
+}
+
+esp_err_t ota_download_check(const char *repo, bool prerelease, const char *current_version,
+                             ota_download_release_t *out_release, bool *out_newer) {
+    char url[OTA_DOWNLOAD_URL_MAX_LEN];
+    char tag[sizeof(out_release->tag)];
+
+    if (repo == NULL || repo[0] == '\0' || out_release == NULL || out_newer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_newer = false;
+
+    // Met pre-releases is de nieuwste release het eerste element van de lijst
+    snprintf(url, sizeof(url), "https://api.github.com/repos/%s/releases%s", repo,
+             prerelease ? "?per_page=1" : "/latest");
+    ESP_LOGI(DOWNLOAD_TAG, "Checking updates for repo %s (pre=%d)", repo, prerelease);
+
+    // Assets worden op naam opgehaald (image_open), alleen de tag is nodig
+    esp_err_t err = http_find_release_tag(url, tag, sizeof(tag));
+    int latest[3];
+    int current[3] = {0, 0, 0};
+
+    if (err != ESP_OK) {
+        ESP_LOGE(DOWNLOAD_TAG, "Failed to read release tag: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (!parse_version(tag, latest)) {
+        ESP_LOGE(DOWNLOAD_TAG, "No suitable release");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    strlcpy(out_release->tag, tag, sizeof(out_release->tag));
+    snprintf(out_release->version, sizeof(out_release->version), "%d.%d.%d",
+             latest[0], latest[1], latest[2]);
+
+    if (!parse_version(current_version, current)) {
+        ESP_LOGW(DOWNLOAD_TAG, "Invalid current firmware version, assuming 0.0.0");
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (latest[i] != current[i]) {
+            *out_newer = latest[i] > current[i];
+            break;
+        }
+    }
+
+    ESP_LOGI(DOWNLOAD_TAG, "Latest release version %s (running %s)", out_release->version,
+             current_version != NULL ? current_version : "?");
+    return ESP_OK;
+}
+
+static esp_err_t image_write(void *ctx, const void *data, size_t len) {
+    image_writer_t *writer = ctx;
+
+    // Hash loopt mee met elk geschreven blok; niets wordt twee keer gelezen
+    mbedtls_sha512_update(&writer->sha, data, len);
+    writer->written += len;
+    return esp_ota_write(writer->ota, data, len);
+}
+
+static esp_err_t download_signature(const char *repo, const char *tag, uint8_t *out_hash,
+                                    uint32_t *out_length) {
+    char url[OTA_DOWNLOAD_URL_MAX_LEN];
+    char sig[OTA_DOWNLOAD_SIG_MAX_LEN];
+    size_t len = 0;
+
+    snprintf(url, sizeof(url), "https://github.com/%s/releases/download/%s/main.bin.sig", repo, tag);
+    ESP_LOGI(DOWNLOAD_TAG, "Downloading signature from %s", url);
+
+    esp_err_t err = http_get_small(url, sig, sizeof(sig), &len);
+    if (err != ESP_OK) {
+        ESP_LOGE(DOWNLOAD_TAG, "Failed to download signature: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (len < OTA_DOWNLOAD_SIG_MIN_LEN) {
+        ESP_LOGE(DOWNLOAD_TAG, "Signature length %u unexpected", (unsigned)len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const uint8_t *p = (const uint8_t *)sig;
+    memcpy(out_hash, p, OTA_DOWNLOAD_SIG_HASH_LEN);
+    p += OTA_DOWNLOAD_SIG_HASH_LEN;
+    *out_length = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    return ESP_OK;
+}
+
+esp_err_t ota_download_image(const char *repo, const ota_download_release_t *release,
+                             ota_download_result_t *out_result) {
+    uint8_t expected_hash[OTA_DOWNLOAD_SIG_HASH_LEN];
+    uint8_t hash[64];
+    uint32_t expected_length = 0;
+
+    if (repo == NULL || release == NULL || out_result == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out_result, 0, sizeof(*out_result));
+    int64_t start_us = esp_timer_get_time();
+
+    esp_err_t err = download_signature(repo, release->tag, expected_hash, &expected_length);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_partition_t *target = esp_ota_get_next_update_partition(NULL);
+    if (target == NULL) {
+        ESP_LOGE(DOWNLOAD_TAG, "No OTA partition available");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (expected_length > target->size) {
+        ESP_LOGE(DOWNLOAD_TAG, "Image of %" PRIu32 " bytes does not fit in '%s'", expected_length, target->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ESP_LOGI(DOWNLOAD_TAG, "Using OTA partition '%s' at 0x%" PRIx32 " (%" PRIu32 " bytes)",
+             target->label, target->address, target->size);
+
+    image_writer_t writer = { 0 };
+    mbedtls_sha512_init(&writer.sha);
+    mbedtls_sha512_starts(&writer.sha, 1);   // 1 = SHA-384
+
+    // Sequential writes: sectoren worden pas gewist op het moment dat ze nodig zijn
+    err = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &writer.ota);
+    if (err != ESP_OK) {
+        mbedtls_sha512_free(&writer.sha);
+        return err;
+    }
+
+    ota_stream_t *stream = NULL;
+    esp_http_client_handle_t client = NULL;
+    uint8_t *chunk = malloc(OTA_DOWNLOAD_CHUNK_SIZE);
+
+    err = (chunk != NULL) ? ota_stream_begin(running, image_write, &writer, &stream) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK) {
+        err = image_open(repo, release->tag, running, &client);
+    }
+
+    while (err == ESP_OK) {
+        int n = esp_http_client_read(client, (char *)chunk, OTA_DOWNLOAD_CHUNK_SIZE);
+        if (n < 0) {
+            err = ESP_FAIL;
+        } else if (n == 0) {
+            break;
+        } else {
+            err = ota_stream_feed(stream, chunk, (size_t)n);
+        }
+    }
+    if (err == ESP_OK && !esp_http_client_is_complete_data_received(client)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (client != NULL) {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+    }
+    free(chunk);
+
+    if (stream != NULL) {
+        esp_err_t finish_err = ota_stream_finish(stream, &out_result->stream);
+        if (err == ESP_OK) {
+            err = finish_err;
+        }
+    }
+    mbedtls_sha512_finish(&writer.sha, hash);
+    mbedtls_sha512_free(&writer.sha);
+
+    if (err == ESP_OK && writer.written != expected_length) {
+        ESP_LOGE(DOWNLOAD_TAG, "Image length mismatch: expected %" PRIu32 " got %" PRIu32,
+                 expected_length, writer.written);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK && memcmp(hash, expected_hash, OTA_DOWNLOAD_SIG_HASH_LEN) != 0) {
+        ESP_LOGE(DOWNLOAD_TAG, "SHA384 mismatch");
+        err = ESP_ERR_INVALID_CRC;
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(DOWNLOAD_TAG, "OTA failed: %s", esp_err_to_name(err));
+        esp_ota_abort(writer.ota);
+        return err;
+    }
+
+    // esp_ota_end() valideert daarnaast het image formaat (en secure boot indien actief)
+    err = esp_ota_end(writer.ota);
+    if (err != ESP_OK) {
+        ESP_LOGE(DOWNLOAD_TAG, "Image validation failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    out_result->partition = target;
+    out_result->elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    ESP_LOGI(DOWNLOAD_TAG, "Signature verified: %" PRIu32 " bytes in %" PRIu32 " ms (downloaded %" PRIu32
+             ", from base %" PRIu32 ")", writer.written, out_result->elapsed_ms,
+             out_result->stream.in_bytes, out_result->stream.base_bytes);
+    return ESP_OK;
+}
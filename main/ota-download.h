@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#include "ota-stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_DOWNLOAD_VERSION_MAX_LEN 32
+
+typedef struct {
+    char tag[OTA_DOWNLOAD_VERSION_MAX_LEN];       // release tag zoals op GitHub
+    char version[OTA_DOWNLOAD_VERSION_MAX_LEN];   // genormaliseerd "x.y.z"
+} ota_download_release_t;
+
+typedef struct {
+    const esp_partition_t *partition;   // geschreven en gevalideerde ota_x partition
+    ota_stream_stats_t stream;
+    uint32_t elapsed_ms;
+} ota_download_result_t;
+
+// Zoek de nieuwste release van 'repo' (owner/name, zoals fwcfg/repo van de
+// factory LCM). '*out_newer' is true als die nieuwer is dan 'current_version'.
+esp_err_t ota_download_check(const char *repo, bool prerelease, const char *current_version,
+                             ota_download_release_t *out_release, bool *out_newer);
+
+// Stream main.bin van 'release' in de inactieve ota_x partition, met
+// CONFIG_LCM_OTA_COMPRESSED_DELTA bij voorkeur als delta of zlib asset. De SHA-384
+// en lengte uit main.bin.sig worden tijdens het schrijven bijgehouden en vóór
+// esp_ota_end() gecontroleerd; de boot partition blijft ongewijzigd.
+esp_err_t ota_download_image(const char *repo, const ota_download_release_t *release,
+                             ota_download_result_t *out_result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,382 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#if __has_include("miniz.h")
+#include "miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
+
+#include "ota-stream.h"
+
+static const char *STREAM_TAG = "OTA_STREAM";
+
+#define OTA_STREAM_DELTA_HEADER_LEN (4 + 4 + 32)
+#define OTA_STREAM_ZLIB_CMF 0x78
+#define OTA_STREAM_IMAGE_MAGIC 0xE9
+
+typedef enum {
+    PAYLOAD_DETECT = 0,
+    PAYLOAD_RAW,
+    PAYLOAD_DELTA_HEADER,
+    PAYLOAD_DELTA_OP,
+    PAYLOAD_DELTA_ARGS,
+    PAYLOAD_DELTA_INSERT,
+    PAYLOAD_DELTA_DONE,
+} payload_state_t;
+
+struct ota_stream {
+    const esp_partition_t *base;
+    ota_stream_write_t write;
+    void *ctx;
+
+    // Transportlaag: nog onbekend, plat of zlib
+    bool transport_known;
+    bool compressed;
+    bool inflate_done;
+    tinfl_decompressor *inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+
+    // Payload: ruw image of delta patch
+    payload_state_t state;
+    uint8_t header[OTA_STREAM_DELTA_HEADER_LEN];
+    size_t header_len;
+    uint8_t op;
+    uint8_t args[8];
+    size_t args_len;
+    uint32_t insert_left;
+    uint32_t target_size;
+
+    uint8_t block[OTA_STREAM_BLOCK_SIZE];
+    size_t block_len;
+
+    ota_stream_stats_t stats;
+};
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static esp_err_t block_flush(ota_stream_t *s) {
+    if (s->block_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = s->write(s->ctx, s->block, s->block_len);
+    s->stats.out_bytes += s->block_len;
+    s->block_len = 0;
+    return err;
+}
+
+static esp_err_t block_push(ota_stream_t *s, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t take = OTA_STREAM_BLOCK_SIZE - s->block_len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(s->block + s->block_len, data, take);
+        s->block_len += take;
+        data += take;
+        len -= take;
+        if (s->block_len == OTA_STREAM_BLOCK_SIZE) {
+            esp_err_t err = block_flush(s);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// COPY: lees rechtstreeks uit de base partition in het uitvoerblok
+static esp_err_t delta_copy(ota_stream_t *s, uint32_t offset, uint32_t len) {
+    if (s->base == NULL || offset > s->base->size || len > s->base->size - offset) {
+        ESP_LOGE(STREAM_TAG, "COPY %" PRIu32 "+%" PRIu32 " outside base partition", offset, len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s->stats.base_bytes += len;
+    while (len > 0) {
+        size_t take = OTA_STREAM_BLOCK_SIZE - s->block_len;
+        if (take > len) {
+            take = len;
+        }
+        esp_err_t err = esp_partition_read(s->base, offset, s->block + s->block_len, take);
+        if (err != ESP_OK) {
+            return err;
+        }
+        s->block_len += take;
+        offset += take;
+        len -= take;
+        if (s->block_len == OTA_STREAM_BLOCK_SIZE) {
+            err = block_flush(s);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t delta_check_header(ota_stream_t *s) {
+    uint8_t base_sha[32];
+
+    s->target_size = read_le32(s->header + 4);
+    if (s->base == NULL) {
+        ESP_LOGE(STREAM_TAG, "Delta patch without base partition");
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_partition_get_sha256(s->base, base_sha);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (memcmp(base_sha, s->header + 8, sizeof(base_sha)) != 0) {
+        ESP_LOGE(STREAM_TAG, "Delta patch was made for a different base image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    ESP_LOGI(STREAM_TAG, "Applying delta patch against '%s' (target %" PRIu32 " bytes)",
+             s->base->label, s->target_size);
+    return ESP_OK;
+}
+
+// Payloadlaag: krijgt de (eventueel uitgepakte) bytes in volgorde binnen
+static esp_err_t payload_feed(ota_stream_t *s, const uint8_t *p, size_t n) {
+    esp_err_t err = ESP_OK;
+
+    while (n > 0 && err == ESP_OK) {
+        switch (s->state) {
+        case PAYLOAD_DETECT:
+            if (p[0] == OTA_STREAM_IMAGE_MAGIC) {
+                s->state = PAYLOAD_RAW;
+            } else if (p[0] == (uint8_t)OTA_STREAM_DELTA_MAGIC[0]) {
+                s->stats.delta = true;
+                s->state = PAYLOAD_DELTA_HEADER;
+            } else {
+                ESP_LOGE(STREAM_TAG, "Unknown update payload (first byte 0x%02x)", p[0]);
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            break;
+        case PAYLOAD_RAW:
+            err = block_push(s, p, n);
+            n = 0;
+            break;
+        case PAYLOAD_DELTA_HEADER: {
+            size_t take = OTA_STREAM_DELTA_HEADER_LEN - s->header_len;
+            if (take > n) {
+                take = n;
+            }
+            memcpy(s->header + s->header_len, p, take);
+            s->header_len += take;
+            p += take;
+            n -= take;
+            if (s->header_len == OTA_STREAM_DELTA_HEADER_LEN) {
+                if (memcmp(s->header, OTA_STREAM_DELTA_MAGIC, 4) != 0) {
+                    ESP_LOGE(STREAM_TAG, "Bad delta patch magic");
+                    return ESP_ERR_NOT_SUPPORTED;
+                }
+                err = delta_check_header(s);
+                s->state = PAYLOAD_DELTA_OP;
+            }
+            break;
+        }
+        case PAYLOAD_DELTA_OP:
+            s->op = *p++;
+            n--;
+            s->args_len = 0;
+            if (s->op == OTA_STREAM_OP_END) {
+                s->state = PAYLOAD_DELTA_DONE;
+            } else if (s->op == OTA_STREAM_OP_COPY || s->op == OTA_STREAM_OP_INSERT) {
+                s->state = PAYLOAD_DELTA_ARGS;
+            } else {
+                ESP_LOGE(STREAM_TAG, "Unknown delta op 0x%02x", s->op);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            break;
+        case PAYLOAD_DELTA_ARGS: {
+            size_t need = (s->op == OTA_STREAM_OP_COPY) ? 8 : 4;
+            size_t take = need - s->args_len;
+            if (take > n) {
+                take = n;
+            }
+            memcpy(s->args + s->args_len, p, take);
+            s->args_len += take;
+            p += take;
+            n -= take;
+            if (s->args_len < need) {
+                break;
+            }
+            if (s->op == OTA_STREAM_OP_COPY) {
+                err = delta_copy(s, read_le32(s->args), read_le32(s->args + 4));
+                s->state = PAYLOAD_DELTA_OP;
+            } else {
+                s->insert_left = read_le32(s->args);
+                s->state = (s->insert_left > 0) ? PAYLOAD_DELTA_INSERT : PAYLOAD_DELTA_OP;
+            }
+            break;
+        }
+        case PAYLOAD_DELTA_INSERT: {
+            size_t take = (n < s->insert_left) ? n : s->insert_left;
+            err = block_push(s, p, take);
+            s->insert_left -= take;
+            p += take;
+            n -= take;
+            if (s->insert_left == 0) {
+                s->state = PAYLOAD_DELTA_OP;
+            }
+            break;
+        }
+        case PAYLOAD_DELTA_DONE:
+        default:
+            ESP_LOGE(STREAM_TAG, "Data after end of delta patch");
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return err;
+}
+
+static esp_err_t inflate_feed(ota_stream_t *s, const uint8_t *p, size_t n) {
+    const mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT |
+                            TINFL_FLAG_COMPUTE_ADLER32;
+
+    while (!s->inflate_done) {
+        size_t in_len = n;
+        size_t out_len = TINFL_LZ_DICT_SIZE - s->dict_ofs;
+        tinfl_status status = tinfl_decompress(s->inflator, p, &in_len, s->dict,
+                                               s->dict + s->dict_ofs, &out_len, flags);
+        p += in_len;
+        n -= in_len;
+
+        if (out_len > 0) {
+            esp_err_t err = payload_feed(s, s->dict + s->dict_ofs, out_len);
+            if (err != ESP_OK) {
+                return err;
+            }
+            s->dict_ofs = (s->dict_ofs + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(STREAM_TAG, "Inflate failed (%d)", (int)status);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            s->inflate_done = true;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && n == 0) {
+            return ESP_OK;
+        }
+    }
+
+    if (n > 0) {
+        ESP_LOGE(STREAM_TAG, "Data after end of compressed stream");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_begin(const esp_partition_t *base, ota_stream_write_t write, void *ctx,
+                           ota_stream_t **out_stream) {
+    if (write == NULL || out_stream == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ota_stream_t *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->base = base;
+    s->write = write;
+    s->ctx = ctx;
+    s->state = PAYLOAD_DETECT;
+
+    *out_stream = s;
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_feed(ota_stream_t *s, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    if (s == NULL || (data == NULL && len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    s->stats.in_bytes += len;
+
+    if (!s->transport_known) {
+        s->transport_known = true;
+        s->compressed = (p[0] == OTA_STREAM_ZLIB_CMF);
+        if (s->compressed) {
+            // Venster alleen voor gecomprimeerde streams alloceren
+            s->inflator = malloc(sizeof(tinfl_decompressor));
+            s->dict = malloc(TINFL_LZ_DICT_SIZE);
+            if (s->inflator == NULL || s->dict == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            tinfl_init(s->inflator);
+            s->stats.compressed = true;
+        }
+    }
+
+    return s->compressed ? inflate_feed(s, p, len) : payload_feed(s, p, len);
+}
+
+esp_err_t ota_stream_finish(ota_stream_t *s, ota_stream_stats_t *out_stats) {
+    if (s == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = block_flush(s);
+    if (err == ESP_OK) {
+        if (s->compressed && !s->inflate_done) {
+            ESP_LOGE(STREAM_TAG, "Compressed stream truncated");
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (s->state == PAYLOAD_DETECT) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (s->stats.delta &&
+                   (s->state != PAYLOAD_DELTA_DONE || s->stats.out_bytes != s->target_size)) {
+            ESP_LOGE(STREAM_TAG, "Delta patch incomplete (%" PRIu32 " of %" PRIu32 " bytes)",
+                     s->stats.out_bytes, s->target_size);
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    if (out_stats != NULL) {
+        *out_stats = s->stats;
+    }
+    ota_stream_abort(s);
+    return err;
+}
+
+void ota_stream_abort(ota_stream_t *s) {
+    if (s == NULL) {
+        return;
+    }
+    free(s->inflator);
+    free(s->dict);
+    free(s);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming decoder voor update images. Het formaat wordt uit de eerste bytes
+// herkend en mag gestapeld zijn:
+//   - zlib stream (0x78 ..)       -> wordt eerst uitgepakt
+//   - ESP app image (0xE9 ..)     -> ongewijzigd doorgegeven
+//   - delta patch ("SPD1")        -> toegepast tegen 'base' (de draaiende app)
+// De delta patch heeft een header { "SPD1", u32 target_size, u8 base_sha256[32] }
+// gevolgd door ops (little endian):
+//   0x01 COPY   u32 offset, u32 len    bytes uit de base partition
+//   0x02 INSERT u32 len, <len bytes>   nieuwe bytes uit de stream
+//   0x00 END
+// base_sha256 is de hash die esp_partition_get_sha256() voor de base geeft.
+// Uitvoer gaat in blokken van OTA_STREAM_BLOCK_SIZE naar 'write'; het RAM
+// gebruik is één blok plus, bij zlib, het 32 KB inflate venster.
+
+#define OTA_STREAM_BLOCK_SIZE 4096
+
+#define OTA_STREAM_DELTA_MAGIC "SPD1"
+
+typedef enum {
+    OTA_STREAM_OP_END = 0x00,
+    OTA_STREAM_OP_COPY = 0x01,
+    OTA_STREAM_OP_INSERT = 0x02,
+} ota_stream_op_t;
+
+typedef esp_err_t (*ota_stream_write_t)(void *ctx, const void *data, size_t len);
+
+typedef struct ota_stream ota_stream_t;
+
+typedef struct {
+    bool compressed;
+    bool delta;
+    uint32_t in_bytes;      // gedownloade bytes
+    uint32_t out_bytes;     // bytes van het resulterende image
+    uint32_t base_bytes;    // daarvan gekopieerd uit de base partition
+} ota_stream_stats_t;
+
+esp_err_t ota_stream_begin(const esp_partition_t *base, ota_stream_write_t write, void *ctx,
+                           ota_stream_t **out_stream);
+
+// Voer het volgende stuk van de download in; mag willekeurig groot zijn.
+esp_err_t ota_stream_feed(ota_stream_t *stream, const void *data, size_t len);
+
+// Schrijf het laatste blok en controleer dat de stream compleet is. Geeft de
+// stream in alle gevallen vrij.
+esp_err_t ota_stream_finish(ota_stream_t *stream, ota_stream_stats_t *out_stats);
+
+void ota_stream_abort(ota_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
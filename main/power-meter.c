@@ -0,0 +1,295 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/pulse_cnt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nvs.h>
+
+#include "power-meter.h"
+
+static const char *METER_TAG = "METER";
+
+#ifndef CONFIG_ESP_METER_INTERVAL_MS
+#define CONFIG_ESP_METER_INTERVAL_MS 2000
+#endif
+#ifndef CONFIG_ESP_METER_POWER_MW_PER_HZ
+#define CONFIG_ESP_METER_POWER_MW_PER_HZ 1500
+#endif
+#ifndef CONFIG_ESP_METER_VOLTAGE_MV_PER_HZ
+#define CONFIG_ESP_METER_VOLTAGE_MV_PER_HZ 450
+#endif
+#ifndef CONFIG_ESP_METER_CURRENT_UA_PER_HZ
+#define CONFIG_ESP_METER_CURRENT_UA_PER_HZ 15000
+#endif
+#ifndef CONFIG_ESP_METER_IN_USE_THRESHOLD_W
+#define CONFIG_ESP_METER_IN_USE_THRESHOLD_W 2
+#endif
+#ifndef CONFIG_ESP_METER_CHECKPOINT_WH
+#define CONFIG_ESP_METER_CHECKPOINT_WH 50
+#endif
+
+#define METER_TASK_STACK_SIZE   3072
+#define METER_TASK_PRIORITY     (tskIDLE_PRIORITY + 1)
+#define METER_PCNT_HIGH_LIMIT   32000
+// Na het omschakelen van SEL is de eerste CF1 periode onbetrouwbaar (HLW8012 /
+// BL0937 datasheet); zo lang na de switch tellen CF1 pulsen niet mee. Minimaal
+// interval 500 ms, dus het meetvenster blijft ten minste 300 ms.
+#define METER_SEL_SETTLE_MS     200
+// Ruim voor int overflow van de geaccumuleerde PCNT count terugzetten
+#define METER_PCNT_CLEAR_AT     (1 << 30)
+
+static const uint32_t k_meter_energy_magic = 0xC0DEE4E6;
+static const char *k_meter_namespace = "meter";
+static const char *k_meter_energy_key = "energy_mwh";
+
+// Warm resets behouden de energie stand zonder flash I/O; NVS wordt pas na
+// CONFIG_ESP_METER_CHECKPOINT_WH extra verbruik bijgewerkt.
+RTC_DATA_ATTR static struct {
+    uint32_t magic;
+    uint64_t energy_mwh;
+} s_meter_rtc;
+
+typedef struct {
+    pcnt_unit_handle_t unit;
+    int last_count;
+} meter_counter_t;
+
+static meter_counter_t s_cf;
+static meter_counter_t s_cf1;
+static int s_sel_gpio = -1;
+static bool s_sel_voltage = false;
+static power_meter_callback_t s_callback = NULL;
+static power_meter_reading_t s_reading;
+static portMUX_TYPE s_reading_lock = portMUX_INITIALIZER_UNLOCKED;
+static double s_energy_mwh = 0;
+static uint64_t s_checkpoint_mwh = 0;
+
+static esp_err_t meter_counter_init(meter_counter_t *counter, int gpio) {
+    pcnt_unit_config_t unit_cfg = {
+        .low_limit = -1,
+        .high_limit = METER_PCNT_HIGH_LIMIT,
+        .flags.accum_count = 1,
+    };
+    esp_err_t err = pcnt_new_unit(&unit_cfg, &counter->unit);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    pcnt_glitch_filter_config_t filter = {
+        .max_glitch_ns = 1000,
+    };
+    pcnt_unit_set_glitch_filter(counter->unit, &filter);
+
+    pcnt_chan_config_t chan_cfg = {
+        .edge_gpio_num = gpio,
+        .level_gpio_num = -1,
+    };
+    pcnt_channel_handle_t chan = NULL;
+    err = pcnt_new_channel(counter->unit, &chan_cfg, &chan);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    pcnt_channel_set_edge_action(chan, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+    pcnt_unit_add_watch_point(counter->unit, METER_PCNT_HIGH_LIMIT);
+
+    err = pcnt_unit_enable(counter->unit);
+    if (err == ESP_OK) {
+        err = pcnt_unit_clear_count(counter->unit);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_start(counter->unit);
+    }
+    counter->last_count = 0;
+    return err;
+}
+
+// Pulsen sinds de vorige aanroep
+static uint32_t meter_counter_delta(meter_counter_t *counter) {
+    int count = 0;
+    if (pcnt_unit_get_count(counter->unit, &count) != ESP_OK) {
+        return 0;
+    }
+
+    uint32_t delta = (count >= counter->last_count) ? (uint32_t)(count - counter->last_count) : 0U;
+    counter->last_count = count;
+
+    if (count >= METER_PCNT_CLEAR_AT) {
+        pcnt_unit_clear_count(counter->unit);
+        counter->last_count = 0;
+    }
+    return delta;
+}
+
+static void meter_set_sel(bool voltage) {
+    s_sel_voltage = voltage;
+#if CONFIG_ESP_METER_SEL_INVERTED
+    gpio_set_level(s_sel_gpio, voltage ? 0 : 1);
+#else
+    gpio_set_level(s_sel_gpio, voltage ? 1 : 0);
+#endif
+}
+
+static void meter_load_energy(void) {
+    uint64_t stored = 0;
+    nvs_handle_t handle;
+    if (nvs_open(k_meter_namespace, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u64(handle, k_meter_energy_key, &stored);
+        nvs_close(handle);
+    }
+
+    if (s_meter_rtc.magic != k_meter_energy_magic) {
+        s_meter_rtc.magic = k_meter_energy_magic;
+        s_meter_rtc.energy_mwh = 0;
+    }
+
+    uint64_t energy = (s_meter_rtc.energy_mwh > stored) ? s_meter_rtc.energy_mwh : stored;
+    s_energy_mwh = (double)energy;
+    s_checkpoint_mwh = stored;
+}
+
+static void meter_checkpoint_energy(void) {
+    uint64_t energy = (uint64_t)s_energy_mwh;
+    s_meter_rtc.energy_mwh = energy;
+
+    if (energy < s_checkpoint_mwh + (uint64_t)CONFIG_ESP_METER_CHECKPOINT_WH * 1000ULL) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(k_meter_namespace, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u64(handle, k_meter_energy_key, energy);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(METER_TAG, "Failed to checkpoint energy: %s", esp_err_to_name(err));
+        return;
+    }
+    s_checkpoint_mwh = energy;
+}
+
+static void meter_task(void *args) {
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t last_us = esp_timer_get_time();
+    int64_t cf1_start_us = last_us;
+    power_meter_reading_t reading = { 0 };
+
+    for (;;) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_ESP_METER_INTERVAL_MS));
+
+        int64_t now_us = esp_timer_get_time();
+        float seconds = (float)(now_us - last_us) / 1000000.0f;
+        last_us = now_us;
+        if (seconds <= 0.0f) {
+            continue;
+        }
+
+        float cf_hz = (float)meter_counter_delta(&s_cf) / seconds;
+        // CF1 heeft een eigen venster: van einde settle tot nu
+        float cf1_seconds = (float)(now_us - cf1_start_us) / 1000000.0f;
+        float cf1_hz = (cf1_seconds > 0.0f) ? (float)meter_counter_delta(&s_cf1) / cf1_seconds : 0.0f;
+
+        reading.power_w = cf_hz * (float)CONFIG_ESP_METER_POWER_MW_PER_HZ / 1000.0f;
+        if (s_sel_voltage) {
+            reading.voltage_v = cf1_hz * (float)CONFIG_ESP_METER_VOLTAGE_MV_PER_HZ / 1000.0f;
+        } else {
+            reading.current_a = cf1_hz * (float)CONFIG_ESP_METER_CURRENT_UA_PER_HZ / 1000000.0f;
+        }
+
+        // CF1 afwisselend spanning en stroom laten meten. De pulsen uit de
+        // settle periode na het omschakelen worden weggegooid; het volgende
+        // CF1 venster begint pas daarna.
+        meter_set_sel(!s_sel_voltage);
+        vTaskDelay(pdMS_TO_TICKS(METER_SEL_SETTLE_MS));
+        meter_counter_delta(&s_cf1);
+        cf1_start_us = esp_timer_get_time();
+
+        s_energy_mwh += (double)reading.power_w * (double)seconds / 3.6;
+        reading.energy_kwh = (float)(s_energy_mwh / 1000000.0);
+        reading.in_use = reading.power_w >= (float)CONFIG_ESP_METER_IN_USE_THRESHOLD_W;
+        meter_checkpoint_energy();
+
+        taskENTER_CRITICAL(&s_reading_lock);
+        s_reading = reading;
+        taskEXIT_CRITICAL(&s_reading_lock);
+
+        if (s_callback != NULL) {
+            s_callback(&reading);
+        }
+    }
+}
+
+esp_err_t power_meter_init(int cf_gpio, int cf1_gpio, int sel_gpio, power_meter_callback_t callback) {
+    if (cf_gpio < 0 || cf1_gpio < 0 || sel_gpio < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_callback = callback;
+    s_sel_gpio = sel_gpio;
+
+    gpio_reset_pin(sel_gpio);
+    gpio_set_direction(sel_gpio, GPIO_MODE_OUTPUT);
+    meter_set_sel(false);
+
+    esp_err_t err = meter_counter_init(&s_cf, cf_gpio);
+    if (err == ESP_OK) {
+        err = meter_counter_init(&s_cf1, cf1_gpio);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(METER_TAG, "Failed to set up pulse counters: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    meter_load_energy();
+
+    if (xTaskCreate(meter_task, "power_meter", METER_TASK_STACK_SIZE, NULL,
+                    METER_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(METER_TAG, "Metering on CF=%d CF1=%d SEL=%d (energy %.3f kWh)",
+             cf_gpio, cf1_gpio, sel_gpio, s_energy_mwh / 1000000.0);
+    return ESP_OK;
+}
+
+void power_meter_get_reading(power_meter_reading_t *out_reading) {
+    if (out_reading == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_reading_lock);
+    *out_reading = s_reading;
+    taskEXIT_CRITICAL(&s_reading_lock);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+// Eve (Elgato) energy characteristics; understood by the Eve app and most
+// HomeKit tools that show metering data.
+// The limits are const compound literals and so live in flash (rodata);
+// esp32-homekit declares the fields as plain float * but only reads them.
+#define POWER_METER_LIMIT(_value) ((float *)(const float[]) {_value})
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_POWER "E863F10D-079E-48FF-8F27-9C2605A29F52"
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_EVE_POWER(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_POWER, \
+    .description = "Consumption", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_notify, \
+    .min_value = POWER_METER_LIMIT(0), \
+    .max_value = POWER_METER_LIMIT(65535), \
+    .min_step = POWER_METER_LIMIT(0.1), \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_TOTAL_ENERGY "E863F10C-079E-48FF-8F27-9C2605A29F52"
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_EVE_TOTAL_ENERGY(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_TOTAL_ENERGY, \
+    .description = "Total Consumption", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_notify, \
+    .min_value = POWER_METER_LIMIT(0), \
+    .max_value = POWER_METER_LIMIT(4294967295), \
+    .min_step = POWER_METER_LIMIT(0.001), \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_VOLTAGE "E863F10A-079E-48FF-8F27-9C2605A29F52"
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_EVE_VOLTAGE(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_VOLTAGE, \
+    .description = "Voltage", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_notify, \
+    .min_value = POWER_METER_LIMIT(0), \
+    .max_value = POWER_METER_LIMIT(300), \
+    .min_step = POWER_METER_LIMIT(0.1), \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_CURRENT "E863F126-079E-48FF-8F27-9C2605A29F52"
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_EVE_CURRENT(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_EVE_CURRENT, \
+    .description = "Electric Current", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+        | homekit_permissions_notify, \
+    .min_value = POWER_METER_LIMIT(0), \
+    .max_value = POWER_METER_LIMIT(20), \
+    .min_step = POWER_METER_LIMIT(0.01), \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    float power_w;
+    float voltage_v;
+    float current_a;
+    float energy_kwh;     // geaccumuleerd sinds factory reset
+    bool in_use;          // power_w boven CONFIG_ESP_METER_IN_USE_THRESHOLD_W
+} power_meter_reading_t;
+
+// Aangeroepen vanuit de meter task na elke meting
+typedef void (*power_meter_callback_t)(const power_meter_reading_t *reading);
+
+// Start de PCNT units voor CF/CF1 (SEL schakelt CF1 tussen spanning en stroom)
+// en de periodieke low-priority meet task.
+esp_err_t power_meter_init(int cf_gpio, int cf1_gpio, int sel_gpio, power_meter_callback_t callback);
+
+// Laatste meting (nullen zolang er nog niet gemeten is)
+void power_meter_get_reading(power_meter_reading_t *out_reading);
+
+#ifdef __cplusplus
+}
+#endif
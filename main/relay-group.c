@@ -0,0 +1,123 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <esp_log.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <soc/soc_caps.h>
+#if SOC_DEDICATED_GPIO_SUPPORTED
+#include <driver/dedic_gpio.h>
+#endif
+
+#include "relay-group.h"
+
+static const char *GROUP_TAG = "RELAY_GROUP";
+
+static const relay_channel_desc_t *s_channels = NULL;
+static size_t s_count = 0;
+static uint32_t s_all_mask = 0;
+
+#if SOC_DEDICATED_GPIO_SUPPORTED
+static dedic_gpio_bundle_handle_t s_bundle = NULL;
+#endif
+// Fallback: pinnen één voor één, maar zonder onderbreking door andere taken/ISRs
+static portMUX_TYPE s_write_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void relay_group_write_serial(uint32_t mask, uint32_t value) {
+    portENTER_CRITICAL(&s_write_lock);
+    for (size_t i = 0; i < s_count; ++i) {
+        if ((mask & (1U << i)) != 0U) {
+            gpio_set_level(s_channels[i].gpio, (value & (1U << i)) ? 1 : 0);
+        }
+    }
+    portEXIT_CRITICAL(&s_write_lock);
+}
+
+esp_err_t relay_group_init(const relay_channel_desc_t *channels, size_t count, uint32_t initial_mask) {
+    if (channels == NULL || count == 0 || count > RELAY_GROUP_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_channels = channels;
+    s_count = count;
+    s_all_mask = (1U << count) - 1U;
+
+    for (size_t i = 0; i < count; ++i) {
+        gpio_reset_pin(channels[i].gpio);
+        gpio_set_direction(channels[i].gpio, GPIO_MODE_OUTPUT);
+    }
+    relay_group_write_serial(s_all_mask, initial_mask);
+
+#if SOC_DEDICATED_GPIO_SUPPORTED
+    if (count > 1) {
+        int gpios[RELAY_GROUP_MAX_CHANNELS];
+        for (size_t i = 0; i < count; ++i) {
+            gpios[i] = channels[i].gpio;
+        }
+
+        dedic_gpio_bundle_config_t bundle_cfg = {
+            .gpio_array = gpios,
+            .array_size = count,
+            .flags = {
+                .out_en = 1,
+            },
+        };
+        esp_err_t err = dedic_gpio_new_bundle(&bundle_cfg, &s_bundle);
+        if (err != ESP_OK) {
+            s_bundle = NULL;
+            ESP_LOGW(GROUP_TAG, "Dedicated GPIO bundle unavailable (%s); switching channels serially",
+                     esp_err_to_name(err));
+        } else {
+            // De bundle neemt de pinnen over: opnieuw de initiële state zetten
+            dedic_gpio_bundle_write(s_bundle, s_all_mask, initial_mask);
+        }
+    }
+#endif
+
+    ESP_LOGI(GROUP_TAG, "%u relay channel(s)", (unsigned)count);
+    return ESP_OK;
+}
+
+void relay_group_write(uint32_t mask, uint32_t value) {
+    mask &= s_all_mask;
+    if (mask == 0U) {
+        return;
+    }
+
+#if SOC_DEDICATED_GPIO_SUPPORTED
+    if (s_bundle != NULL) {
+        // Bit n in de bundle is channels[n]: één CPU register write
+        dedic_gpio_bundle_write(s_bundle, mask, value);
+        return;
+    }
+#endif
+    relay_group_write_serial(mask, value);
+}
+
+size_t relay_group_count(void) {
+    return s_count;
+}
+
+uint32_t relay_group_all_mask(void) {
+    return s_all_mask;
+}
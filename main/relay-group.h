@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RELAY_GROUP_MAX_CHANNELS 6
+
+typedef struct {
+    int gpio;
+    const char *name;     // naam van de OUTLET service
+} relay_channel_desc_t;
+
+// Configureer de relay GPIOs uit de channel tabel en zet ze in één keer op
+// 'initial_mask' (bit n = kanaal n aan). Bij meer dan één kanaal worden de
+// pinnen als dedicated GPIO bundle gekoppeld, zodat een group write één
+// register write is.
+esp_err_t relay_group_init(const relay_channel_desc_t *channels, size_t count, uint32_t initial_mask);
+
+// Zet alle kanalen in 'mask' tegelijk naar hun bit in 'value'; kanalen buiten
+// 'mask' blijven ongemoeid.
+void relay_group_write(uint32_t mask, uint32_t value);
+
+size_t relay_group_count(void);
+uint32_t relay_group_all_mask(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,367 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <nvs.h>
+
+#include "relay-state.h"
+
+static const char *STATE_TAG = "RELAY_STATE";
+
+#ifndef CONFIG_ESP_RELAY_STATE_COMMIT_DELAY_MS
+#define CONFIG_ESP_RELAY_STATE_COMMIT_DELAY_MS 5000
+#endif
+#ifndef CONFIG_ESP_RELAY_JOURNAL_PARTITION
+#define CONFIG_ESP_RELAY_JOURNAL_PARTITION "relay_state"
+#endif
+
+#if CONFIG_ESP_RELAY_POWER_ON_ON
+#define RELAY_POWER_ON_MODE RELAY_POWER_ON_ON
+#elif CONFIG_ESP_RELAY_POWER_ON_LAST
+#define RELAY_POWER_ON_MODE RELAY_POWER_ON_LAST
+#else
+#define RELAY_POWER_ON_MODE RELAY_POWER_ON_OFF
+#endif
+
+// Append-only journal: entries van 8 bytes achter elkaar in gewiste flash. De
+// nieuwste geldige entry (hoogste seq) is de state; een sector wordt pas gewist
+// als de schrijfpositie hem binnenloopt, zodat de vorige sector de laatste
+// state altijd bewaart (ook bij stroomuitval tijdens het wissen).
+#define JOURNAL_ENTRY_MAGIC  0x5A
+#define JOURNAL_SCAN_CHUNK   32
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint8_t state;            // bit n = kanaal n
+    uint8_t magic;
+    uint16_t crc;
+} journal_entry_t;
+
+_Static_assert(sizeof(journal_entry_t) == 8, "journal entry must stay 8 bytes");
+
+static const uint32_t k_state_rtc_magic = 0xC0DE5747;
+static const char *k_state_namespace = "relay";
+static const char *k_state_key = "state";
+
+// Warme resets: state zonder flash I/O terugzetten
+RTC_DATA_ATTR static struct {
+    uint32_t magic;
+    uint8_t state;
+    uint8_t inverted;         // ~state, vangt half geschreven RTC geheugen af
+} s_state_rtc;
+
+static const esp_partition_t *s_journal = NULL;
+static bool s_journal_scanned = false;
+static uint32_t s_journal_seq = 0;
+static size_t s_journal_offset = 0;     // volgende vrije entry
+static int s_committed_state = -1;      // -1: onbekend
+
+static esp_timer_handle_t s_commit_timer = NULL;
+static SemaphoreHandle_t s_commit_lock = NULL;
+static StaticSemaphore_t s_commit_lock_buf;
+static portMUX_TYPE s_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static int s_pending_state = -1;        // -1: niets uitgesteld
+static relay_state_stats_t s_stats;
+
+static uint16_t journal_entry_crc(const journal_entry_t *entry) {
+    return esp_rom_crc16_le(0, (const uint8_t *)entry, offsetof(journal_entry_t, crc));
+}
+
+static bool journal_entry_valid(const journal_entry_t *entry) {
+    return entry->magic == JOURNAL_ENTRY_MAGIC && entry->crc == journal_entry_crc(entry);
+}
+
+static bool journal_entry_erased(const journal_entry_t *entry) {
+    const uint8_t *bytes = (const uint8_t *)entry;
+    for (size_t i = 0; i < sizeof(*entry); ++i) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Eenmalige scan van de hele partitie; bepaalt de laatste state en de
+// schrijfpositie. Half geschreven entries (stroomuitval) worden overgeslagen.
+static void journal_scan(void) {
+    if (s_journal_scanned || s_journal == NULL) {
+        return;
+    }
+    s_journal_scanned = true;
+
+    journal_entry_t chunk[JOURNAL_SCAN_CHUNK];
+    bool found = false;
+    size_t newest_offset = 0;
+    journal_entry_t newest = {0};
+
+    for (size_t base = 0; base < s_journal->size; base += sizeof(chunk)) {
+        size_t len = s_journal->size - base;
+        if (len > sizeof(chunk)) {
+            len = sizeof(chunk);
+        }
+        if (esp_partition_read(s_journal, base, chunk, len) != ESP_OK) {
+            ESP_LOGW(STATE_TAG, "Journal read failed at 0x%x", (unsigned)base);
+            break;
+        }
+
+        for (size_t i = 0; i < len / sizeof(journal_entry_t); ++i) {
+            if (!journal_entry_valid(&chunk[i])) {
+                continue;
+            }
+            if (!found || (int32_t)(chunk[i].seq - newest.seq) > 0) {
+                newest = chunk[i];
+                newest_offset = base + i * sizeof(journal_entry_t);
+                found = true;
+            }
+        }
+    }
+
+    if (!found) {
+        s_journal_offset = 0;
+        s_journal_seq = 0;
+        return;
+    }
+
+    s_journal_seq = newest.seq;
+    s_committed_state = newest.state;
+
+    // Eerste gewiste slot na de nieuwste entry binnen dezelfde sector; op een
+    // sectorgrens wist de volgende append de sector zelf.
+    size_t offset = newest_offset + sizeof(journal_entry_t);
+    while (offset < s_journal->size && (offset % s_journal->erase_size) != 0) {
+        journal_entry_t slot;
+        if (esp_partition_read(s_journal, offset, &slot, sizeof(slot)) == ESP_OK &&
+                journal_entry_erased(&slot)) {
+            break;
+        }
+        offset += sizeof(journal_entry_t);
+    }
+    s_journal_offset = (offset >= s_journal->size) ? 0 : offset;
+}
+
+static esp_err_t journal_append(uint8_t mask) {
+    journal_scan();
+
+    if ((s_journal_offset % s_journal->erase_size) == 0) {
+        esp_err_t err = esp_partition_erase_range(s_journal, s_journal_offset, s_journal->erase_size);
+        if (err != ESP_OK) {
+            return err;
+        }
+        s_stats.sector_erases++;
+    }
+
+    journal_entry_t entry = {
+        .seq = s_journal_seq + 1,
+        .state = mask,
+        .magic = JOURNAL_ENTRY_MAGIC,
+    };
+    entry.crc = journal_entry_crc(&entry);
+
+    esp_err_t err = esp_partition_write(s_journal, s_journal_offset, &entry, sizeof(entry));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_journal_seq = entry.seq;
+    s_journal_offset += sizeof(entry);
+    if (s_journal_offset >= s_journal->size) {
+        s_journal_offset = 0;
+    }
+    return ESP_OK;
+}
+
+static int nvs_load_state(void) {
+    nvs_handle_t handle;
+    uint8_t value = 0;
+    int state = -1;
+
+    if (nvs_open(k_state_namespace, NVS_READONLY, &handle) == ESP_OK) {
+        if (nvs_get_u8(handle, k_state_key, &value) == ESP_OK) {
+            state = value;
+        }
+        nvs_close(handle);
+    }
+    return state;
+}
+
+static esp_err_t nvs_store_state(uint8_t mask) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(k_state_namespace, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(handle, k_state_key, mask);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    return err;
+}
+
+static void relay_state_commit(void) {
+    if (s_commit_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_commit_lock, portMAX_DELAY);
+
+    portENTER_CRITICAL(&s_pending_lock);
+    int pending = s_pending_state;
+    s_pending_state = -1;
+    portEXIT_CRITICAL(&s_pending_lock);
+
+    if (pending >= 0 && pending != s_committed_state) {
+        esp_err_t err = (s_journal != NULL) ? journal_append((uint8_t)pending)
+                                            : nvs_store_state((uint8_t)pending);
+        if (err == ESP_OK) {
+            s_committed_state = pending;
+            s_stats.committed++;
+            ESP_LOGI(STATE_TAG, "Relay state 0x%02x committed (%" PRIu32 " commits, %" PRIu32 " coalesced)",
+                     pending, s_stats.committed, s_stats.coalesced);
+        } else {
+            ESP_LOGW(STATE_TAG, "Failed to commit relay state: %s", esp_err_to_name(err));
+        }
+    }
+
+    xSemaphoreGive(s_commit_lock);
+}
+
+static void relay_state_commit_timer_cb(void *arg) {
+    relay_state_commit();
+}
+
+uint8_t relay_state_init(void) {
+    if (RELAY_POWER_ON_MODE == RELAY_POWER_ON_ON) {
+        return 0xFF;
+    }
+    if (RELAY_POWER_ON_MODE == RELAY_POWER_ON_OFF) {
+        return 0;
+    }
+
+    if (s_commit_lock == NULL) {
+        s_commit_lock = xSemaphoreCreateMutexStatic(&s_commit_lock_buf);
+    }
+
+    s_journal = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         CONFIG_ESP_RELAY_JOURNAL_PARTITION);
+    if (s_journal != NULL && s_journal->size < 2 * s_journal->erase_size) {
+        ESP_LOGW(STATE_TAG, "Journal partition '%s' needs at least two sectors; using NVS",
+                 s_journal->label);
+        s_journal = NULL;
+    }
+    s_stats.journal_partition = (s_journal != NULL);
+
+    if (s_commit_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = relay_state_commit_timer_cb,
+            .name = "relay_state",
+        };
+        if (esp_timer_create(&args, &s_commit_timer) != ESP_OK) {
+            s_commit_timer = NULL;
+        }
+    }
+
+    uint8_t mask = 0;
+    if (s_state_rtc.magic == k_state_rtc_magic &&
+            s_state_rtc.inverted == (uint8_t)~s_state_rtc.state) {
+        // Warme reset: flash blijft onaangeroerd tot de eerste commit
+        mask = s_state_rtc.state;
+        ESP_LOGI(STATE_TAG, "Restored relay state 0x%02x from RTC memory", mask);
+    } else {
+        if (s_journal != NULL) {
+            journal_scan();
+        } else {
+            s_committed_state = nvs_load_state();
+        }
+        mask = (s_committed_state >= 0) ? (uint8_t)s_committed_state : 0;
+        ESP_LOGI(STATE_TAG, "Restored relay state 0x%02x from %s", mask,
+                 s_journal != NULL ? "journal" : "NVS");
+
+        s_state_rtc.magic = k_state_rtc_magic;
+        s_state_rtc.state = mask;
+        s_state_rtc.inverted = (uint8_t)~s_state_rtc.state;
+    }
+
+    return mask;
+}
+
+void relay_state_record(uint8_t mask) {
+    if (RELAY_POWER_ON_MODE != RELAY_POWER_ON_LAST) {
+        return;
+    }
+
+    s_state_rtc.magic = k_state_rtc_magic;
+    s_state_rtc.state = mask;
+    s_state_rtc.inverted = (uint8_t)~s_state_rtc.state;
+
+    portENTER_CRITICAL(&s_pending_lock);
+    s_stats.recorded++;
+    if (s_pending_state >= 0) {
+        s_stats.coalesced++;
+    }
+    s_pending_state = mask;
+    portEXIT_CRITICAL(&s_pending_lock);
+
+    if (s_commit_timer == NULL) {
+        relay_state_commit();
+        return;
+    }
+
+    // Niet herstarten: de eerste wijziging bepaalt de deadline, zodat
+    // continu schakelen de commit niet eindeloos uitstelt.
+    if (!esp_timer_is_active(s_commit_timer)) {
+        esp_timer_start_once(s_commit_timer, (uint64_t)CONFIG_ESP_RELAY_STATE_COMMIT_DELAY_MS * 1000ULL);
+    }
+}
+
+void relay_state_flush(void) {
+    if (RELAY_POWER_ON_MODE != RELAY_POWER_ON_LAST) {
+        return;
+    }
+    if (s_commit_timer != NULL) {
+        esp_timer_stop(s_commit_timer);
+    }
+    relay_state_commit();
+}
+
+relay_power_on_mode_t relay_state_power_on_mode(void) {
+    return RELAY_POWER_ON_MODE;
+}
+
+void relay_state_get_stats(relay_state_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&s_pending_lock);
+    *out_stats = s_stats;
+    portEXIT_CRITICAL(&s_pending_lock);
+}
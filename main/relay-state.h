@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    RELAY_POWER_ON_OFF = 0,
+    RELAY_POWER_ON_ON,
+    RELAY_POWER_ON_LAST,
+} relay_power_on_mode_t;
+
+typedef struct {
+    uint32_t recorded;        // relay_state_record() aanroepen
+    uint32_t committed;       // daadwerkelijk naar flash geschreven entries
+    uint32_t coalesced;       // wijzigingen die binnen het commit-venster zijn samengevoegd
+    uint32_t sector_erases;
+    bool journal_partition;   // false: fallback naar NVS
+} relay_state_stats_t;
+
+// Initialiseer de journal en geef de relay state (bit n = kanaal n) na een
+// reset terug volgens CONFIG_ESP_RELAY_POWER_ON_*; "on" geeft alle bits. Bij
+// "last" lezen warme resets alleen RTC geheugen; alleen een koude start scant
+// het journal. Aanroepen vóór Wi-Fi.
+uint8_t relay_state_init(void);
+
+// Leg een nieuwe relay state vast (alleen bij "last"). RTC wordt direct
+// bijgewerkt, de flash write volgt na CONFIG_ESP_RELAY_STATE_COMMIT_DELAY_MS en
+// voegt tussenliggende wijzigingen samen.
+void relay_state_record(uint8_t mask);
+
+// Schrijf een eventueel uitgestelde state direct weg (bv. vóór een reboot)
+void relay_state_flush(void);
+
+relay_power_on_mode_t relay_state_power_on_mode(void);
+void relay_state_get_stats(relay_state_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/gptimer.h>
+#include <freertos/semphr.h>
+
+#include "zero-cross.h"
+
+static const char *ZC_TAG = "ZEROCROSS";
+
+// Periodes buiten dit venster zijn ruis of geen (50/60 Hz) netspanning
+#define ZC_PERIOD_MIN_US    4000
+#define ZC_PERIOD_MAX_US    25000
+// Minimale marge tussen flank en alarm, anders een periode later
+#define ZC_MIN_LEAD_US      200
+// Na zoveel zonder flanken beschouwen we de detectie als weg
+#define ZC_STALE_US         100000
+
+static gptimer_handle_t s_timer = NULL;
+static SemaphoreHandle_t s_done = NULL;
+static int s_relay_gpio = -1;
+
+// Lage 32 bits van esp_timer_get_time(): één woord, dus de task leest hem
+// zonder lock niet half bijgewerkt (de C3 is 32-bit). 0 = nog geen flank.
+static volatile uint32_t s_last_edge_us = 0;
+static volatile uint32_t s_period_us = 0;
+static volatile bool s_armed = false;
+static volatile bool s_target_on = false;
+static volatile int64_t s_edge_at_arm_us = 0;
+static volatile int64_t s_fire_target_us = 0;
+
+static atomic_uint s_actuation_delay_us = 0;
+static volatile int32_t s_timer_error_us = 0;
+static volatile uint32_t s_edge_to_switch_us = 0;
+static uint32_t s_synced_switches = 0;
+static uint32_t s_fallback_switches = 0;
+
+static bool zero_cross_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata,
+                                void *user_ctx) {
+    int64_t now = esp_timer_get_time();
+    gptimer_stop(timer);
+
+    gpio_set_level(s_relay_gpio, s_target_on ? 1 : 0);
+    s_armed = false;
+
+    // Leer de systematische timer-latency (EWMA 1/8) zodat volgende alarmen
+    // net zoveel eerder afgaan.
+    int32_t error = (int32_t)(now - s_fire_target_us);
+    s_timer_error_us += (error - s_timer_error_us) / 8;
+    s_edge_to_switch_us = (uint32_t)(now - s_edge_at_arm_us);
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(s_done, &woken);
+    return woken == pdTRUE;
+}
+
+static void zero_cross_isr(void *arg) {
+    int64_t now = esp_timer_get_time();
+    uint32_t now32 = (uint32_t)now;
+    uint32_t last = s_last_edge_us;
+    s_last_edge_us = (now32 != 0U) ? now32 : 1U;
+
+    if (last != 0U) {
+        uint32_t period = now32 - last;
+        if (period >= ZC_PERIOD_MIN_US && period <= ZC_PERIOD_MAX_US) {
+            uint32_t filtered = s_period_us;
+            s_period_us = (filtered == 0U) ? (uint32_t)period
+                                           : filtered + ((int32_t)period - (int32_t)filtered) / 4;
+        }
+    }
+
+    if (!s_armed || s_period_us == 0U) {
+        return;
+    }
+
+    // Contacten moeten sluiten op de volgende crossing: vuur 'actuation delay'
+    // (plus geleerde timer-latency) ervoor, eventueel een of meer periodes later.
+    int64_t target = now + s_period_us;
+    int64_t fire_at = target - (int64_t)atomic_load(&s_actuation_delay_us) - s_timer_error_us;
+    while (fire_at < now + ZC_MIN_LEAD_US) {
+        fire_at += s_period_us;
+    }
+
+    s_edge_at_arm_us = now;
+    s_fire_target_us = fire_at;
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = (uint64_t)(fire_at - now),
+    };
+    gptimer_set_raw_count(s_timer, 0);
+    gptimer_set_alarm_action(s_timer, &alarm);
+    gptimer_start(s_timer);
+}
+
+esp_err_t zero_cross_init(int zc_gpio, int relay_gpio, uint32_t actuation_delay_us) {
+    if (s_timer != NULL) {
+        return ESP_OK;
+    }
+    if (zc_gpio < 0 || relay_gpio < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_relay_gpio = relay_gpio;
+    atomic_store(&s_actuation_delay_us, actuation_delay_us);
+
+    s_done = xSemaphoreCreateBinary();
+    if (s_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,  // 1 tick = 1 us
+    };
+    esp_err_t err = gptimer_new_timer(&timer_cfg, &s_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(ZC_TAG, "Failed to create GPTimer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = zero_cross_on_alarm,
+    };
+    err = gptimer_register_event_callbacks(s_timer, &cbs, NULL);
+    if (err == ESP_OK) {
+        err = gptimer_enable(s_timer);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(ZC_TAG, "Failed to start GPTimer: %s", esp_err_to_name(err));
+        gptimer_del_timer(s_timer);
+        s_timer = NULL;
+        return err;
+    }
+
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << zc_gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+    err = gpio_config(&io);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(ZC_TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = gpio_isr_handler_add(zc_gpio, zero_cross_isr, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(ZC_TAG, "Failed to add zero-cross ISR: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(ZC_TAG, "Zero-cross input on GPIO %d (actuation delay %u us)", zc_gpio,
+             (unsigned)actuation_delay_us);
+    return ESP_OK;
+}
+
+esp_err_t zero_cross_switch(bool on, TickType_t timeout) {
+    if (s_timer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (s_period_us == 0U || (uint32_t)esp_timer_get_time() - s_last_edge_us > ZC_STALE_US) {
+        s_fallback_switches++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_done, 0);
+    s_target_on = on;
+    s_armed = true;
+
+    if (xSemaphoreTake(s_done, timeout) != pdTRUE) {
+        s_armed = false;
+        gptimer_stop(s_timer);
+        // Alarm kan net tussen timeout en disarm gevuurd hebben
+        if (xSemaphoreTake(s_done, 0) == pdTRUE) {
+            s_synced_switches++;
+            return ESP_OK;
+        }
+        s_fallback_switches++;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    s_synced_switches++;
+    ESP_LOGD(ZC_TAG, "Switched %s, edge->switch %u us", on ? "ON" : "OFF",
+             (unsigned)s_edge_to_switch_us);
+    return ESP_OK;
+}
+
+void zero_cross_set_actuation_delay_us(uint32_t actuation_delay_us) {
+    atomic_store(&s_actuation_delay_us, actuation_delay_us);
+}
+
+void zero_cross_get_stats(zero_cross_stats_t *out_stats) {
+    if (out_stats == NULL) {
+        return;
+    }
+
+    memset(out_stats, 0, sizeof(*out_stats));
+    out_stats->period_us = s_period_us;
+    out_stats->actuation_delay_us = atomic_load(&s_actuation_delay_us);
+    out_stats->timer_error_us = s_timer_error_us;
+    out_stats->edge_to_switch_us = s_edge_to_switch_us;
+    out_stats->synced_switches = s_synced_switches;
+    out_stats->fallback_switches = s_fallback_switches;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t period_us;             // gemeten tijd tussen zero-cross flanken (0 = geen netspanning gezien)
+    uint32_t actuation_delay_us;    // mechanische relais vertraging (configuratie / tuning)
+    int32_t timer_error_us;         // geleerde afwijking van het timer-alarm t.o.v. het doel
+    uint32_t edge_to_switch_us;     // laatste zero-cross flank -> relay GPIO flank
+    uint32_t synced_switches;
+    uint32_t fallback_switches;     // geen zero-cross binnen de timeout, direct geschakeld
+} zero_cross_stats_t;
+
+// Start zero-cross detectie op 'zc_gpio' (rising edge) en de GPTimer scheduler
+// die 'relay_gpio' schakelt.
+esp_err_t zero_cross_init(int zc_gpio, int relay_gpio, uint32_t actuation_delay_us);
+
+// Schakel 'relay_gpio' zo dat de contacten sluiten op de volgende zero crossing.
+// Blokkeert maximaal 'timeout'. ESP_ERR_TIMEOUT / ESP_ERR_INVALID_STATE: er is
+// niet geschakeld en de aanroeper moet zelf direct schakelen.
+esp_err_t zero_cross_switch(bool on, TickType_t timeout);
+
+void zero_cross_set_actuation_delay_us(uint32_t actuation_delay_us);
+void zero_cross_get_stats(zero_cross_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
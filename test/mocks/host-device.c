@@ -0,0 +1,597 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_app_desc.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_random.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#include "host-internal.h"
+
+host_shared_t *g_host = NULL;
+
+// Start and end of the RTC_DATA_ATTR variables (see test/stubs/host-idf.h)
+extern uint8_t __start_host_rtc[] __attribute__((weak));
+extern uint8_t __stop_host_rtc[] __attribute__((weak));
+
+static size_t rtc_size(void) {
+    if (__start_host_rtc == NULL || __stop_host_rtc == NULL) {
+        return 0;
+    }
+    return (size_t)(__stop_host_rtc - __start_host_rtc);
+}
+
+static int64_t s_now_us = 0;
+static uint32_t s_random_state = 0;
+static size_t s_free_heap = 160 * 1024;
+static bool s_verbose = false;
+static bool s_in_boot = false;
+
+uint64_t host_wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+void host_device_reset(void) {
+    if (g_host == NULL) {
+        g_host = mmap(NULL, sizeof(*g_host), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (g_host == MAP_FAILED) {
+            perror("mmap");
+            exit(2);
+        }
+        memset(g_host, 0, sizeof(*g_host));
+        if (rtc_size() > HOST_RTC_MAX_BYTES) {
+            fprintf(stderr, "RTC section of %zu bytes does not fit\n", rtc_size());
+            exit(2);
+        }
+        // Still the image of the loaded binary: nothing ran yet
+        memcpy(g_host->rtc_power_on, __start_host_rtc, rtc_size());
+    }
+
+    uint32_t failures = g_host->failures;
+    uint8_t power_on[HOST_RTC_MAX_BYTES];
+    memcpy(power_on, g_host->rtc_power_on, sizeof(power_on));
+
+    memset(g_host, 0, sizeof(*g_host));
+    g_host->failures = failures;
+    g_host->boot_subtype = -1;
+    memcpy(g_host->rtc_power_on, power_on, sizeof(power_on));
+    memcpy(g_host->rtc, power_on, sizeof(power_on));
+    strncpy(g_host->app_version, "1.0.0", sizeof(g_host->app_version) - 1);
+}
+
+void host_power_cycle(void) {
+    memcpy(g_host->rtc, g_host->rtc_power_on, sizeof(g_host->rtc));
+}
+
+void host_set_app_version(const char *version) {
+    strncpy(g_host->app_version, version, sizeof(g_host->app_version) - 1);
+}
+
+static void (*s_restart_hook)(void *) = NULL;
+static void *s_restart_hook_arg = NULL;
+
+static void host_boot_finish(void) {
+    memcpy(g_host->rtc, __start_host_rtc, rtc_size());
+    g_host->boot.uptime_us = s_now_us;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+}
+
+static uint64_t s_boot_wall_start = 0;
+
+bool host_boot(host_boot_fn_t fn, void *arg, host_boot_result_t *out_result) {
+    uint32_t failures = g_host->failures;
+    memset(&g_host->boot, 0, sizeof(g_host->boot));
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(2);
+    }
+
+    if (pid == 0) {
+        memcpy(__start_host_rtc, g_host->rtc, rtc_size());
+        s_now_us = 0;
+        s_random_state = 0x2545F491U;
+        s_in_boot = true;
+        host_log_reset();
+        host_rtos_reset();
+        host_timer_reset();
+        host_net_reset();
+        host_nvs_boot_init();
+        s_restart_hook = NULL;
+
+        s_boot_wall_start = host_wall_us();
+        fn(arg);
+        g_host->boot.wall_us = host_wall_us() - s_boot_wall_start;
+        host_boot_finish();
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        g_host->boot.crashed = true;
+        g_host->failures++;
+        fprintf(stderr, "boot crashed (status 0x%x)\n", status);
+    }
+
+    if (out_result != NULL) {
+        *out_result = g_host->boot;
+    }
+    return g_host->failures == failures;
+}
+
+bool host_check(bool ok, const char *expr, const char *file, int line) {
+    if (!ok) {
+        g_host->failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    }
+    return ok;
+}
+
+uint32_t host_failures(void) {
+    return g_host->failures;
+}
+
+void host_on_restart(void (*hook)(void *arg), void *arg) {
+    s_restart_hook = hook;
+    s_restart_hook_arg = arg;
+}
+
+void esp_restart(void) {
+    if (s_restart_hook != NULL) {
+        s_restart_hook(s_restart_hook_arg);
+    }
+    g_host->boot.restarted = true;
+    g_host->boot.wall_us = host_wall_us() - s_boot_wall_start;
+    host_boot_finish();
+    abort();
+}
+
+// ---- Log ----------------------------------------------------------------
+
+#define HOST_LOG_LINES 512
+#define HOST_LOG_LINE_LEN 240
+
+static char s_log[HOST_LOG_LINES][HOST_LOG_LINE_LEN];
+static size_t s_log_count = 0;
+
+void host_log_reset(void) {
+    s_log_count = 0;
+    const char *env = getenv("HOST_VERBOSE");
+    s_verbose = s_verbose || (env != NULL && env[0] == '1');
+}
+
+void host_set_verbose(bool verbose) {
+    s_verbose = verbose;
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...) {
+    char line[HOST_LOG_LINE_LEN];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (s_in_boot) {
+        strncpy(s_log[s_log_count % HOST_LOG_LINES], line, HOST_LOG_LINE_LEN - 1);
+        s_log_count++;
+    }
+    if (s_verbose) {
+        printf("    %c (%8lld) %s: %s\n", level, (long long)(s_now_us / 1000), tag, line);
+    }
+}
+
+bool host_log_contains(const char *needle) {
+    size_t first = (s_log_count > HOST_LOG_LINES) ? s_log_count - HOST_LOG_LINES : 0;
+    for (size_t i = first; i < s_log_count; ++i) {
+        if (strstr(s_log[i % HOST_LOG_LINES], needle) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---- esp_timer ----------------------------------------------------------
+
+#define HOST_TIMERS 32
+
+struct host_timer {
+    bool used;
+    bool armed;
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t due_us;
+    uint64_t period_us;
+    uint64_t last_timeout_us;
+};
+
+static struct host_timer s_timers[HOST_TIMERS];
+
+void host_timer_reset(void) {
+    memset(s_timers, 0, sizeof(s_timers));
+}
+
+int64_t esp_timer_get_time(void) {
+    return s_now_us;
+}
+
+void host_consume_us(uint64_t us) {
+    s_now_us += (int64_t)us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle) {
+    if (args == NULL || args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < HOST_TIMERS; ++i) {
+        if (!s_timers[i].used) {
+            s_timers[i] = (struct host_timer){
+                .used = true,
+                .callback = args->callback,
+                .arg = args->arg,
+                .name = args->name,
+            };
+            *out_handle = &s_timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer == NULL || !timer->used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->due_us = s_now_us + (int64_t)timeout_us;
+    timer->period_us = 0;
+    timer->last_timeout_us = timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    esp_err_t err = esp_timer_start_once(timer, period_us);
+    if (err == ESP_OK) {
+        timer->period_us = period_us;
+    }
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL || !timer->used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL || !timer->used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->used = false;
+    return ESP_OK;
+}
+
+static struct host_timer *host_timer_find(const char *name) {
+    for (size_t i = 0; i < HOST_TIMERS; ++i) {
+        if (s_timers[i].used && s_timers[i].name != NULL && strcmp(s_timers[i].name, name) == 0) {
+            return &s_timers[i];
+        }
+    }
+    return NULL;
+}
+
+uint64_t host_timer_last_timeout_us(const char *name) {
+    struct host_timer *timer = host_timer_find(name);
+    return (timer != NULL) ? timer->last_timeout_us : 0U;
+}
+
+bool host_timer_armed(const char *name) {
+    struct host_timer *timer = host_timer_find(name);
+    return timer != NULL && timer->armed;
+}
+
+void host_advance_us(int64_t us) {
+    int64_t target = s_now_us + us;
+
+    for (;;) {
+        struct host_timer *next = NULL;
+        for (size_t i = 0; i < HOST_TIMERS; ++i) {
+            struct host_timer *timer = &s_timers[i];
+            if (timer->used && timer->armed && timer->due_us <= target &&
+                    (next == NULL || timer->due_us < next->due_us)) {
+                next = timer;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+
+        if (next->due_us > s_now_us) {
+            s_now_us = next->due_us;
+        }
+        if (next->period_us != 0U) {
+            next->due_us += (int64_t)next->period_us;
+        } else {
+            next->armed = false;
+        }
+        next->callback(next->arg);
+    }
+
+    if (target > s_now_us) {
+        s_now_us = target;
+    }
+}
+
+void host_advance_ms(int64_t ms) {
+    host_advance_us(ms * 1000);
+}
+
+// ---- FreeRTOS -----------------------------------------------------------
+
+static int s_tasks[2];
+static host_task_t s_current_task = HOST_TASK_MAIN;
+static uint32_t s_notify_count = 0;
+static uint32_t s_tasks_created = 0;
+static void (*s_wait_hook)(void *) = NULL;
+static void *s_wait_hook_arg = NULL;
+
+void host_rtos_reset(void) {
+    s_current_task = HOST_TASK_MAIN;
+    s_notify_count = 0;
+    s_tasks_created = 0;
+    s_wait_hook = NULL;
+    s_wait_hook_arg = NULL;
+}
+
+void host_set_current_task(host_task_t task) {
+    s_current_task = task;
+}
+
+void host_on_wait(void (*hook)(void *arg), void *arg) {
+    s_wait_hook = hook;
+    s_wait_hook_arg = arg;
+}
+
+uint32_t host_tasks_created(void) {
+    return s_tasks_created;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    host_advance_ms((int64_t)ticks);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *out_task) {
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)priority;
+    // Tasks are not run; the paths under test only start them
+    s_tasks_created++;
+    if (out_task != NULL) {
+        *out_task = NULL;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return &s_tasks[s_current_task];
+}
+
+TaskHandle_t xTaskGetHandle(const char *name) {
+    (void)name;
+    return NULL;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    (void)task;
+    return 1;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    (void)task;
+    (void)priority;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    (void)task;
+    s_notify_count++;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task) {
+    (void)task;
+    s_notify_count = 0;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    if (s_notify_count == 0U && s_wait_hook != NULL) {
+        s_wait_hook(s_wait_hook_arg);
+    }
+    if (s_notify_count == 0U) {
+        host_advance_ms((int64_t)ticks);
+    }
+    uint32_t count = s_notify_count;
+    if (clear) {
+        s_notify_count = 0;
+    } else if (s_notify_count > 0U) {
+        s_notify_count--;
+    }
+    return count;
+}
+
+static int s_semaphores;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf) {
+    return buf != NULL ? (SemaphoreHandle_t)buf : (SemaphoreHandle_t)&s_semaphores;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buf) {
+    return xSemaphoreCreateMutexStatic(buf);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    (void)sem;
+    (void)ticks;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    (void)sem;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) {
+    return xSemaphoreTake(sem, ticks);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    return xSemaphoreGive(sem);
+}
+
+// ---- System -------------------------------------------------------------
+
+uint32_t esp_random(void) {
+    // xorshift32: reproducible per boot
+    uint32_t x = s_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_random_state = x;
+    return x;
+}
+
+void esp_fill_random(void *buf, size_t len) {
+    uint8_t *out = buf;
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = (uint8_t)esp_random();
+    }
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    (void)type;
+    static const uint8_t k_mac[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+    memcpy(mac, k_mac, sizeof(k_mac));
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return s_free_heap;
+}
+
+void host_set_free_heap(size_t bytes) {
+    s_free_heap = bytes;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    static esp_app_desc_t desc;
+    memset(&desc, 0, sizeof(desc));
+    strncpy(desc.version, g_host->app_version, sizeof(desc.version) - 1);
+    strncpy(desc.project_name, "main", sizeof(desc.project_name) - 1);
+    return &desc;
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = (len < size - 1) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        case ESP_ERR_WIFI_NOT_INIT: return "ESP_ERR_WIFI_NOT_INIT";
+        case ESP_ERR_WIFI_NOT_STARTED: return "ESP_ERR_WIFI_NOT_STARTED";
+        default: return "ESP_ERR_UNKNOWN";
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <esp_event.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Host model of one plug. Every boot runs in a forked child process, so all
+// RAM state of main/esp32-lcm.c starts from zero like on the device. Flash
+// (NVS, partitions) and RTC memory live in a shared mapping and survive the
+// reboot; a power cycle also clears RTC memory.
+
+// Flash timing model: typical SPI NOR figures as used by the IDF flash
+// driver. Good enough to compare two versions of a path, not a device
+// measurement.
+#define HOST_FLASH_SECTOR_SIZE       4096U
+#define HOST_FLASH_SECTOR_ERASE_US   45000U   // 4 KiB sector erase
+#define HOST_FLASH_ENTRY_WRITE_US    120U     // program one 32 byte NVS entry
+#define HOST_FLASH_ENTRY_READ_US     4U       // read one 32 byte NVS entry
+#define HOST_NVS_ENTRY_SIZE          32U
+#define HOST_NVS_ENTRIES_PER_PAGE    126U     // a full page is garbage collected with one erase
+
+typedef struct {
+    uint32_t nvs_calls;           // every nvs_* get/set/erase/commit/open call
+    uint32_t entry_reads;
+    uint32_t entry_writes;
+    uint32_t sector_erases;
+    uint64_t erase_bytes;
+    uint64_t busy_us;             // modelled flash time
+} host_flash_stats_t;
+
+typedef struct {
+    bool restarted;               // esp_restart() ended the boot
+    bool crashed;                 // the child died (signal, abort)
+    int64_t uptime_us;            // virtual clock at the end of the boot
+    uint64_t wall_us;             // host time spent in the boot function
+} host_boot_result_t;
+
+typedef void (*host_boot_fn_t)(void *arg);
+
+// Blank device: erased flash, cleared RTC memory, default partition table.
+void host_device_reset(void);
+void host_power_cycle(void);
+
+// Run 'fn' as one boot of the device. Returns false when a check inside the
+// boot failed.
+bool host_boot(host_boot_fn_t fn, void *arg, host_boot_result_t *out_result);
+
+// Firmware version reported by esp_app_get_description() from the next boot.
+void host_set_app_version(const char *version);
+
+// Called by esp_restart() before the boot ends, e.g. to close a measurement.
+void host_on_restart(void (*hook)(void *arg), void *arg);
+uint64_t host_wall_us(void);
+
+// Checks inside a boot; a failure is reported by host_boot().
+#define HOST_CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+bool host_check(bool ok, const char *expr, const char *file, int line);
+uint32_t host_failures(void);
+
+// Virtual clock: advance and fire every esp_timer that falls due.
+void host_advance_us(int64_t us);
+void host_advance_ms(int64_t ms);
+
+// Task reported by xTaskGetCurrentTaskHandle(); the HomeKit server task is
+// the one that delivers homekit events.
+typedef enum {
+    HOST_TASK_MAIN = 0,
+    HOST_TASK_HOMEKIT_SERVER,
+} host_task_t;
+
+void host_set_current_task(host_task_t task);
+
+// Called when ulTaskNotifyTake() would block, before the clock runs to the
+// timeout: lets "another task" post events or notifications meanwhile.
+void host_on_wait(void (*hook)(void *arg), void *arg);
+
+// Synchronous event loop: call the registered handlers.
+void host_post_event(esp_event_base_t base, int32_t id, void *data);
+
+// Flash state and counters (shared between boots).
+void host_flash_get_stats(host_flash_stats_t *out_stats);
+void host_flash_stats_diff(const host_flash_stats_t *before, host_flash_stats_t *out_delta);
+bool host_nvs_has_key(const char *namespace_name, const char *key);
+esp_err_t host_nvs_seed_u32(const char *namespace_name, const char *key, uint32_t value);
+esp_err_t host_nvs_seed_str(const char *namespace_name, const char *key, const char *value);
+esp_err_t host_nvs_seed_blob(const char *namespace_name, const char *key, const void *value, size_t len);
+esp_err_t host_nvs_corrupt_blob(const char *namespace_name, const char *key);
+void host_nvs_fail_next_init(esp_err_t err);
+// Boot partition selected by esp_ota_set_boot_partition(), -1 when unchanged.
+int host_boot_subtype(void);
+// Bytes erased in the app partition with 'subtype' since the last reset.
+uint32_t host_partition_erased(int subtype);
+
+// Log capture of the current boot.
+bool host_log_contains(const char *needle);
+void host_set_verbose(bool verbose);
+
+// Counters of the stubbed platform calls in the current boot.
+typedef struct {
+    uint32_t wifi_connects;
+    uint32_t wifi_disconnects;
+    uint32_t wifi_restores;
+    uint32_t mdns_removes;
+    uint32_t mdns_frees;
+    uint32_t homekit_resets;
+    int64_t homekit_reset_us;     // virtual time of the last homekit_server_reset()
+    uint32_t tasks_created;
+    uint32_t socket_probes;       // getsockopt() calls: one per descriptor a socket scan looks at
+} host_platform_stats_t;
+
+void host_platform_get_stats(host_platform_stats_t *out_stats);
+// Delay of the last esp_timer_start_once() on the timer called 'name'.
+uint64_t host_timer_last_timeout_us(const char *name);
+bool host_timer_armed(const char *name);
+void host_set_free_heap(size_t bytes);
+
+// Connected HAP sessions as seen by the socket scans of esp32-lcm.c: open one
+// at the lowest free descriptor (-1 when all are in use), close it, and see
+// how it was shut down (SHUT_WR/SHUT_RDWR, -1 = not).
+int host_hap_open(uint16_t peer_port);
+void host_hap_close(int fd);
+int host_hap_shut(int fd);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,556 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "host-internal.h"
+
+// Partition table of the flash model (4 MB part with factory LCM and two
+// OTA slots), in the order esp_partition_find() returns them.
+static const esp_partition_t k_partitions[HOST_PARTITION_COUNT] = {
+    { ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 0x6000, 0x1000, "nvs", false },
+    { ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, 0xf000, 0x2000, 0x1000, "otadata", false },
+    { ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x01, 0x11000, 0x1000, 0x1000, "phy_init", false },
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, 0x20000, 0x100000, 0x1000, "factory", false },
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x120000, 0x170000, 0x1000, "ota_0", false },
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x290000, 0x170000, 0x1000, "ota_1", false },
+};
+
+#define HOST_RUNNING_PARTITION 4
+
+void host_flash_count_erase(uint32_t bytes) {
+    uint32_t sectors = (bytes + HOST_FLASH_SECTOR_SIZE - 1U) / HOST_FLASH_SECTOR_SIZE;
+    g_host->flash.sector_erases += sectors;
+    g_host->flash.erase_bytes += bytes;
+    g_host->flash.busy_us += (uint64_t)sectors * HOST_FLASH_SECTOR_ERASE_US;
+    host_consume_us((uint64_t)sectors * HOST_FLASH_SECTOR_ERASE_US);
+}
+
+static void host_flash_count_reads(uint32_t entries) {
+    g_host->flash.entry_reads += entries;
+    g_host->flash.busy_us += (uint64_t)entries * HOST_FLASH_ENTRY_READ_US;
+    host_consume_us((uint64_t)entries * HOST_FLASH_ENTRY_READ_US);
+}
+
+// NVS appends entries to the active page; a full page costs one sector
+// erase when the garbage collector reclaims it.
+static void host_flash_count_writes(uint32_t entries) {
+    g_host->flash.entry_writes += entries;
+    g_host->flash.busy_us += (uint64_t)entries * HOST_FLASH_ENTRY_WRITE_US;
+    host_consume_us((uint64_t)entries * HOST_FLASH_ENTRY_WRITE_US);
+
+    g_host->page_fill += entries;
+    while (g_host->page_fill >= HOST_NVS_ENTRIES_PER_PAGE) {
+        g_host->page_fill -= HOST_NVS_ENTRIES_PER_PAGE;
+        host_flash_count_erase(HOST_FLASH_SECTOR_SIZE);
+    }
+}
+
+void host_flash_get_stats(host_flash_stats_t *out_stats) {
+    *out_stats = g_host->flash;
+}
+
+void host_flash_stats_diff(const host_flash_stats_t *before, host_flash_stats_t *out_delta) {
+    const host_flash_stats_t *now = &g_host->flash;
+    out_delta->nvs_calls = now->nvs_calls - before->nvs_calls;
+    out_delta->entry_reads = now->entry_reads - before->entry_reads;
+    out_delta->entry_writes = now->entry_writes - before->entry_writes;
+    out_delta->sector_erases = now->sector_erases - before->sector_erases;
+    out_delta->erase_bytes = now->erase_bytes - before->erase_bytes;
+    out_delta->busy_us = now->busy_us - before->busy_us;
+}
+
+// ---- NVS ----------------------------------------------------------------
+
+#define HOST_NVS_HANDLES 16
+
+typedef struct {
+    bool open;
+    bool writable;
+    uint8_t ns;
+} host_nvs_handle_t;
+
+static bool s_nvs_initialized = false;
+static host_nvs_handle_t s_handles[HOST_NVS_HANDLES + 1];
+
+void host_nvs_boot_init(void) {
+    s_nvs_initialized = false;
+    memset(s_handles, 0, sizeof(s_handles));
+}
+
+static uint32_t host_nvs_entry_span(host_nvs_type_t type, size_t len) {
+    uint32_t data = (uint32_t)((len + HOST_NVS_ENTRY_SIZE - 1U) / HOST_NVS_ENTRY_SIZE);
+    switch (type) {
+        case HOST_NVS_TYPE_STR:
+            return 1U + data;
+        case HOST_NVS_TYPE_BLOB:
+            return 2U + data;   // blob index + data chunk header
+        default:
+            return 1U;
+    }
+}
+
+static int host_nvs_find_namespace(const char *name) {
+    for (int i = 0; i < HOST_NVS_MAX_NAMESPACES; ++i) {
+        if (g_host->namespaces[i][0] != '\0' && strcmp(g_host->namespaces[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int host_nvs_add_namespace(const char *name) {
+    int ns = host_nvs_find_namespace(name);
+    if (ns >= 0) {
+        return ns;
+    }
+    for (int i = 0; i < HOST_NVS_MAX_NAMESPACES; ++i) {
+        if (g_host->namespaces[i][0] == '\0') {
+            strncpy(g_host->namespaces[i], name, sizeof(g_host->namespaces[i]) - 1);
+            host_flash_count_writes(1);
+            return i;
+        }
+    }
+    return -1;
+}
+
+static host_nvs_entry_t *host_nvs_find(uint8_t ns, const char *key) {
+    for (size_t i = 0; i < HOST_NVS_MAX_ENTRIES; ++i) {
+        host_nvs_entry_t *entry = &g_host->entries[i];
+        if (entry->used && entry->ns == ns && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t host_nvs_store(uint8_t ns, const char *key, host_nvs_type_t type,
+                                const void *value, size_t len, bool count) {
+    if (key == NULL || strlen(key) >= sizeof(g_host->entries[0].key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len > HOST_NVS_MAX_VALUE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    host_nvs_entry_t *entry = host_nvs_find(ns, key);
+    if (entry != NULL && entry->type == type && entry->len == len && memcmp(entry->data, value, len) == 0) {
+        // NVS compares with the stored item and skips an identical write
+        if (count) {
+            host_flash_count_reads(host_nvs_entry_span(type, len));
+        }
+        return ESP_OK;
+    }
+
+    if (entry == NULL) {
+        for (size_t i = 0; i < HOST_NVS_MAX_ENTRIES && entry == NULL; ++i) {
+            if (!g_host->entries[i].used) {
+                entry = &g_host->entries[i];
+            }
+        }
+        if (entry == NULL) {
+            return ESP_ERR_NVS_NO_FREE_PAGES;
+        }
+    } else if (count) {
+        // The old item is marked erased in the entry state bitmap
+        host_flash_count_writes(1);
+    }
+
+    entry->used = true;
+    entry->ns = ns;
+    entry->type = type;
+    strncpy(entry->key, key, sizeof(entry->key) - 1);
+    entry->key[sizeof(entry->key) - 1] = '\0';
+    entry->len = (uint16_t)len;
+    memcpy(entry->data, value, len);
+    if (count) {
+        host_flash_count_writes(host_nvs_entry_span(type, len));
+    }
+    return ESP_OK;
+}
+
+static host_nvs_handle_t *host_nvs_handle(nvs_handle_t handle) {
+    g_host->flash.nvs_calls++;
+    if (handle == 0 || handle > HOST_NVS_HANDLES || !s_handles[handle].open || !s_nvs_initialized) {
+        return NULL;
+    }
+    return &s_handles[handle];
+}
+
+esp_err_t nvs_flash_init(void) {
+    if (g_host->fail_next_init != ESP_OK) {
+        esp_err_t err = g_host->fail_next_init;
+        g_host->fail_next_init = ESP_OK;
+        return err;
+    }
+    // Mounting reads every page header and entry state table
+    host_flash_count_reads(k_partitions[0].size / HOST_FLASH_SECTOR_SIZE);
+    s_nvs_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    if (!s_nvs_initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    s_nvs_initialized = false;
+    memset(s_handles, 0, sizeof(s_handles));
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    // Like the IDF: an initialised partition is deinitialised first
+    s_nvs_initialized = false;
+    memset(s_handles, 0, sizeof(s_handles));
+    memset(g_host->entries, 0, sizeof(g_host->entries));
+    memset(g_host->namespaces, 0, sizeof(g_host->namespaces));
+    g_host->page_fill = 0;
+    host_flash_count_erase(k_partitions[0].size);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t mode, nvs_handle_t *out_handle) {
+    g_host->flash.nvs_calls++;
+    if (!s_nvs_initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (namespace_name == NULL || out_handle == NULL || strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int ns = (mode == NVS_READWRITE) ? host_nvs_add_namespace(namespace_name)
+                                     : host_nvs_find_namespace(namespace_name);
+    if (ns < 0) {
+        return (mode == NVS_READWRITE) ? ESP_ERR_NVS_NO_FREE_PAGES : ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (nvs_handle_t handle = 1; handle <= HOST_NVS_HANDLES; ++handle) {
+        if (!s_handles[handle].open) {
+            s_handles[handle] = (host_nvs_handle_t){
+                .open = true,
+                .writable = (mode == NVS_READWRITE),
+                .ns = (uint8_t)ns,
+            };
+            *out_handle = handle;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    if (handle > 0 && handle <= HOST_NVS_HANDLES) {
+        s_handles[handle].open = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    // Set and erase already wrote through; commit is bookkeeping only
+    return host_nvs_handle(handle) != NULL ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    host_nvs_handle_t *h = host_nvs_handle(handle);
+    if (h == NULL || !h->writable) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    host_nvs_entry_t *entry = host_nvs_find(h->ns, key);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    entry->used = false;
+    host_flash_count_writes(1);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    host_nvs_handle_t *h = host_nvs_handle(handle);
+    if (h == NULL || !h->writable) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    for (size_t i = 0; i < HOST_NVS_MAX_ENTRIES; ++i) {
+        host_nvs_entry_t *entry = &g_host->entries[i];
+        if (entry->used && entry->ns == h->ns) {
+            entry->used = false;
+            host_flash_count_writes(1);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t host_nvs_get(nvs_handle_t handle, const char *key, host_nvs_type_t type,
+                              host_nvs_entry_t **out_entry) {
+    host_nvs_handle_t *h = host_nvs_handle(handle);
+    if (h == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    host_nvs_entry_t *entry = host_nvs_find(h->ns, key);
+    if (entry == NULL || entry->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    host_flash_count_reads(host_nvs_entry_span(type, entry->len));
+    *out_entry = entry;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    host_nvs_entry_t *entry;
+    esp_err_t err = host_nvs_get(handle, key, HOST_NVS_TYPE_U8, &entry);
+    if (err == ESP_OK) {
+        memcpy(out_value, entry->data, sizeof(*out_value));
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    host_nvs_entry_t *entry;
+    esp_err_t err = host_nvs_get(handle, key, HOST_NVS_TYPE_U32, &entry);
+    if (err == ESP_OK) {
+        memcpy(out_value, entry->data, sizeof(*out_value));
+    }
+    return err;
+}
+
+static esp_err_t host_nvs_get_sized(nvs_handle_t handle, const char *key, host_nvs_type_t type,
+                                    void *out_value, size_t *length) {
+    if (length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_nvs_entry_t *entry;
+    esp_err_t err = host_nvs_get(handle, key, type, &entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (out_value == NULL) {
+        *length = entry->len;
+        return ESP_OK;
+    }
+    if (*length < entry->len) {
+        *length = entry->len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->len);
+    *length = entry->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return host_nvs_get_sized(handle, key, HOST_NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return host_nvs_get_sized(handle, key, HOST_NVS_TYPE_BLOB, out_value, length);
+}
+
+static esp_err_t host_nvs_set(nvs_handle_t handle, const char *key, host_nvs_type_t type,
+                              const void *value, size_t len) {
+    host_nvs_handle_t *h = host_nvs_handle(handle);
+    if (h == NULL || !h->writable) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return host_nvs_store(h->ns, key, type, value, len, true);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return host_nvs_set(handle, key, HOST_NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return host_nvs_set(handle, key, HOST_NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return host_nvs_set(handle, key, HOST_NVS_TYPE_STR, value, strlen(value) + 1U);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return host_nvs_set(handle, key, HOST_NVS_TYPE_BLOB, value, length);
+}
+
+// Seeding from the harness: no flash accounting
+static esp_err_t host_nvs_seed(const char *namespace_name, const char *key, host_nvs_type_t type,
+                               const void *value, size_t len) {
+    int ns = host_nvs_find_namespace(namespace_name);
+    if (ns < 0) {
+        for (int i = 0; i < HOST_NVS_MAX_NAMESPACES && ns < 0; ++i) {
+            if (g_host->namespaces[i][0] == '\0') {
+                strncpy(g_host->namespaces[i], namespace_name, sizeof(g_host->namespaces[i]) - 1);
+                ns = i;
+            }
+        }
+    }
+    if (ns < 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    return host_nvs_store((uint8_t)ns, key, type, value, len, false);
+}
+
+esp_err_t host_nvs_seed_u32(const char *namespace_name, const char *key, uint32_t value) {
+    return host_nvs_seed(namespace_name, key, HOST_NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t host_nvs_seed_str(const char *namespace_name, const char *key, const char *value) {
+    return host_nvs_seed(namespace_name, key, HOST_NVS_TYPE_STR, value, strlen(value) + 1U);
+}
+
+esp_err_t host_nvs_seed_blob(const char *namespace_name, const char *key, const void *value, size_t len) {
+    return host_nvs_seed(namespace_name, key, HOST_NVS_TYPE_BLOB, value, len);
+}
+
+esp_err_t host_nvs_corrupt_blob(const char *namespace_name, const char *key) {
+    int ns = host_nvs_find_namespace(namespace_name);
+    host_nvs_entry_t *entry = (ns >= 0) ? host_nvs_find((uint8_t)ns, key) : NULL;
+    if (entry == NULL || entry->len == 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    entry->data[entry->len / 2U] ^= 0x5A;
+    return ESP_OK;
+}
+
+bool host_nvs_has_key(const char *namespace_name, const char *key) {
+    int ns = host_nvs_find_namespace(namespace_name);
+    return ns >= 0 && host_nvs_find((uint8_t)ns, key) != NULL;
+}
+
+void host_nvs_fail_next_init(esp_err_t err) {
+    g_host->fail_next_init = err;
+}
+
+// ---- Partitions ---------------------------------------------------------
+
+struct host_partition_iterator {
+    size_t index;
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+};
+
+static bool host_partition_matches(size_t index, esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                   const char *label) {
+    const esp_partition_t *part = &k_partitions[index];
+    return part->type == type &&
+           (subtype == ESP_PARTITION_SUBTYPE_ANY || part->subtype == subtype) &&
+           (label == NULL || strcmp(part->label, label) == 0);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    for (size_t i = 0; i < HOST_PARTITION_COUNT; ++i) {
+        if (host_partition_matches(i, type, subtype, label)) {
+            return &k_partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_partition_iterator_t host_partition_seek(esp_partition_iterator_t it, size_t from) {
+    for (size_t i = from; i < HOST_PARTITION_COUNT; ++i) {
+        if (host_partition_matches(i, it->type, it->subtype, NULL)) {
+            it->index = i;
+            return it;
+        }
+    }
+    free(it);
+    return NULL;
+}
+
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                            const char *label) {
+    (void)label;
+    esp_partition_iterator_t it = calloc(1, sizeof(*it));
+    if (it == NULL) {
+        return NULL;
+    }
+    it->type = type;
+    it->subtype = subtype;
+    return host_partition_seek(it, 0);
+}
+
+const esp_partition_t *esp_partition_get(esp_partition_iterator_t it) {
+    return (it != NULL) ? &k_partitions[it->index] : NULL;
+}
+
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t it) {
+    return (it != NULL) ? host_partition_seek(it, it->index + 1U) : NULL;
+}
+
+void esp_partition_iterator_release(esp_partition_iterator_t it) {
+    free(it);
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (partition == NULL || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset % HOST_FLASH_SECTOR_SIZE != 0U || size % HOST_FLASH_SECTOR_SIZE != 0U) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t index = (size_t)(partition - k_partitions);
+    if (index < HOST_PARTITION_COUNT) {
+        g_host->partition_erased[index] += (uint32_t)size;
+    }
+    host_flash_count_erase((uint32_t)size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256) {
+    if (partition == NULL || sha_256 == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < 32; ++i) {
+        sha_256[i] = (uint8_t)(partition->address >> (8 * (i % 4))) ^ (uint8_t)i;
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return &k_partitions[HOST_RUNNING_PARTITION];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    if (partition == NULL || partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // otadata: one sector erase plus the new select entry
+    host_flash_count_erase(HOST_FLASH_SECTOR_SIZE);
+    g_host->boot_subtype = partition->subtype;
+    return ESP_OK;
+}
+
+int host_boot_subtype(void) {
+    return g_host->boot_subtype;
+}
+
+uint32_t host_partition_erased(int subtype) {
+    for (size_t i = 0; i < HOST_PARTITION_COUNT; ++i) {
+        if (k_partitions[i].type == ESP_PARTITION_TYPE_APP && (int)k_partitions[i].subtype == subtype) {
+            return g_host->partition_erased[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "host-device.h"
+
+// State shared between the harness and the forked boots: everything that
+// survives a reboot on the device.
+#define HOST_NVS_MAX_ENTRIES    96
+#define HOST_NVS_MAX_NAMESPACES 16
+#define HOST_NVS_MAX_VALUE      512
+#define HOST_RTC_MAX_BYTES      4096
+#define HOST_PARTITION_COUNT    6
+
+typedef enum {
+    HOST_NVS_TYPE_U8 = 1,
+    HOST_NVS_TYPE_U32,
+    HOST_NVS_TYPE_STR,
+    HOST_NVS_TYPE_BLOB,
+} host_nvs_type_t;
+
+typedef struct {
+    bool used;
+    uint8_t ns;
+    host_nvs_type_t type;
+    char key[16];
+    uint16_t len;
+    uint8_t data[HOST_NVS_MAX_VALUE];
+} host_nvs_entry_t;
+
+typedef struct {
+    host_nvs_entry_t entries[HOST_NVS_MAX_ENTRIES];
+    char namespaces[HOST_NVS_MAX_NAMESPACES][16];
+    uint32_t page_fill;                       // entries written into the active page
+    esp_err_t fail_next_init;
+
+    int boot_subtype;
+    uint32_t partition_erased[HOST_PARTITION_COUNT];
+    host_flash_stats_t flash;
+
+    uint8_t rtc[HOST_RTC_MAX_BYTES];
+    uint8_t rtc_power_on[HOST_RTC_MAX_BYTES];
+    char app_version[32];
+
+    uint32_t failures;
+    host_boot_result_t boot;
+} host_shared_t;
+
+extern host_shared_t *g_host;
+
+// Advance the virtual clock by flash busy time without running timers.
+void host_consume_us(uint64_t us);
+void host_flash_count_erase(uint32_t bytes);
+void host_nvs_boot_init(void);
+void host_log_reset(void);
+void host_rtos_reset(void);
+void host_timer_reset(void);
+void host_net_reset(void);
+uint32_t host_tasks_created(void);
@@ -0,0 +1,356 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <driver/gpio.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_pm.h>
+#include <esp_rrm.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include <esp_wnm.h>
+#include <lwip/dhcp.h>
+#include <lwip/sockets.h>
+#include <mdns.h>
+
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "event-trace.h"
+#include "notify-scheduler.h"
+
+#include "host-internal.h"
+
+// Wi-Fi, netif, event loop, sockets, mDNS and HomeKit stubs: they accept
+// every call and count the ones the tests look at.
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+#define HOST_EVENT_HANDLERS 8
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} host_event_handler_t;
+
+static host_event_handler_t s_handlers[HOST_EVENT_HANDLERS];
+static host_platform_stats_t s_stats;
+static struct host_netif {
+    int dummy;
+} s_netif;
+
+// Connected HAP sessions by descriptor; lwIP hands out the lowest free one
+typedef struct {
+    bool open;
+    int shut_how;                 // -1 while not shut down
+    struct sockaddr_in peer;
+} host_socket_t;
+
+static host_socket_t s_sockets[CONFIG_LWIP_MAX_SOCKETS];
+
+void host_net_reset(void) {
+    memset(s_handlers, 0, sizeof(s_handlers));
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(s_sockets, 0, sizeof(s_sockets));
+}
+
+void host_platform_get_stats(host_platform_stats_t *out_stats) {
+    *out_stats = s_stats;
+    out_stats->tasks_created = host_tasks_created();
+}
+
+void host_post_event(esp_event_base_t base, int32_t id, void *data) {
+    for (size_t i = 0; i < HOST_EVENT_HANDLERS; ++i) {
+        host_event_handler_t *h = &s_handlers[i];
+        if (h->handler != NULL && h->base == base && (h->id == ESP_EVENT_ANY_ID || h->id == id)) {
+            h->handler(h->arg, base, id, data);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg) {
+    for (size_t i = 0; i < HOST_EVENT_HANDLERS; ++i) {
+        if (s_handlers[i].handler == NULL) {
+            s_handlers[i] = (host_event_handler_t){ base, id, handler, arg };
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t base, int32_t id, esp_event_handler_t handler) {
+    for (size_t i = 0; i < HOST_EVENT_HANDLERS; ++i) {
+        host_event_handler_t *h = &s_handlers[i];
+        if (h->handler == handler && h->base == base && h->id == id) {
+            memset(h, 0, sizeof(*h));
+        }
+    }
+    return ESP_OK;
+}
+
+int host_hap_open(uint16_t peer_port) {
+    for (int fd = 0; fd < CONFIG_LWIP_MAX_SOCKETS; ++fd) {
+        host_socket_t *sock = &s_sockets[fd];
+        if (!sock->open) {
+            memset(sock, 0, sizeof(*sock));
+            sock->open = true;
+            sock->shut_how = -1;
+            sock->peer.sin_family = AF_INET;
+            sock->peer.sin_addr.s_addr = htonl(0xC0A80164U);  // 192.168.1.100
+            sock->peer.sin_port = htons(peer_port);
+            return fd + LWIP_SOCKET_OFFSET;
+        }
+    }
+    return -1;
+}
+
+static host_socket_t *host_socket(int fd) {
+    int slot = fd - LWIP_SOCKET_OFFSET;
+    if (slot < 0 || slot >= CONFIG_LWIP_MAX_SOCKETS || !s_sockets[slot].open) {
+        return NULL;
+    }
+    return &s_sockets[slot];
+}
+
+void host_hap_close(int fd) {
+    host_socket_t *sock = host_socket(fd);
+    if (sock != NULL) {
+        sock->open = false;
+    }
+}
+
+int host_hap_shut(int fd) {
+    host_socket_t *sock = host_socket(fd);
+    return (sock != NULL) ? sock->shut_how : -1;
+}
+
+int host_getsockopt(int fd, int level, int name, void *value, socklen_t *len) {
+    s_stats.socket_probes++;
+    if (host_socket(fd) == NULL || level != SOL_SOCKET || name != SO_TYPE || *len < sizeof(int)) {
+        return -1;
+    }
+    *(int *)value = SOCK_STREAM;
+    *len = sizeof(int);
+    return 0;
+}
+
+int host_setsockopt(int fd, int level, int name, const void *value, socklen_t len) {
+    (void)level;
+    (void)name;
+    (void)value;
+    (void)len;
+    return (host_socket(fd) != NULL) ? 0 : -1;
+}
+
+int host_getsockname(int fd, struct sockaddr *addr, socklen_t *len) {
+    if (host_socket(fd) == NULL || *len < sizeof(struct sockaddr_in)) {
+        return -1;
+    }
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_LCM_HAP_PORT),
+    };
+    memcpy(addr, &local, sizeof(local));
+    *len = sizeof(local);
+    return 0;
+}
+
+int host_getpeername(int fd, struct sockaddr *addr, socklen_t *len) {
+    host_socket_t *sock = host_socket(fd);
+    if (sock == NULL || *len < sizeof(struct sockaddr_in)) {
+        return -1;
+    }
+    memcpy(addr, &sock->peer, sizeof(sock->peer));
+    *len = sizeof(sock->peer);
+    return 0;
+}
+
+int host_shutdown(int fd, int how) {
+    host_socket_t *sock = host_socket(fd);
+    if (sock == NULL) {
+        return -1;
+    }
+    // SHUT_WR after SHUT_RDWR stays a full shutdown
+    if (sock->shut_how != SHUT_RDWR) {
+        sock->shut_how = how;
+    }
+    return 0;
+}
+
+esp_err_t esp_netif_init(void) { return ESP_OK; }
+esp_netif_t *esp_netif_create_default_wifi_sta(void) { return &s_netif; }
+void esp_netif_destroy(esp_netif_t *netif) { (void)netif; }
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif) { (void)netif; return ESP_OK; }
+void *esp_netif_get_netif_impl(esp_netif_t *netif) { (void)netif; return NULL; }
+struct dhcp *netif_dhcp_data(struct netif *netif) { (void)netif; return NULL; }
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info) {
+    (void)netif;
+    (void)ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns) {
+    (void)netif;
+    (void)type;
+    memset(dns, 0, sizeof(*dns));
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns) {
+    (void)netif;
+    (void)type;
+    (void)dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_str_to_ip4(const char *src, esp_ip4_addr_t *dst) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, src, &addr) != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dst->addr = addr.s_addr;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { (void)config; return ESP_OK; }
+esp_err_t esp_wifi_deinit(void) { return ESP_OK; }
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) { (void)storage; return ESP_OK; }
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) { (void)mode; return ESP_OK; }
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) { (void)type; return ESP_OK; }
+esp_err_t esp_wifi_start(void) { return ESP_OK; }
+esp_err_t esp_wifi_stop(void) { return ESP_OK; }
+esp_err_t esp_wifi_scan_stop(void) { return ESP_OK; }
+esp_err_t esp_wifi_clear_ap_list(void) { return ESP_OK; }
+esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi) { (void)rssi; return ESP_OK; }
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    (void)interface;
+    (void)conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    s_stats.wifi_connects++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    s_stats.wifi_disconnects++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_restore(void) {
+    s_stats.wifi_restores++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block) {
+    (void)config;
+    (void)block;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records) {
+    (void)ap_records;
+    *number = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    (void)ap_info;
+    return ESP_ERR_WIFI_NOT_STARTED;
+}
+
+bool esp_rrm_is_rrm_supported_connection(void) { return false; }
+int esp_rrm_send_neighbor_rep_request(neighbor_rep_request_cb cb, void *cb_ctx) {
+    (void)cb;
+    (void)cb_ctx;
+    return -1;
+}
+bool esp_wnm_is_btm_supported_connection(void) { return false; }
+int esp_wnm_send_bss_transition_mgmt_query(enum btm_query_reason query_reason,
+                                           const char *btm_candidates, int cand_list) {
+    (void)query_reason;
+    (void)btm_candidates;
+    (void)cand_list;
+    return -1;
+}
+
+esp_err_t esp_pm_configure(const void *config) { (void)config; return ESP_OK; }
+esp_err_t esp_sleep_enable_gpio_wakeup(void) { return ESP_OK; }
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type) {
+    (void)gpio;
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_remove(const char *service_type, const char *proto) {
+    (void)service_type;
+    (void)proto;
+    s_stats.mdns_removes++;
+    return ESP_OK;
+}
+
+esp_err_t mdns_netif_action(esp_netif_t *esp_netif, uint32_t event_actions) {
+    (void)esp_netif;
+    (void)event_actions;
+    return ESP_OK;
+}
+
+void mdns_free(void) {
+    s_stats.mdns_frees++;
+}
+
+void homekit_server_reset(void) {
+    s_stats.homekit_resets++;
+    s_stats.homekit_reset_us = esp_timer_get_time();
+}
+
+void notify_scheduler_submit(homekit_characteristic_t *characteristic,
+                             homekit_value_t value,
+                             notify_priority_t priority) {
+    (void)characteristic;
+    (void)value;
+    (void)priority;
+}
+
+void event_trace_record(event_trace_event_t event, uint16_t a, uint32_t b) {
+    (void)event;
+    (void)a;
+    (void)b;
+}
+
+void event_trace_dump_previous(const char *log_tag) {
+    (void)log_tag;
+}
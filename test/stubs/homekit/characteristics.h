@@ -0,0 +1,78 @@
+#pragma once
+
+// Host build: de homekit_value_t/homekit_characteristic_t velden die
+// main/esp32-lcm.c en de lifecycle headers gebruiken.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    homekit_format_bool,
+    homekit_format_uint8,
+    homekit_format_uint16,
+    homekit_format_uint32,
+    homekit_format_uint64,
+    homekit_format_int,
+    homekit_format_float,
+    homekit_format_string,
+    homekit_format_tlv,
+    homekit_format_data,
+} homekit_format_t;
+
+typedef enum {
+    homekit_unit_none,
+    homekit_unit_seconds,
+} homekit_unit_t;
+
+typedef enum {
+    homekit_permissions_paired_read = 1,
+    homekit_permissions_paired_write = 2,
+    homekit_permissions_notify = 4,
+} homekit_permissions_t;
+
+typedef struct {
+    homekit_format_t format;
+    bool is_null;
+    bool is_static;
+    union {
+        bool bool_value;
+        int int_value;
+        uint8_t uint8_value;
+        uint16_t uint16_value;
+        uint32_t uint32_value;
+        uint64_t uint64_value;
+        float float_value;
+        char *string_value;
+    };
+} homekit_value_t;
+
+typedef struct _homekit_characteristic homekit_characteristic_t;
+
+struct _homekit_characteristic {
+    const char *type;
+    const char *description;
+    homekit_format_t format;
+    homekit_unit_t unit;
+    homekit_permissions_t permissions;
+    int max_len;
+    homekit_value_t value;
+    homekit_value_t (*getter)(void);
+    void (*setter)(const homekit_value_t value);
+    homekit_value_t (*getter_ex)(const homekit_characteristic_t *ch);
+    void (*setter_ex)(homekit_characteristic_t *ch, const homekit_value_t value);
+};
+
+#define HOMEKIT_BOOL_(value, ...) { .format = homekit_format_bool, .bool_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_BOOL(value, ...) ((homekit_value_t) HOMEKIT_BOOL_(value, ##__VA_ARGS__))
+#define HOMEKIT_UINT32_(value, ...) { .format = homekit_format_uint32, .uint32_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_UINT32(value, ...) ((homekit_value_t) HOMEKIT_UINT32_(value, ##__VA_ARGS__))
+#define HOMEKIT_STRING_(value, ...) { .format = homekit_format_string, .string_value = (value), ##__VA_ARGS__ }
+#define HOMEKIT_STRING(value, ...) ((homekit_value_t) HOMEKIT_STRING_(value, ##__VA_ARGS__))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+// Host build: types van esp32-homekit die main/esp32-lcm.c gebruikt.
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "characteristics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    HOMEKIT_EVENT_SERVER_INITIALIZED,
+    HOMEKIT_EVENT_CLIENT_CONNECTED,
+    HOMEKIT_EVENT_CLIENT_VERIFIED,
+    HOMEKIT_EVENT_CLIENT_DISCONNECTED,
+    HOMEKIT_EVENT_PAIRING_ADDED,
+    HOMEKIT_EVENT_PAIRING_REMOVED,
+} homekit_event_t;
+
+void homekit_server_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../host-idf.h"
+
+// De socket calls van main/esp32-lcm.c gaan naar de HAP sessies van het
+// host model (test/mocks/host-platform.c), niet naar de descriptors van het
+// testproces.
+#define getsockopt  host_getsockopt
+#define setsockopt  host_setsockopt
+#define getsockname host_getsockname
+#define getpeername host_getpeername
+#define shutdown    host_shutdown
+
+int host_getsockopt(int fd, int level, int name, void *value, socklen_t *len);
+int host_setsockopt(int fd, int level, int name, const void *value, socklen_t len);
+int host_getsockname(int fd, struct sockaddr *addr, socklen_t *len);
+int host_getpeername(int fd, struct sockaddr *addr, socklen_t *len);
+int host_shutdown(int fd, int how);
@@ -0,0 +1,89 @@
+#pragma once
+
+// Host build: the tinfl API of the ESP-IDF ROM miniz as used by
+// main/ota-stream.c, on top of the system zlib. The caller's circular
+// dictionary is only written to; zlib keeps its own window.
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE              32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER    1
+#define TINFL_FLAG_HAS_MORE_INPUT       2
+#define TINFL_FLAG_COMPUTE_ADLER32      8
+
+typedef enum {
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+// ota-stream.c frees the decompressor with free(); zlib's state is kept in
+// a static arena so nothing leaks. One stream at a time, like on the device.
+typedef struct {
+    z_stream zs;
+    int ready;
+} tinfl_decompressor;
+
+static unsigned char s_tinfl_arena[64 * 1024];
+static size_t s_tinfl_arena_used;
+
+static voidpf tinfl_host_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    size_t len = ((size_t)items * size + 15U) & ~(size_t)15U;
+    if (s_tinfl_arena_used + len > sizeof(s_tinfl_arena)) {
+        return Z_NULL;
+    }
+    voidpf p = s_tinfl_arena + s_tinfl_arena_used;
+    s_tinfl_arena_used += len;
+    return p;
+}
+
+static void tinfl_host_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    (void)address;
+}
+
+static inline void tinfl_init(tinfl_decompressor *d) {
+    memset(d, 0, sizeof(*d));
+    s_tinfl_arena_used = 0;
+    d->zs.zalloc = tinfl_host_alloc;
+    d->zs.zfree = tinfl_host_free;
+    d->ready = inflateInit(&d->zs) == Z_OK;
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *d, const uint8_t *in, size_t *in_len,
+                                            uint8_t *out_start, uint8_t *out_next, size_t *out_len,
+                                            mz_uint32 flags) {
+    (void)out_start;
+    (void)flags;
+    if (!d->ready) {
+        *in_len = 0;
+        *out_len = 0;
+        return TINFL_STATUS_FAILED;
+    }
+
+    d->zs.next_in = (Bytef *)in;
+    d->zs.avail_in = (uInt)*in_len;
+    d->zs.next_out = out_next;
+    d->zs.avail_out = (uInt)*out_len;
+    int ret = inflate(&d->zs, Z_NO_FLUSH);
+    *in_len -= d->zs.avail_in;
+    *out_len -= d->zs.avail_out;
+
+    if (ret == Z_STREAM_END) {
+        return TINFL_STATUS_DONE;
+    }
+    if (ret == Z_OK || ret == Z_BUF_ERROR) {
+        return (d->zs.avail_out == 0) ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+    }
+    if (ret == Z_DATA_ERROR && d->zs.msg != NULL && strstr(d->zs.msg, "check") != NULL) {
+        return TINFL_STATUS_ADLER32_MISMATCH;
+    }
+    return TINFL_STATUS_FAILED;
+}
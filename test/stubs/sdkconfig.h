@@ -0,0 +1,58 @@
+#pragma once
+
+// Host build: Kconfig defaults van main/Kconfig.projbuild. Booleans zijn 0/1
+// zodat test/CMakeLists.txt een variant kan bouwen met -DCONFIG_...=0.
+#ifndef CONFIG_LWIP_MAX_SOCKETS
+#define CONFIG_LWIP_MAX_SOCKETS 16
+#endif
+#ifndef CONFIG_ESP_EVENT_TRACE
+#define CONFIG_ESP_EVENT_TRACE 0
+#endif
+#ifndef CONFIG_LCM_WIFI_FAST_RECONNECT
+#define CONFIG_LCM_WIFI_FAST_RECONNECT 1
+#endif
+#ifndef CONFIG_LCM_WIFI_ROAMING
+#define CONFIG_LCM_WIFI_ROAMING 0
+#endif
+#ifndef CONFIG_LCM_WIFI_IP_DHCP_CACHE
+#define CONFIG_LCM_WIFI_IP_DHCP_CACHE 0
+#endif
+#ifndef CONFIG_LCM_WIFI_IP_STATIC
+#define CONFIG_LCM_WIFI_IP_STATIC 0
+#endif
+#ifndef CONFIG_LCM_POWER_PROFILE_BALANCED
+#define CONFIG_LCM_POWER_PROFILE_BALANCED 0
+#endif
+#ifndef CONFIG_LCM_POWER_PROFILE_ECO
+#define CONFIG_LCM_POWER_PROFILE_ECO 0
+#endif
+#ifndef CONFIG_LCM_HAP_PORT
+#define CONFIG_LCM_HAP_PORT 5556
+#endif
+#ifndef CONFIG_LCM_HAP_ADAPTIVE_CLIENTS
+#define CONFIG_LCM_HAP_ADAPTIVE_CLIENTS 1
+#endif
+#ifndef CONFIG_LCM_HAP_SESSION_HEAP_BYTES
+#define CONFIG_LCM_HAP_SESSION_HEAP_BYTES 8192
+#endif
+#ifndef CONFIG_LCM_HAP_HEAP_RESERVE_BYTES
+#define CONFIG_LCM_HAP_HEAP_RESERVE_BYTES 24576
+#endif
+#ifndef CONFIG_LCM_UPDATE_IN_APP
+#define CONFIG_LCM_UPDATE_IN_APP 0
+#endif
+#ifndef CONFIG_LCM_FAST_FACTORY_RESET
+#define CONFIG_LCM_FAST_FACTORY_RESET 1
+#endif
+#ifndef CONFIG_LCM_RESTART_COUNTER_TIMEOUT_MS
+#define CONFIG_LCM_RESTART_COUNTER_TIMEOUT_MS 5000
+#endif
+#ifndef CONFIG_LCM_WIFI_RECONNECT_BASE_MS
+#define CONFIG_LCM_WIFI_RECONNECT_BASE_MS 250
+#endif
+#ifndef CONFIG_LCM_WIFI_RECONNECT_MAX_MS
+#define CONFIG_LCM_WIFI_RECONNECT_MAX_MS 30000
+#endif
+#ifndef CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS
+#define CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS 1000
+#endif
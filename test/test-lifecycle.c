@@ -0,0 +1,712 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+// Host regressie- en benchmark suite voor main/esp32-lcm.c: NVS record,
+// restart counter, factory reset, update request, Wi-Fi backoff en boot
+// timeline. Elke gemeten operatie print zijn flash I/O en (gemodelleerde)
+// tijd en wordt getoetst aan k_budgets.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <homekit/homekit.h>
+
+#include "esp32-lcm.h"
+
+#include "host-device.h"
+
+#define TEST_TAG "TEST"
+
+// ---- Budgets ------------------------------------------------------------
+
+// Upper bounds per scenario. A change that needs more flash I/O has to raise
+// the number here, so the cost shows up in review.
+typedef struct {
+    const char *scenario;
+    lifecycle_io_op_t op;
+    uint32_t max_nvs_reads;
+    uint32_t max_nvs_writes;
+    uint32_t max_entry_writes;
+    uint32_t max_sector_erases;
+    uint64_t max_device_us;
+} io_budget_t;
+
+static const io_budget_t k_budgets[] = {
+    { "first_boot",        LIFECYCLE_IO_POST_RESET_STATE,        0, 1, 5,   0,   1000 },
+    { "first_boot",        LIFECYCLE_IO_FIRMWARE_REVISION,       1, 2, 9,   0,   1500 },
+    { "warm_boot",         LIFECYCLE_IO_POST_RESET_STATE,        0, 1, 6,   0,   1000 },
+    { "warm_boot",         LIFECYCLE_IO_FIRMWARE_REVISION,       0, 0, 0,   0,   50 },
+    { "new_firmware",      LIFECYCLE_IO_POST_RESET_STATE,        0, 1, 6,   0,   1000 },
+    { "new_firmware",      LIFECYCLE_IO_FIRMWARE_REVISION,       1, 1, 6,   0,   1000 },
+    { "counter_timeout",   LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT, 0, 1, 6,   0,   1000 },
+    { "update_request",    LIFECYCLE_IO_UPDATE_REQUEST,          0, 1, 2,   1,   50000 },
+#if CONFIG_LCM_FAST_FACTORY_RESET
+    { "factory_reset",     LIFECYCLE_IO_FACTORY_RESET,           0, 1, 6,   11,  500000 },
+#else
+    { "factory_reset",     LIFECYCLE_IO_FACTORY_RESET,           0, 1, 10,  745, 33600000 },
+#endif
+};
+
+static const io_budget_t *find_budget(const char *scenario, lifecycle_io_op_t op) {
+    for (size_t i = 0; i < sizeof(k_budgets) / sizeof(k_budgets[0]); ++i) {
+        if (k_budgets[i].op == op && strcmp(k_budgets[i].scenario, scenario) == 0) {
+            return &k_budgets[i];
+        }
+    }
+    return NULL;
+}
+
+// ---- Measurement --------------------------------------------------------
+
+static const char *const k_op_names[LIFECYCLE_IO_OP_COUNT] = {
+    [LIFECYCLE_IO_POST_RESET_STATE] = "post_reset_state",
+    [LIFECYCLE_IO_FIRMWARE_REVISION] = "firmware_revision",
+    [LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT] = "restart_counter_timeout",
+    [LIFECYCLE_IO_UPDATE_REQUEST] = "update_request",
+    [LIFECYCLE_IO_FACTORY_RESET] = "factory_reset",
+};
+
+typedef struct {
+    const char *scenario;
+    lifecycle_io_op_t op;
+    host_flash_stats_t flash;
+    lifecycle_io_cost_t cost;
+    uint64_t wall_start_us;
+} measure_t;
+
+static void measure_begin(measure_t *m, const char *scenario, lifecycle_io_op_t op) {
+    m->scenario = scenario;
+    m->op = op;
+    host_flash_get_stats(&m->flash);
+    lifecycle_get_io_cost(op, &m->cost);
+    m->wall_start_us = host_wall_us();
+}
+
+static void measure_end(measure_t *m) {
+    uint64_t wall_us = host_wall_us() - m->wall_start_us;
+    host_flash_stats_t flash;
+    host_flash_stats_diff(&m->flash, &flash);
+    lifecycle_io_cost_t cost;
+    lifecycle_get_io_cost(m->op, &cost);
+
+    const lifecycle_nvs_stats_t *nvs = &cost.nvs;
+    printf("  %-16s %-24s nvs o/r/w/e/c %" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
+           "  entries r/w %" PRIu32 "/%" PRIu32 "  erases %" PRIu32 " (%" PRIu64 " B)"
+           "  device %.2f ms  host %" PRIu64 " us\n",
+           m->scenario, k_op_names[m->op],
+           nvs->opens, nvs->reads, nvs->writes, nvs->erases, nvs->commits,
+           flash.entry_reads, flash.entry_writes, flash.sector_erases, flash.erase_bytes,
+           (double)cost.last_us / 1000.0, wall_us);
+
+    // The operation ran exactly once and every NVS call was counted by the
+    // lifecycle layer itself
+    HOST_CHECK(cost.runs == m->cost.runs + 1U);
+    HOST_CHECK(nvs->opens + nvs->reads + nvs->writes + nvs->erases + nvs->commits == flash.nvs_calls);
+    HOST_CHECK(flash.erase_bytes >= cost.partition_erase_bytes);
+
+    const io_budget_t *budget = find_budget(m->scenario, m->op);
+    if (HOST_CHECK(budget != NULL)) {
+        HOST_CHECK(nvs->reads <= budget->max_nvs_reads);
+        HOST_CHECK(nvs->writes <= budget->max_nvs_writes);
+        HOST_CHECK(flash.entry_writes <= budget->max_entry_writes);
+        HOST_CHECK(flash.sector_erases <= budget->max_sector_erases);
+        HOST_CHECK(cost.last_us <= budget->max_device_us);
+    }
+}
+
+static void measure_end_hook(void *arg) {
+    measure_end((measure_t *)arg);
+}
+
+// ---- Boot helpers -------------------------------------------------------
+
+static homekit_characteristic_t s_revision;
+
+typedef struct {
+    const char *scenario;
+} boot_args_t;
+
+// The lifecycle part of app_main: NVS, post-reset state, firmware revision
+static void boot_lifecycle(void *arg) {
+    const boot_args_t *args = arg;
+    const char *scenario = (args != NULL) ? args->scenario : NULL;
+    measure_t m;
+
+    lifecycle_boot_mark(LIFECYCLE_BOOT_APP_MAIN);
+    HOST_CHECK(lifecycle_nvs_init() == ESP_OK);
+    lifecycle_boot_mark(LIFECYCLE_BOOT_NVS_INIT);
+
+    if (scenario != NULL) {
+        measure_begin(&m, scenario, LIFECYCLE_IO_POST_RESET_STATE);
+        host_on_restart(measure_end_hook, &m);
+    }
+    lifecycle_log_post_reset_state(TEST_TAG);
+    if (scenario != NULL) {
+        host_on_restart(NULL, NULL);
+        measure_end(&m);
+    }
+    lifecycle_boot_mark(LIFECYCLE_BOOT_POST_RESET_STATE);
+
+    memset(&s_revision, 0, sizeof(s_revision));
+    if (scenario != NULL) {
+        measure_begin(&m, scenario, LIFECYCLE_IO_FIRMWARE_REVISION);
+    }
+    HOST_CHECK(lifecycle_init_firmware_revision(&s_revision, "0.0.1") == ESP_OK);
+    if (scenario != NULL) {
+        measure_end(&m);
+    }
+    lifecycle_boot_mark(LIFECYCLE_BOOT_CONFIGURE_HOMEKIT);
+}
+
+static bool run_boot(host_boot_fn_t fn, void *arg, host_boot_result_t *result) {
+    host_boot_result_t local;
+    bool ok = host_boot(fn, arg, result != NULL ? result : &local);
+    return ok;
+}
+
+// ---- Tests --------------------------------------------------------------
+
+static void check_first_boot(void *arg) {
+    boot_lifecycle(arg);
+    HOST_CHECK(host_log_contains("consecutive_restart_count=1"));
+    HOST_CHECK(strcmp(s_revision.value.string_value, "1.0.0") == 0);
+    HOST_CHECK(strcmp(lifecycle_get_firmware_revision_string(), "1.0.0") == 0);
+}
+
+static void check_warm_boot(void *arg) {
+    boot_lifecycle(arg);
+    HOST_CHECK(host_log_contains("consecutive_restart_count=2"));
+    HOST_CHECK(host_log_contains("Firmware revision set to 1.0.0 (stored)"));
+}
+
+static void test_first_and_warm_boot(void) {
+    boot_args_t first = { "first_boot" };
+    boot_args_t warm = { "warm_boot" };
+
+    run_boot(check_first_boot, &first, NULL);
+    HOST_CHECK(host_nvs_has_key("lcm", "state"));
+    HOST_CHECK(host_nvs_has_key("fwcfg", "installed_ver"));
+    HOST_CHECK(!host_nvs_has_key("lcm", "restart_count"));
+
+    // Crash before the restart counter timeout: the warm boot counts it
+    run_boot(check_warm_boot, &warm, NULL);
+}
+
+static void check_new_firmware(void *arg) {
+    boot_lifecycle(arg);
+    // The factory LCM wrote fwcfg/installed_ver for the new image
+    HOST_CHECK(strcmp(s_revision.value.string_value, "1.1.0") == 0);
+}
+
+static void check_counter_timeout(void *arg) {
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_timer_armed("restart_cnt_reset"));
+
+    measure_t m;
+    measure_begin(&m, (const char *)arg, LIFECYCLE_IO_RESTART_COUNTER_TIMEOUT);
+    host_advance_ms(CONFIG_LCM_RESTART_COUNTER_TIMEOUT_MS);
+    measure_end(&m);
+    HOST_CHECK(!host_timer_armed("restart_cnt_reset"));
+}
+
+static void check_counter_cleared(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_log_contains("consecutive_restart_count=1"));
+}
+
+static void test_firmware_update_and_counter_timeout(void) {
+    run_boot(boot_lifecycle, NULL, NULL);
+
+    host_set_app_version("1.1.0");
+    HOST_CHECK(host_nvs_seed_str("fwcfg", "installed_ver", "1.1.0") == ESP_OK);
+    boot_args_t args = { "new_firmware" };
+    run_boot(check_new_firmware, &args, NULL);
+
+    run_boot(check_counter_timeout, "counter_timeout", NULL);
+    run_boot(check_counter_cleared, NULL, NULL);
+}
+
+static void check_storm_boot(void *arg) {
+    int expected = *(int *)arg;
+    char line[48];
+    boot_lifecycle(NULL);
+    snprintf(line, sizeof(line), "consecutive_restart_count=%d", expected);
+    HOST_CHECK(host_log_contains(line));
+}
+
+static void check_storm_reset(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    // Only reached when the countdown did not reset and reboot
+    HOST_CHECK(false);
+}
+
+static void check_after_factory_reset(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_log_contains("post_reset_flag=factory"));
+    HOST_CHECK(host_log_contains("consecutive_restart_count=1"));
+}
+
+static void test_restart_storm(void) {
+    for (int count = 1; count <= 9; ++count) {
+        run_boot(check_storm_boot, &count, NULL);
+    }
+
+    host_boot_result_t result;
+    run_boot(check_storm_reset, NULL, &result);
+    HOST_CHECK(result.restarted);
+    // 11 s countdown before the reset
+    HOST_CHECK(result.uptime_us >= 11000000);
+    HOST_CHECK(host_boot_subtype() == ESP_PARTITION_SUBTYPE_APP_FACTORY);
+    HOST_CHECK(!host_nvs_has_key("lcm", "state"));
+    HOST_CHECK(!host_nvs_has_key("fwcfg", "installed_ver"));
+
+    run_boot(check_after_factory_reset, NULL, NULL);
+}
+
+static void check_factory_reset(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+
+    static measure_t m;
+    measure_begin(&m, "factory_reset", LIFECYCLE_IO_FACTORY_RESET);
+    host_on_restart(measure_end_hook, &m);
+    lifecycle_factory_reset_and_reboot();
+    HOST_CHECK(false);
+}
+
+static void test_factory_reset(void) {
+    HOST_CHECK(host_nvs_seed_str("wifi_cfg", "wifi_ssid", "plug-net") == ESP_OK);
+    HOST_CHECK(host_nvs_seed_str("wifi_cfg", "wifi_password", "secret123") == ESP_OK);
+
+    host_boot_result_t result;
+    run_boot(check_factory_reset, NULL, &result);
+    HOST_CHECK(result.restarted);
+    HOST_CHECK(host_boot_subtype() == ESP_PARTITION_SUBTYPE_APP_FACTORY);
+    HOST_CHECK(!host_nvs_has_key("wifi_cfg", "wifi_ssid"));
+    HOST_CHECK(!host_nvs_has_key("lcm", "state"));
+
+#if CONFIG_LCM_FAST_FACTORY_RESET
+    // Image headers only
+    HOST_CHECK(host_partition_erased(ESP_PARTITION_SUBTYPE_APP_OTA_0) == 0x1000);
+    HOST_CHECK(host_partition_erased(ESP_PARTITION_SUBTYPE_APP_OTA_1) == 0x1000);
+#else
+    HOST_CHECK(host_partition_erased(ESP_PARTITION_SUBTYPE_APP_OTA_0) == 0x170000);
+    HOST_CHECK(host_partition_erased(ESP_PARTITION_SUBTYPE_APP_OTA_1) == 0x170000);
+#endif
+    HOST_CHECK(host_partition_erased(ESP_PARTITION_SUBTYPE_APP_FACTORY) == 0);
+}
+
+static void hap_event(homekit_event_t event) {
+    host_set_current_task(HOST_TASK_HOMEKIT_SERVER);
+    lifecycle_homekit_event(event);
+    host_set_current_task(HOST_TASK_MAIN);
+}
+
+#define DRAIN_MAX_SESSIONS 4
+
+typedef struct {
+    int sessions;
+    int disconnects;              // controllers that close within the drain
+    int closed;
+    int fds[DRAIN_MAX_SESSIONS];
+    int64_t start_us;
+    int64_t last_disconnect_us;
+} drain_sim_t;
+
+// The server task reaps one half-closed session per wait
+static void drain_wait_hook(void *arg) {
+    drain_sim_t *sim = arg;
+    if (sim->disconnects > 0) {
+        host_advance_ms(20);
+        // The controller saw our FIN and closes its side
+        HOST_CHECK(host_hap_shut(sim->fds[sim->closed]) == SHUT_WR);
+        host_hap_close(sim->fds[sim->closed++]);
+        sim->disconnects--;
+        sim->last_disconnect_us = esp_timer_get_time();
+        hap_event(HOMEKIT_EVENT_CLIENT_DISCONNECTED);
+    }
+}
+
+static void drain_check_restart(void *arg) {
+    const drain_sim_t *sim = arg;
+    host_platform_stats_t platform;
+    host_platform_get_stats(&platform);
+
+    char line[48];
+    snprintf(line, sizeof(line), "drained %d HAP session(s)", sim->sessions);
+    HOST_CHECK(host_log_contains(line));
+    HOST_CHECK(platform.homekit_resets == 1);
+    // Sessions still open were half-closed, not torn down
+    for (int i = sim->closed; i < sim->sessions; ++i) {
+        HOST_CHECK(host_hap_shut(sim->fds[i]) == SHUT_WR);
+    }
+    // Pairings are removed after the last session closed or the drain timed out
+    HOST_CHECK(platform.homekit_reset_us >= sim->last_disconnect_us);
+    if (sim->disconnects > 0 || sim->last_disconnect_us == 0) {
+        HOST_CHECK(platform.homekit_reset_us - sim->start_us >= CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS * 1000LL);
+    } else {
+        HOST_CHECK(platform.homekit_reset_us - sim->start_us < CONFIG_LCM_SHUTDOWN_DRAIN_TIMEOUT_MS * 1000LL);
+    }
+    printf("  %-16s %d session(s), pairings reset after %.1f ms\n", "drain",
+           sim->sessions, (double)(platform.homekit_reset_us - sim->start_us) / 1000.0);
+}
+
+static void check_factory_drain(void *arg) {
+    drain_sim_t *sim = arg;
+    boot_lifecycle(NULL);
+    for (int i = 0; i < sim->sessions; ++i) {
+        sim->fds[i] = host_hap_open((uint16_t)(40000 + i));
+        HOST_CHECK(sim->fds[i] >= 0);
+        hap_event(HOMEKIT_EVENT_CLIENT_CONNECTED);
+    }
+
+    sim->start_us = esp_timer_get_time();
+    host_on_wait(drain_wait_hook, sim);
+    host_on_restart(drain_check_restart, sim);
+    lifecycle_factory_reset_and_reboot();
+    HOST_CHECK(false);
+}
+
+static void test_shutdown_drain(void) {
+    // Both controllers close their side
+    drain_sim_t closing = { .sessions = 2, .disconnects = 2 };
+    run_boot(check_factory_drain, &closing, NULL);
+
+    // Nobody closes: the reset waits for the drain timeout
+    host_device_reset();
+    drain_sim_t stuck = { .sessions = 2, .disconnects = 0 };
+    run_boot(check_factory_drain, &stuck, NULL);
+}
+
+// ---- HAP client budget ---------------------------------------------------
+
+#define HAP_BUDGET_MAX_CLIENTS  16
+
+static uint32_t socket_probes(void) {
+    host_platform_stats_t platform;
+    host_platform_get_stats(&platform);
+    return platform.socket_probes;
+}
+
+// The budget becomes the server's max_clients: free heap above the reserve
+// divided by the session cost, capped and never below one controller.
+static void check_hap_budget(void *arg) {
+    (void)arg;
+    host_set_free_heap(CONFIG_LCM_HAP_HEAP_RESERVE_BYTES + 8 * CONFIG_LCM_HAP_SESSION_HEAP_BYTES + 4096);
+    HOST_CHECK(lifecycle_hap_configure_client_budget(HAP_BUDGET_MAX_CLIENTS) == 8);
+
+    host_set_free_heap(CONFIG_LCM_HAP_HEAP_RESERVE_BYTES + 64 * CONFIG_LCM_HAP_SESSION_HEAP_BYTES);
+    HOST_CHECK(lifecycle_hap_configure_client_budget(HAP_BUDGET_MAX_CLIENTS) == HAP_BUDGET_MAX_CLIENTS);
+
+    host_set_free_heap(CONFIG_LCM_HAP_HEAP_RESERVE_BYTES - 1024);
+    HOST_CHECK(lifecycle_hap_configure_client_budget(HAP_BUDGET_MAX_CLIENTS) == 1);
+
+    // Connect events only count sessions; the server enforces the limit
+    uint32_t probes = socket_probes();
+    for (int i = 0; i < 3; ++i) {
+        hap_event(HOMEKIT_EVENT_CLIENT_CONNECTED);
+    }
+    hap_event(HOMEKIT_EVENT_CLIENT_DISCONNECTED);
+    HOST_CHECK(socket_probes() == probes);
+
+    lifecycle_hap_client_stats_t stats;
+    lifecycle_get_hap_client_stats(&stats);
+    HOST_CHECK(stats.budget == 1);
+    HOST_CHECK(stats.sessions == 2);
+    HOST_CHECK(stats.peak_sessions == 3);
+}
+
+static void test_hap_budget(void) {
+    run_boot(check_hap_budget, NULL, NULL);
+}
+
+static void check_update_request(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+
+    static measure_t m;
+    measure_begin(&m, "update_request", LIFECYCLE_IO_UPDATE_REQUEST);
+    host_on_restart(measure_end_hook, &m);
+    lifecycle_request_update_and_reboot();
+    HOST_CHECK(false);
+}
+
+static void check_after_update(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_log_contains("post_reset_flag=update"));
+}
+
+static void test_update_request(void) {
+    host_boot_result_t result;
+    run_boot(check_update_request, NULL, &result);
+    HOST_CHECK(result.restarted);
+    HOST_CHECK(host_boot_subtype() == ESP_PARTITION_SUBTYPE_APP_FACTORY);
+    HOST_CHECK(host_nvs_has_key("lcm", "do_update"));
+    // The factory LCM only gets the flag, no payload formats it cannot decode
+    HOST_CHECK(!host_nvs_has_key("lcm", "upd_caps"));
+    run_boot(check_after_update, NULL, NULL);
+}
+
+static void check_migration(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_log_contains("consecutive_restart_count=4"));
+}
+
+static void test_legacy_migration(void) {
+    const uint8_t fast[8] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01, 6, WIFI_AUTH_WPA2_PSK };
+    HOST_CHECK(host_nvs_seed_u32("lcm", "restart_count", 3) == ESP_OK);
+    HOST_CHECK(host_nvs_seed_blob("wifi_cfg", "wifi_fast", fast, sizeof(fast)) == ESP_OK);
+
+    run_boot(check_migration, NULL, NULL);
+    HOST_CHECK(host_nvs_has_key("lcm", "state"));
+    HOST_CHECK(!host_nvs_has_key("lcm", "restart_count"));
+}
+
+static void check_corrupt_record(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(host_log_contains("Lifecycle record invalid"));
+    // The counter continues; the firmware revision is read from fwcfg again
+    HOST_CHECK(host_log_contains("consecutive_restart_count=2"));
+    HOST_CHECK(host_log_contains("Firmware revision set to 1.0.0 (stored)"));
+}
+
+static void check_nvs_recovery(void *arg) {
+    (void)arg;
+    host_flash_stats_t before;
+    host_flash_stats_t delta;
+    host_flash_get_stats(&before);
+    HOST_CHECK(lifecycle_nvs_init() == ESP_OK);
+    host_flash_stats_diff(&before, &delta);
+    HOST_CHECK(host_log_contains("attempting erase"));
+    HOST_CHECK(delta.erase_bytes == 0x6000);
+}
+
+static void test_record_recovery(void) {
+    run_boot(boot_lifecycle, NULL, NULL);
+    HOST_CHECK(host_nvs_corrupt_blob("lcm", "state") == ESP_OK);
+    run_boot(check_corrupt_record, NULL, NULL);
+
+    host_nvs_fail_next_init(ESP_ERR_NVS_NO_FREE_PAGES);
+    run_boot(check_nvs_recovery, NULL, NULL);
+}
+
+static void post_disconnect(uint8_t reason) {
+    wifi_event_sta_disconnected_t disc = { .reason = reason };
+    host_post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disc);
+}
+
+static void post_connected(const uint8_t bssid[6], uint8_t channel) {
+    wifi_event_sta_connected_t conn = { .channel = channel, .authmode = WIFI_AUTH_WPA2_PSK };
+    memcpy(conn.bssid, bssid, sizeof(conn.bssid));
+    host_post_event(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &conn);
+}
+
+static void post_got_ip(uint32_t addr) {
+    ip_event_got_ip_t got = { .ip_info = { .ip = { addr } } };
+    host_post_event(IP_EVENT, IP_EVENT_STA_GOT_IP, &got);
+}
+
+static const uint8_t k_bssid[6] = { 0x24, 0x0a, 0xc4, 0xaa, 0xbb, 0xcc };
+
+static void check_backoff(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    HOST_CHECK(wifi_start(NULL) == ESP_OK);
+    host_post_event(WIFI_EVENT, WIFI_EVENT_STA_START, NULL);
+
+    // Equal jitter: attempt n waits between half and all of base << n (capped)
+    uint64_t expected_ms = CONFIG_LCM_WIFI_RECONNECT_BASE_MS;
+    for (int attempt = 0; attempt < 12; ++attempt) {
+        post_disconnect(201);
+        uint64_t delay_ms = host_timer_last_timeout_us("wifi_reconnect") / 1000U;
+        printf("  %-16s attempt %2d: %6" PRIu64 " ms (window %" PRIu64 "..%" PRIu64 ")\n",
+               "backoff", attempt, delay_ms, expected_ms / 2U, expected_ms);
+        HOST_CHECK(delay_ms >= expected_ms / 2U && delay_ms <= expected_ms);
+        HOST_CHECK(host_timer_armed("wifi_reconnect"));
+        host_advance_ms((int64_t)delay_ms);
+        HOST_CHECK(!host_timer_armed("wifi_reconnect"));
+
+        expected_ms *= 2U;
+        if (expected_ms > CONFIG_LCM_WIFI_RECONNECT_MAX_MS) {
+            expected_ms = CONFIG_LCM_WIFI_RECONNECT_MAX_MS;
+        }
+    }
+
+    post_connected(k_bssid, 6);
+    post_got_ip(0x3201a8c0);
+
+    // No association parameters stored yet
+    lifecycle_wifi_connect_stats_t connect;
+    lifecycle_get_wifi_connect_stats(&connect);
+    HOST_CHECK(connect.last_path == LIFECYCLE_WIFI_CONNECT_PATH_FULL_SCAN);
+
+    lifecycle_wifi_reconnect_stats_t stats;
+    lifecycle_get_wifi_reconnect_stats(&stats);
+    HOST_CHECK(stats.disconnects == 12);
+    HOST_CHECK(stats.reconnects == 1);
+    HOST_CHECK(stats.current_attempt == 0);
+    HOST_CHECK(stats.reasons[0].reason == 201 && stats.reasons[0].count == 12);
+    printf("  %-16s reconnected after %.1f s\n", "backoff", (double)stats.last_reconnect_us / 1e6);
+
+    // A new disconnect starts at the base delay again
+    post_disconnect(8);
+    HOST_CHECK(host_timer_last_timeout_us("wifi_reconnect") <= CONFIG_LCM_WIFI_RECONNECT_BASE_MS * 1000ULL);
+
+    host_platform_stats_t platform;
+    host_platform_get_stats(&platform);
+    HOST_CHECK(platform.wifi_connects == 13);   // STA_START + 12 reconnects
+}
+
+typedef struct {
+    lifecycle_wifi_connect_path_t path;
+    bool directed_fails;
+} connect_args_t;
+
+static void check_connect_path(void *arg) {
+    const connect_args_t *args = arg;
+    boot_lifecycle(NULL);
+    lifecycle_boot_mark(LIFECYCLE_BOOT_GPIO_INIT);
+    HOST_CHECK(wifi_start(NULL) == ESP_OK);
+    lifecycle_boot_mark(LIFECYCLE_BOOT_WIFI_START);
+    host_advance_ms(5);
+
+    host_post_event(WIFI_EVENT, WIFI_EVENT_STA_START, NULL);
+    if (args->directed_fails) {
+        post_disconnect(201);
+    }
+    host_advance_ms(120);
+    host_flash_stats_t before;
+    host_flash_stats_t delta;
+    host_flash_get_stats(&before);
+    post_connected(k_bssid, 6);
+    host_flash_stats_diff(&before, &delta);
+    host_advance_ms(30);
+    post_got_ip(0x3201a8c0);
+
+    lifecycle_wifi_connect_stats_t stats;
+    lifecycle_get_wifi_connect_stats(&stats);
+    HOST_CHECK(stats.last_path == args->path);
+    // Association parameters are only written when they changed
+    HOST_CHECK((delta.entry_writes == 0) == (args->path == LIFECYCLE_WIFI_CONNECT_PATH_FAST));
+
+    uint32_t got_ip = lifecycle_boot_get_stamp(LIFECYCLE_BOOT_GOT_IP, false);
+    uint32_t prev_got_ip = lifecycle_boot_get_stamp(LIFECYCLE_BOOT_GOT_IP, true);
+    printf("  %-16s path %d: got IP at %.1f ms (previous boot %.1f ms), %" PRIu32 " entries written\n",
+           "connect_path", (int)stats.last_path, got_ip / 1000.0, prev_got_ip / 1000.0, delta.entry_writes);
+    HOST_CHECK(got_ip != 0);
+    HOST_CHECK(lifecycle_boot_get_stamp(LIFECYCLE_BOOT_POST_RESET_STATE, false) <
+               lifecycle_boot_get_stamp(LIFECYCLE_BOOT_WIFI_START, false));
+}
+
+static void test_wifi_paths(void) {
+    HOST_CHECK(host_nvs_seed_str("wifi_cfg", "wifi_ssid", "plug-net") == ESP_OK);
+    HOST_CHECK(host_nvs_seed_str("wifi_cfg", "wifi_password", "secret123") == ESP_OK);
+
+    run_boot(check_backoff, NULL, NULL);
+
+    // The backoff boot already stored the association parameters
+    connect_args_t fast = { LIFECYCLE_WIFI_CONNECT_PATH_FAST, false };
+    run_boot(check_connect_path, &fast, NULL);
+    host_power_cycle();
+    run_boot(check_connect_path, &fast, NULL);
+
+    connect_args_t fallback = { LIFECYCLE_WIFI_CONNECT_PATH_FAST_FALLBACK, true };
+    run_boot(check_connect_path, &fallback, NULL);
+}
+
+static void check_boot_timeline(void *arg) {
+    (void)arg;
+    boot_lifecycle(NULL);
+    uint32_t previous = lifecycle_boot_get_stamp(LIFECYCLE_BOOT_CONFIGURE_HOMEKIT, true);
+    uint32_t current = lifecycle_boot_get_stamp(LIFECYCLE_BOOT_CONFIGURE_HOMEKIT, false);
+    HOST_CHECK(previous != 0 && current != 0);
+    HOST_CHECK(lifecycle_boot_get_stamp(LIFECYCLE_BOOT_NVS_INIT, false) <=
+               lifecycle_boot_get_stamp(LIFECYCLE_BOOT_POST_RESET_STATE, false));
+
+    homekit_value_t value = lifecycle_boot_timeline_get(NULL);
+    HOST_CHECK(value.format == homekit_format_string);
+    HOST_CHECK(strncmp(value.string_value, "cur=", 4) == 0);
+    HOST_CHECK(strstr(value.string_value, ";prev=") != NULL);
+    printf("  %-16s %s\n", "boot_timeline", value.string_value);
+}
+
+static void test_boot_timeline(void) {
+    run_boot(boot_lifecycle, NULL, NULL);
+    run_boot(check_boot_timeline, NULL, NULL);
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+} test_case_t;
+
+static const test_case_t k_tests[] = {
+    { "first_and_warm_boot", test_first_and_warm_boot },
+    { "firmware_update_and_counter_timeout", test_firmware_update_and_counter_timeout },
+    { "restart_storm", test_restart_storm },
+    { "factory_reset", test_factory_reset },
+    { "update_request", test_update_request },
+    { "shutdown_drain", test_shutdown_drain },
+    { "hap_budget", test_hap_budget },
+    { "legacy_migration", test_legacy_migration },
+    { "record_recovery", test_record_recovery },
+    { "wifi_paths", test_wifi_paths },
+    { "boot_timeline", test_boot_timeline },
+};
+
+int main(int argc, char **argv) {
+    const char *only = (argc > 1) ? argv[1] : NULL;
+    uint32_t failed_tests = 0;
+
+    printf("esp32-lcm host suite (%s factory reset)\n",
+           CONFIG_LCM_FAST_FACTORY_RESET ? "fast" : "full");
+
+    for (size_t i = 0; i < sizeof(k_tests) / sizeof(k_tests[0]); ++i) {
+        if (only != NULL && strcmp(only, k_tests[i].name) != 0) {
+            continue;
+        }
+        host_device_reset();
+        uint32_t before = host_failures();
+        printf("[ RUN  ] %s\n", k_tests[i].name);
+        k_tests[i].fn();
+        bool ok = host_failures() == before;
+        printf("[ %s ] %s\n", ok ? " OK " : "FAIL", k_tests[i].name);
+        if (!ok) {
+            failed_tests++;
+        }
+    }
+
+    printf("%" PRIu32 " test(s) failed\n", failed_tests);
+    return failed_tests == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
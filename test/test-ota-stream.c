@@ -0,0 +1,496 @@
+/**
+   Copyright 2025 Achim Pieters | StudioPieters®
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NON INFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+   WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   for more information visit https://www.studiopieters.nl
+ **/
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <esp_partition.h>
+
+#include "ota-stream.h"
+
+// Host tests for the update stream decoder in main/ota-stream.c: plain,
+// zlib and SPD1 delta payloads are decoded against a reference image, fed in
+// chunks that split every header, op and block, plus truncated and corrupt
+// input. The base partition is an in-memory image.
+
+#define BASE_SIZE       (192 * 1024)
+#define TARGET_SIZE     (160 * 1024)
+#define OUT_MAX         (256 * 1024)
+
+static uint32_t s_failures;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static bool check(bool ok, const char *expr, int line) {
+    if (!ok) {
+        s_failures++;
+        fprintf(stderr, "test-ota-stream.c:%d: check failed: %s\n", line, expr);
+    }
+    return ok;
+}
+
+// ---- Platform ------------------------------------------------------------
+
+static uint8_t s_base_image[BASE_SIZE];
+static const uint8_t k_base_sha[32] = {
+    0x5b, 0x1d, 0x0c, 0x7e, 0x22, 0x9a, 0x41, 0x03, 0xd8, 0x6f, 0xe0, 0x11, 0x35, 0xc4, 0x7a, 0x90,
+    0x0e, 0xb3, 0x58, 0x26, 0xf1, 0x4c, 0x99, 0x62, 0x17, 0xad, 0x3e, 0x85, 0xca, 0x70, 0x04, 0xeb,
+};
+static const esp_partition_t k_base = {
+    .type = ESP_PARTITION_TYPE_APP,
+    .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0,
+    .address = 0x20000,
+    .size = BASE_SIZE,
+    .label = "ota_0",
+};
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (partition != &k_base || src_offset + size > BASE_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, s_base_image + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256) {
+    if (partition != &k_base) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(sha_256, k_base_sha, sizeof(k_base_sha));
+    return ESP_OK;
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...) {
+    const char *env = getenv("HOST_VERBOSE");
+    if (env == NULL || env[0] != '1') {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    printf("    %c (%s) ", level, tag);
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+}
+
+// ---- Images --------------------------------------------------------------
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+static void buf_put(buf_t *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        b->cap = (b->len + len) * 2;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void buf_put_u8(buf_t *b, uint8_t v) {
+    buf_put(b, &v, 1);
+}
+
+static void buf_put_le32(buf_t *b, uint32_t v) {
+    uint8_t le[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    buf_put(b, le, sizeof(le));
+}
+
+static uint32_t s_rng = 0x2545f491U;
+
+static uint8_t next_byte(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return (uint8_t)s_rng;
+}
+
+// App-image-like content: the magic byte, then runs of repeated words mixed
+// with noise so zlib has something to do and the output is not trivial
+static void fill_image(uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = ((i / 64) % 3 == 0) ? next_byte() : (uint8_t)(i * 7 / 64);
+    }
+    out[0] = 0xE9;
+}
+
+static uint8_t s_target[TARGET_SIZE];
+
+typedef struct {
+    uint8_t op;
+    uint32_t offset;    // COPY: offset in the base
+    uint32_t len;
+} patch_op_t;
+
+// Target = base pieces moved around plus new bytes in between. The COPYs cross
+// output block boundaries and the INSERTs are larger than one block.
+static const patch_op_t k_patch_ops[] = {
+    { OTA_STREAM_OP_COPY, 0, 10000 },
+    { OTA_STREAM_OP_INSERT, 0, 5000 },
+    { OTA_STREAM_OP_COPY, 50000, 40000 },
+    { OTA_STREAM_OP_INSERT, 0, 1 },
+    { OTA_STREAM_OP_INSERT, 0, 0 },
+    { OTA_STREAM_OP_COPY, 20000, 30000 },
+    { OTA_STREAM_OP_INSERT, 0, 12345 },
+    { OTA_STREAM_OP_COPY, BASE_SIZE - 100, 100 },
+};
+
+// Builds the patch and the reference target it must decode to
+static void build_patch(buf_t *patch, const uint8_t *sha, uint32_t target_size) {
+    size_t out = 0;
+    buf_put(patch, OTA_STREAM_DELTA_MAGIC, 4);
+    buf_put_le32(patch, target_size);
+    buf_put(patch, sha, 32);
+    for (size_t i = 0; i < sizeof(k_patch_ops) / sizeof(k_patch_ops[0]); ++i) {
+        const patch_op_t *op = &k_patch_ops[i];
+        buf_put_u8(patch, op->op);
+        if (op->op == OTA_STREAM_OP_COPY) {
+            buf_put_le32(patch, op->offset);
+            buf_put_le32(patch, op->len);
+            memcpy(s_target + out, s_base_image + op->offset, op->len);
+        } else {
+            buf_put_le32(patch, op->len);
+            for (uint32_t j = 0; j < op->len; ++j) {
+                s_target[out + j] = next_byte();
+            }
+            buf_put(patch, s_target + out, op->len);
+        }
+        out += op->len;
+    }
+    buf_put_u8(patch, OTA_STREAM_OP_END);
+}
+
+static size_t patch_target_size(void) {
+    size_t size = 0;
+    for (size_t i = 0; i < sizeof(k_patch_ops) / sizeof(k_patch_ops[0]); ++i) {
+        size += k_patch_ops[i].len;
+    }
+    return size;
+}
+
+static void zlib_compress(const buf_t *in, buf_t *out) {
+    uLongf len = compressBound(in->len);
+    out->data = malloc(len);
+    CHECK(compress2(out->data, &len, in->data, in->len, 9) == Z_OK);
+    out->len = len;
+    out->cap = len;
+}
+
+// ---- Decoding ------------------------------------------------------------
+
+typedef struct {
+    buf_t out;
+    uint32_t writes;
+    uint32_t max_write;
+    esp_err_t fail_at_write;    // != ESP_OK: fail the second write with this
+} sink_t;
+
+static esp_err_t sink_write(void *ctx, const void *data, size_t len) {
+    sink_t *sink = ctx;
+    sink->writes++;
+    if (len > sink->max_write) {
+        sink->max_write = (uint32_t)len;
+    }
+    if (sink->fail_at_write != ESP_OK && sink->writes == 2) {
+        return sink->fail_at_write;
+    }
+    if (sink->out.len + len > OUT_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    buf_put(&sink->out, data, len);
+    return ESP_OK;
+}
+
+// Feed 'in' in chunks of 'chunk' bytes; returns the first error
+static esp_err_t decode(const buf_t *in, size_t chunk, sink_t *sink, ota_stream_stats_t *stats) {
+    ota_stream_t *stream = NULL;
+    esp_err_t err = ota_stream_begin(&k_base, sink_write, sink, &stream);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t pos = 0; pos < in->len; pos += chunk) {
+        size_t len = (in->len - pos < chunk) ? in->len - pos : chunk;
+        err = ota_stream_feed(stream, in->data + pos, len);
+        if (err != ESP_OK) {
+            ota_stream_abort(stream);
+            return err;
+        }
+    }
+    return ota_stream_finish(stream, stats);
+}
+
+static bool output_equals(const sink_t *sink, const uint8_t *ref, size_t len) {
+    return sink->out.len == len && memcmp(sink->out.data, ref, len) == 0;
+}
+
+static void sink_free(sink_t *sink) {
+    free(sink->out.data);
+    memset(sink, 0, sizeof(*sink));
+}
+
+// Chunk sizes: byte by byte (every state boundary), odd, one block, all at once
+static const size_t k_chunks[] = { 1, 7, 1000, OTA_STREAM_BLOCK_SIZE, SIZE_MAX / 2 };
+
+static void report(const char *name, const buf_t *in, const ota_stream_stats_t *stats) {
+    printf("  %-20s %7zu -> %7" PRIu32 " bytes (%" PRIu32 " from base)\n", name, in->len,
+           stats->out_bytes, stats->base_bytes);
+}
+
+// ---- Tests ---------------------------------------------------------------
+
+static void test_plain_image(void) {
+    buf_t image = { 0 };
+    buf_put(&image, s_target, TARGET_SIZE);
+
+    for (size_t i = 0; i < sizeof(k_chunks) / sizeof(k_chunks[0]); ++i) {
+        sink_t sink = { 0 };
+        ota_stream_stats_t stats;
+        CHECK(decode(&image, k_chunks[i], &sink, &stats) == ESP_OK);
+        CHECK(output_equals(&sink, s_target, TARGET_SIZE));
+        CHECK(!stats.compressed && !stats.delta);
+        CHECK(sink.max_write <= OTA_STREAM_BLOCK_SIZE);
+        if (i == 0) {
+            report("plain", &image, &stats);
+        }
+        sink_free(&sink);
+    }
+    free(image.data);
+}
+
+static void test_compressed_image(void) {
+    buf_t image = { 0 };
+    buf_t packed;
+    buf_put(&image, s_target, TARGET_SIZE);
+    zlib_compress(&image, &packed);
+    CHECK(packed.len < image.len);
+
+    for (size_t i = 0; i < sizeof(k_chunks) / sizeof(k_chunks[0]); ++i) {
+        sink_t sink = { 0 };
+        ota_stream_stats_t stats;
+        CHECK(decode(&packed, k_chunks[i], &sink, &stats) == ESP_OK);
+        CHECK(output_equals(&sink, s_target, TARGET_SIZE));
+        CHECK(stats.compressed && !stats.delta);
+        CHECK(stats.in_bytes == packed.len);
+        CHECK(sink.max_write <= OTA_STREAM_BLOCK_SIZE);
+        if (i == 0) {
+            report("zlib", &packed, &stats);
+        }
+        sink_free(&sink);
+    }
+    free(image.data);
+    free(packed.data);
+}
+
+static void test_delta_patch(void) {
+    buf_t patch = { 0 };
+    build_patch(&patch, k_base_sha, (uint32_t)patch_target_size());
+    size_t size = patch_target_size();
+
+    for (size_t i = 0; i < sizeof(k_chunks) / sizeof(k_chunks[0]); ++i) {
+        sink_t sink = { 0 };
+        ota_stream_stats_t stats;
+        CHECK(decode(&patch, k_chunks[i], &sink, &stats) == ESP_OK);
+        CHECK(output_equals(&sink, s_target, size));
+        CHECK(!stats.compressed && stats.delta);
+        CHECK(stats.base_bytes == 10000 + 40000 + 30000 + 100);
+        CHECK(sink.max_write <= OTA_STREAM_BLOCK_SIZE);
+        if (i == 0) {
+            report("delta", &patch, &stats);
+        }
+        sink_free(&sink);
+    }
+    free(patch.data);
+}
+
+static void test_compressed_delta_patch(void) {
+    buf_t patch = { 0 };
+    buf_t packed;
+    build_patch(&patch, k_base_sha, (uint32_t)patch_target_size());
+    zlib_compress(&patch, &packed);
+
+    for (size_t i = 0; i < sizeof(k_chunks) / sizeof(k_chunks[0]); ++i) {
+        sink_t sink = { 0 };
+        ota_stream_stats_t stats;
+        CHECK(decode(&packed, k_chunks[i], &sink, &stats) == ESP_OK);
+        CHECK(output_equals(&sink, s_target, patch_target_size()));
+        CHECK(stats.compressed && stats.delta);
+        if (i == 0) {
+            report("zlib delta", &packed, &stats);
+        }
+        sink_free(&sink);
+    }
+    free(patch.data);
+    free(packed.data);
+}
+
+static esp_err_t decode_once(const buf_t *in, size_t chunk) {
+    sink_t sink = { 0 };
+    ota_stream_stats_t stats;
+    esp_err_t err = decode(in, chunk, &sink, &stats);
+    sink_free(&sink);
+    return err;
+}
+
+static void test_truncated(void) {
+    buf_t patch = { 0 };
+    buf_t packed;
+    build_patch(&patch, k_base_sha, (uint32_t)patch_target_size());
+    zlib_compress(&patch, &packed);
+
+    // Cut inside the header, inside the first INSERT (header, COPY op, INSERT
+    // op, 2000 of its 5000 bytes) and just before END
+    const size_t cuts[] = { 20, 40 + 9 + 5 + 2000, patch.len - 1 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i) {
+        buf_t cut = { .data = patch.data, .len = cuts[i] };
+        CHECK(decode_once(&cut, 1000) == ESP_ERR_INVALID_SIZE);
+    }
+
+    // Compressed stream without its last bytes (adler32 and the final block)
+    buf_t cut = { .data = packed.data, .len = packed.len - 6 };
+    CHECK(decode_once(&cut, 1000) == ESP_ERR_INVALID_SIZE);
+
+    // Empty download
+    buf_t empty = { 0 };
+    CHECK(decode_once(&empty, 1000) == ESP_ERR_INVALID_SIZE);
+
+    free(patch.data);
+    free(packed.data);
+}
+
+static void test_corrupt(void) {
+    buf_t patch = { 0 };
+    build_patch(&patch, k_base_sha, (uint32_t)patch_target_size());
+    const size_t first_op = 4 + 4 + 32;
+
+    // Patch for another base image
+    uint8_t other_sha[32];
+    memcpy(other_sha, k_base_sha, sizeof(other_sha));
+    other_sha[31] ^= 0x01;
+    buf_t wrong_base = { 0 };
+    build_patch(&wrong_base, other_sha, (uint32_t)patch_target_size());
+    CHECK(decode_once(&wrong_base, 1000) == ESP_ERR_INVALID_VERSION);
+    free(wrong_base.data);
+
+    // Declared target size does not match the ops
+    buf_t wrong_size = { 0 };
+    build_patch(&wrong_size, k_base_sha, (uint32_t)patch_target_size() + 1);
+    CHECK(decode_once(&wrong_size, 1000) == ESP_ERR_INVALID_SIZE);
+    free(wrong_size.data);
+
+    buf_t bad = { .data = malloc(patch.len + 1), .len = patch.len };
+
+    // Unknown op
+    memcpy(bad.data, patch.data, patch.len);
+    bad.data[first_op] = 0x7f;
+    CHECK(decode_once(&bad, 1000) == ESP_ERR_INVALID_RESPONSE);
+
+    // COPY beyond the end of the base partition (offset and length overflow)
+    memcpy(bad.data, patch.data, patch.len);
+    bad.data[first_op + 5] = 0xff;
+    bad.data[first_op + 6] = 0xff;
+    bad.data[first_op + 7] = 0xff;
+    bad.data[first_op + 8] = 0xff;
+    CHECK(decode_once(&bad, 1000) == ESP_ERR_INVALID_SIZE);
+
+    // Bad magic after a matching first byte
+    memcpy(bad.data, patch.data, patch.len);
+    bad.data[3] = 'X';
+    CHECK(decode_once(&bad, 1000) == ESP_ERR_NOT_SUPPORTED);
+
+    // Data after END
+    memcpy(bad.data, patch.data, patch.len);
+    bad.data[patch.len] = 0x00;
+    bad.len = patch.len + 1;
+    CHECK(decode_once(&bad, 1000) == ESP_ERR_INVALID_SIZE);
+
+    // Neither an image, a patch nor zlib
+    bad.data[0] = 0x42;
+    CHECK(decode_once(&bad, 1000) == ESP_ERR_NOT_SUPPORTED);
+    free(bad.data);
+
+    // Flipped byte inside the compressed data
+    buf_t image = { 0 };
+    buf_t packed;
+    buf_put(&image, s_target, TARGET_SIZE);
+    zlib_compress(&image, &packed);
+    packed.data[packed.len / 2] ^= 0x55;
+    CHECK(decode_once(&packed, 1000) == ESP_ERR_INVALID_RESPONSE);
+    free(image.data);
+    free(packed.data);
+
+    // A failing flash write stops the stream with that error
+    sink_t sink = { .fail_at_write = ESP_FAIL };
+    ota_stream_stats_t stats;
+    CHECK(decode(&patch, 1000, &sink, &stats) == ESP_FAIL);
+    sink_free(&sink);
+
+    free(patch.data);
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+} test_case_t;
+
+static const test_case_t k_tests[] = {
+    { "plain_image", test_plain_image },
+    { "compressed_image", test_compressed_image },
+    { "delta_patch", test_delta_patch },
+    { "compressed_delta_patch", test_compressed_delta_patch },
+    { "truncated", test_truncated },
+    { "corrupt", test_corrupt },
+};
+
+int main(int argc, char **argv) {
+    const char *only = (argc > 1) ? argv[1] : NULL;
+    uint32_t failed_tests = 0;
+
+    fill_image(s_base_image, BASE_SIZE);
+    fill_image(s_target, TARGET_SIZE);
+    printf("ota-stream host suite\n");
+
+    for (size_t i = 0; i < sizeof(k_tests) / sizeof(k_tests[0]); ++i) {
+        if (only != NULL && strcmp(only, k_tests[i].name) != 0) {
+            continue;
+        }
+        uint32_t before = s_failures;
+        printf("[ RUN  ] %s\n", k_tests[i].name);
+        k_tests[i].fn();
+        bool ok = s_failures == before;
+        printf("[ %s ] %s\n", ok ? " OK " : "FAIL", k_tests[i].name);
+        if (!ok) {
+            failed_tests++;
+        }
+    }
+
+    printf("%" PRIu32 " test(s) failed\n", failed_tests);
+    return failed_tests == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}